@@ -0,0 +1,109 @@
+#define	GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "OcclusionBuffer.h"
+#include "ThreadPool.h"
+
+//headless checks of the cpu occlusion buffer, no window or device, exits non zero when any fails
+
+static const uint32_t WIDTH = 256;
+static const uint32_t HEIGHT = 128;
+
+static int failures = 0;
+
+static void Check(bool passed, const std::string& name)
+{
+	std::cout << (passed ? "passed: " : "FAILED: ") << name << std::endl;
+	if (!passed)
+		++failures;
+}
+
+//looking down -z at the origin from 5 units away
+static glm::mat4 GetViewProj()
+{
+	auto projection = glm::perspective(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f);
+	auto view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	return projection * view;
+}
+
+static void TestQuad()
+{
+	ThreadPool threadPool(2);
+
+	//2x2 quad in the z = 0 plane facing the camera
+	Occluder quad;
+	quad.positions = { glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f) };
+	quad.indices = { 0, 1, 2, 0, 2, 3 };
+
+	OcclusionBuffer occlusionBuffer;
+	occlusionBuffer.Init(WIDTH, HEIGHT);
+	occlusionBuffer.AddOccluder(&quad, glm::mat4(1.0f));
+	occlusionBuffer.Rasterize(&threadPool, GetViewProj());
+
+	Check(occlusionBuffer.GetTriangleCount() == 2, "quad rasterizes as two triangles");
+	Check(occlusionBuffer.IsOccluded(glm::vec3(0.0f, 0.0f, -2.0f), 0.3f), "sphere behind the quad is occluded");
+	Check(!occlusionBuffer.IsOccluded(glm::vec3(0.0f, 0.0f, 2.0f), 0.3f), "sphere in front of the quad is visible");
+	Check(!occlusionBuffer.IsOccluded(glm::vec3(1.0f, 0.0f, -2.0f), 0.5f), "sphere behind the quad's edge, partly outside it, is visible");
+}
+
+//the same pseudo random occluders on every call, only the worker count differs
+static std::vector<float> RasterizeScene(size_t threadCount)
+{
+	ThreadPool threadPool(threadCount);
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coord(-2.0f, 2.0f);
+
+	std::vector<Occluder> occluders(16);
+	for (auto& occluder : occluders)
+	{
+		for (uint32_t v = 0; v < 3 * 32; ++v)
+		{
+			occluder.positions.push_back(glm::vec3(coord(random), coord(random), coord(random)));
+			occluder.indices.push_back(v);
+		}
+	}
+
+	//width and height that neither the 4 pixel groups nor the row bands divide evenly
+	OcclusionBuffer occlusionBuffer;
+	occlusionBuffer.Init(WIDTH - 3, HEIGHT + 5);
+	for (const auto& occluder : occluders)
+		occlusionBuffer.AddOccluder(&occluder, glm::mat4(1.0f));
+	occlusionBuffer.Rasterize(&threadPool, GetViewProj());
+
+	return occlusionBuffer.GetDepth();
+}
+
+static void TestThreadCounts()
+{
+	auto reference = RasterizeScene(1);
+
+	size_t covered = 0;
+	for (auto d : reference)
+		covered += d < 1.0f ? 1 : 0;
+	Check(covered > 0 && covered < reference.size(), "random occluders cover part of the buffer");
+
+	for (size_t threadCount : { 2, 3, 8 })
+	{
+		auto depth = RasterizeScene(threadCount);
+		Check(depth.size() == reference.size() && memcmp(depth.data(), reference.data(), sizeof(float) * depth.size()) == 0,
+			"depth with " + std::to_string(threadCount) + " workers is bit identical to 1 worker");
+	}
+}
+
+int main()
+{
+	TestQuad();
+	TestThreadCounts();
+
+	std::cout << (failures == 0 ? "all occlusion buffer tests passed" : std::to_string(failures) + " occlusion buffer tests failed") << std::endl;
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,547 @@
+#include "DrawList.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <emmintrin.h>
+
+DrawList::DrawList()
+{
+}
+
+void DrawList::Build(std::vector<MeshModel>& models)
+{
+	indexCounts.clear();
+	firstIndices.clear();
+	vertexOffsets.clear();
+	texIds.clear();
+	objectIds.clear();
+	uploadValues.clear();
+	meshIds.clear();
+	localSpheres.clear();
+	lodCounts.clear();
+	lodIndexCounts.clear();
+	lodFirstIndices.clear();
+	lodErrors.clear();
+	meshlets.clear();
+	meshletCounts.clear();
+	meshletVertexOffsets.clear();
+	meshletTriangleOffsets.clear();
+
+	//models placed from the same file share pool ranges, so first index + vertex offset identify a mesh
+	std::unordered_map<uint64_t, uint32_t> meshIdLookup;
+
+	for (size_t i = 0; i < models.size(); ++i)
+	{
+		auto& mm = models[i];
+
+		for (size_t k = 0; k < mm.GetMeshCount(); ++k)
+		{
+			auto mesh = mm.GetMesh(k);
+			if (mesh->GetIndexCount() == 0)
+				continue;
+
+			indexCounts.push_back(static_cast<uint32_t>(mesh->GetIndexCount()));
+			firstIndices.push_back(mesh->GetFirstIndex());
+			vertexOffsets.push_back(static_cast<int32_t>(mesh->GetVertexOffset()));
+			texIds.push_back(static_cast<uint32_t>(mesh->GetTexId()));
+			objectIds.push_back(static_cast<uint32_t>(i));
+			uploadValues.push_back(mm.GetUploadValue());
+
+			auto geometryKey = (static_cast<uint64_t>(mesh->GetFirstIndex()) << 32) | mesh->GetVertexOffset();
+			auto found = meshIdLookup.emplace(geometryKey, static_cast<uint32_t>(meshIdLookup.size()));
+			meshIds.push_back(found.first->second);
+
+			localSpheres.push_back(mesh->GetBoundingSphere());
+
+			meshlets.push_back(mesh->GetMeshlets().data());
+			meshletCounts.push_back(static_cast<uint32_t>(mesh->GetMeshlets().size()));
+			meshletVertexOffsets.push_back(mesh->HasMeshletGeometry() ? mesh->GetMeshletVertexOffset() : UINT32_MAX);
+			meshletTriangleOffsets.push_back(mesh->HasMeshletGeometry() ? mesh->GetMeshletTriangleOffset() : UINT32_MAX);
+
+			lodCounts.push_back(static_cast<uint8_t>(mesh->GetLodCount()));
+			for (int l = 0; l < static_cast<int>(MAX_MESH_LODS); ++l)
+			{
+				//missing levels repeat the coarsest one
+				auto level = std::min(l, mesh->GetLodCount() - 1);
+				lodIndexCounts.push_back(static_cast<uint32_t>(mesh->GetLodIndexCount(level)));
+				lodFirstIndices.push_back(mesh->GetLodFirstIndex(level));
+				lodErrors.push_back(mesh->GetLodError(level));
+			}
+		}
+	}
+
+	//everything counts as visible until the first Cull
+	visible.assign(indexCounts.size(), 1);
+	visibleCount = indexCounts.size();
+	occludedCount = 0;
+	lods.assign(indexCounts.size(), 0);
+
+	order.resize(indexCounts.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = static_cast<uint32_t>(i);
+
+	dirty = false;
+}
+
+void DrawList::Sort(const std::vector<float>& objectDepths)
+{
+	sortKeys.resize(indexCounts.size());
+	for (size_t i = 0; i < indexCounts.size(); ++i)
+	{
+		auto depth = objectIds[i] < objectDepths.size() ? objectDepths[objectIds[i]] : 0.0f;
+		//one pipeline and one geometry pool so far, the fields are kept so new ones sort in without a key change
+		sortKeys[i] = MakeSortKey(0, texIds[i], 0, meshIds[i] * MAX_MESH_LODS + lods[i], depth);
+	}
+
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = static_cast<uint32_t>(i);
+
+	RadixSort();
+}
+
+const std::vector<uint32_t>& DrawList::GetOrder()
+{
+	return order;
+}
+
+void DrawList::ExtractFrustumPlanes(const glm::mat4& viewProj, glm::vec4* planes)
+{
+	//gribb/hartmann, rows of the matrix combined
+	auto row = [&](int r) { return glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]); };
+	planes[0] = row(3) + row(0);
+	planes[1] = row(3) - row(0);
+	planes[2] = row(3) + row(1);
+	planes[3] = row(3) - row(1);
+	planes[4] = row(3) + row(2); //-w <= z, looser than the 0 <= z of zero to one depth, so never culls too much
+	planes[5] = row(3) - row(2);
+
+	for (int p = 0; p < 6; ++p)
+		planes[p] /= glm::length(glm::vec3(planes[p]));
+}
+
+size_t DrawList::Cull(const glm::mat4& viewProj, const std::vector<glm::mat4>& objectModels)
+{
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(viewProj, planes);
+
+	auto count = indexCounts.size();
+	auto padded = (count + 3) & ~static_cast<size_t>(3);
+	sphereX.resize(padded);
+	sphereY.resize(padded);
+	sphereZ.resize(padded);
+	sphereR.resize(padded);
+	visible.resize(padded);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& m = objectModels[objectIds[i]];
+		const auto& s = localSpheres[i];
+
+		auto center = m * glm::vec4(glm::vec3(s), 1.0f);
+		//non uniform scale grows the sphere by the longest axis
+		auto scaleSq = std::max(std::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+			glm::dot(glm::vec3(m[1]), glm::vec3(m[1]))), glm::dot(glm::vec3(m[2]), glm::vec3(m[2])));
+
+		sphereX[i] = center.x;
+		sphereY[i] = center.y;
+		sphereZ[i] = center.z;
+		sphereR[i] = s.w * std::sqrt(scaleSq);
+	}
+
+	for (size_t i = count; i < padded; ++i)
+	{
+		sphereX[i] = sphereY[i] = sphereZ[i] = 0.0f;
+		sphereR[i] = 0.0f;
+	}
+
+	CullSpheres(sphereX.data(), sphereY.data(), sphereZ.data(), sphereR.data(), padded, planes, visible.data());
+
+	visible.resize(count);
+	visibleCount = 0;
+	occludedCount = 0;
+	for (size_t i = 0; i < count; ++i)
+		visibleCount += visible[i];
+
+	return visibleCount;
+}
+
+size_t DrawList::GetVisibleCount()
+{
+	return visibleCount;
+}
+
+size_t DrawList::GetCulledCount()
+{
+	return indexCounts.size() - visibleCount;
+}
+
+size_t DrawList::CullOccluded(const OcclusionBuffer& occlusionBuffer)
+{
+	occludedCount = 0;
+	for (size_t i = 0; i < visible.size(); ++i)
+	{
+		if (visible[i] && occlusionBuffer.IsOccluded(glm::vec3(sphereX[i], sphereY[i], sphereZ[i]), sphereR[i]))
+		{
+			visible[i] = 0;
+			++occludedCount;
+		}
+	}
+
+	visibleCount -= occludedCount;
+	return occludedCount;
+}
+
+size_t DrawList::GetOccludedCount()
+{
+	return occludedCount;
+}
+
+void DrawList::SelectLods(const glm::vec3& cameraPos, float pixelsPerUnit)
+{
+	for (size_t i = 0; i < visible.size(); ++i)
+	{
+		if (!visible[i])
+			continue;
+
+		//error measured at the sphere's nearest point, the camera inside it always gets the full mesh
+		auto center = glm::vec3(sphereX[i], sphereY[i], sphereZ[i]);
+		auto distance = glm::length(center - cameraPos) - sphereR[i];
+		if (distance <= 0.0f)
+		{
+			lods[i] = 0;
+			continue;
+		}
+
+		//object space errors grow with the model matrix like the sphere did
+		auto errorToPixels = sphereR[i] / std::max(localSpheres[i].w, 1e-6f) * pixelsPerUnit / distance;
+		auto errors = &lodErrors[i * MAX_MESH_LODS];
+
+		int lod = std::min<int>(lods[i], lodCounts[i] - 1);
+		while (lod > 0 && errors[lod] * errorToPixels > LOD_PIXEL_ERROR)
+			--lod;
+		while (lod + 1 < lodCounts[i] && errors[lod + 1] * errorToPixels <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+			++lod;
+
+		lods[i] = static_cast<uint8_t>(lod);
+	}
+}
+
+size_t DrawList::CullClusters(uint32_t d, const glm::mat4& model, const glm::vec4* planes, const glm::vec3& cameraPos,
+	std::vector<IndexRun>* runs)
+{
+	runs->clear();
+
+	//facing is tested in object space, it survives any model matrix, the frustum in world space like Cull
+	auto localCamera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+	auto scale = std::sqrt(std::max(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+		glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+	size_t culled = 0;
+	for (uint32_t k = 0; k < meshletCounts[d]; ++k)
+	{
+		const auto& m = meshlets[d][k];
+
+		auto toCenter = glm::vec3(m.sphere) - localCamera;
+		bool visible = glm::dot(toCenter, glm::vec3(m.cone)) < m.cone.w * glm::length(toCenter) + m.sphere.w;
+
+		auto center = glm::vec3(model * glm::vec4(glm::vec3(m.sphere), 1.0f));
+		auto radius = m.sphere.w * scale;
+		for (int p = 0; p < 6 && visible; ++p)
+			visible = glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -radius;
+
+		if (!visible)
+		{
+			++culled;
+			continue;
+		}
+
+		//meshlets are in index order, surviving neighbours stay one draw
+		auto first = firstIndices[d] + m.firstIndex;
+		if (!runs->empty() && runs->back().firstIndex + runs->back().indexCount == first)
+			runs->back().indexCount += m.indexCount;
+		else
+			runs->push_back({ first, m.indexCount });
+	}
+
+	return culled;
+}
+
+uint64_t DrawList::GetVisibleTriangles(bool selectedLods)
+{
+	uint64_t triangles = 0;
+	for (size_t i = 0; i < visible.size(); ++i)
+	{
+		if (visible[i])
+			triangles += lodIndexCounts[i * MAX_MESH_LODS + (selectedLods ? lods[i] : 0)] / 3;
+	}
+
+	return triangles;
+}
+
+uint64_t DrawList::BuildBatches(uint64_t completedUploadValue, uint32_t* instanceObjects, size_t maxInstances)
+{
+	batchDraws.clear();
+	batchFirstInstances.clear();
+	batchInstanceCounts.clear();
+	instanceCount = 0;
+
+	uint64_t maxUploadValue = 0;
+
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		auto d = order[i];
+
+		//still streaming in, show it once its upload is done instead of stalling the frame
+		if (!visible[d] || uploadValues[d] > completedUploadValue)
+			continue;
+
+		if (instanceCount == maxInstances)
+			throw std::runtime_error("more instances than instance stream entries");
+
+		maxUploadValue = std::max(maxUploadValue, uploadValues[d]);
+
+		//sorting put equal mesh, level + texture next to each other, extend the open batch instead of starting one
+		if (batchDraws.empty() || meshIds[batchDraws.back()] != meshIds[d] || lods[batchDraws.back()] != lods[d] ||
+			texIds[batchDraws.back()] != texIds[d])
+		{
+			batchDraws.push_back(d);
+			batchFirstInstances.push_back(static_cast<uint32_t>(instanceCount));
+			batchInstanceCounts.push_back(0);
+		}
+
+		instanceObjects[instanceCount++] = objectIds[d];
+		++batchInstanceCounts.back();
+	}
+
+	return maxUploadValue;
+}
+
+size_t DrawList::GetBatchCount()
+{
+	return batchDraws.size();
+}
+
+size_t DrawList::GetInstanceCount()
+{
+	return instanceCount;
+}
+
+const std::vector<uint32_t>& DrawList::GetBatchDraws()
+{
+	return batchDraws;
+}
+
+const std::vector<uint32_t>& DrawList::GetBatchFirstInstances()
+{
+	return batchFirstInstances;
+}
+
+const std::vector<uint32_t>& DrawList::GetBatchInstanceCounts()
+{
+	return batchInstanceCounts;
+}
+
+uint64_t DrawList::MakeSortKey(uint32_t pipelineId, uint32_t texId, uint32_t geometryId, uint32_t meshId, float depth)
+{
+	//pipeline 63..60, texture 59..48, geometry 47..44, mesh 43..24, depth 23..0
+	auto d = std::min(std::max((depth - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE), 0.0f), 1.0f);
+	auto quantDepth = static_cast<uint64_t>(d * 0xFFFFFF);
+
+	return (static_cast<uint64_t>(pipelineId & 0xF) << 60) |
+		(static_cast<uint64_t>(texId & 0xFFF) << 48) |
+		(static_cast<uint64_t>(geometryId & 0xF) << 44) |
+		(static_cast<uint64_t>(meshId & 0xFFFFF) << 24) |
+		quantDepth;
+}
+
+void DrawList::RadixSort()
+{
+	//lsd, a byte per pass, passes where every key has the same byte are skipped
+	auto count = sortKeys.size();
+	keyScratch.resize(count);
+	orderScratch.resize(count);
+
+	uint64_t* keys = sortKeys.data();
+	uint32_t* vals = order.data();
+	uint64_t* keysOut = keyScratch.data();
+	uint32_t* valsOut = orderScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (size_t i = 0; i < count; ++i)
+			++histogram[(keys[i] >> shift) & 0xFF];
+
+		if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		size_t sum = 0;
+		for (int b = 0; b < 256; ++b)
+		{
+			auto c = histogram[b];
+			histogram[b] = sum;
+			sum += c;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto dst = histogram[(keys[i] >> shift) & 0xFF]++;
+			keysOut[dst] = keys[i];
+			valsOut[dst] = vals[i];
+		}
+
+		std::swap(keys, keysOut);
+		std::swap(vals, valsOut);
+	}
+
+	//odd number of passes left the result in scratch
+	if (keys != sortKeys.data())
+	{
+		memcpy(sortKeys.data(), keys, sizeof(uint64_t) * count);
+		memcpy(order.data(), vals, sizeof(uint32_t) * count);
+	}
+}
+
+void DrawList::MarkDirty()
+{
+	dirty = true;
+}
+
+bool DrawList::IsDirty()
+{
+	return dirty;
+}
+
+size_t DrawList::GetDrawCount()
+{
+	return indexCounts.size();
+}
+
+const std::vector<uint32_t>& DrawList::GetIndexCounts()
+{
+	return indexCounts;
+}
+
+const std::vector<uint32_t>& DrawList::GetFirstIndices()
+{
+	return firstIndices;
+}
+
+const std::vector<int32_t>& DrawList::GetVertexOffsets()
+{
+	return vertexOffsets;
+}
+
+const std::vector<uint32_t>& DrawList::GetTexIds()
+{
+	return texIds;
+}
+
+const std::vector<uint32_t>& DrawList::GetObjectIds()
+{
+	return objectIds;
+}
+
+const std::vector<uint64_t>& DrawList::GetUploadValues()
+{
+	return uploadValues;
+}
+
+const std::vector<uint32_t>& DrawList::GetMeshIds()
+{
+	return meshIds;
+}
+
+const std::vector<glm::vec4>& DrawList::GetLocalSpheres()
+{
+	return localSpheres;
+}
+
+const std::vector<uint8_t>& DrawList::GetLodCounts()
+{
+	return lodCounts;
+}
+
+const std::vector<uint32_t>& DrawList::GetLodIndexCounts()
+{
+	return lodIndexCounts;
+}
+
+const std::vector<uint32_t>& DrawList::GetLodFirstIndices()
+{
+	return lodFirstIndices;
+}
+
+const std::vector<float>& DrawList::GetLodErrors()
+{
+	return lodErrors;
+}
+
+const std::vector<uint8_t>& DrawList::GetLods()
+{
+	return lods;
+}
+
+const std::vector<const Meshlet*>& DrawList::GetMeshlets()
+{
+	return meshlets;
+}
+
+const std::vector<uint32_t>& DrawList::GetMeshletCounts()
+{
+	return meshletCounts;
+}
+
+const std::vector<uint32_t>& DrawList::GetMeshletVertexOffsets()
+{
+	return meshletVertexOffsets;
+}
+
+const std::vector<uint32_t>& DrawList::GetMeshletTriangleOffsets()
+{
+	return meshletTriangleOffsets;
+}
+
+void DrawList::CullSpheres(const float* x, const float* y, const float* z, const float* r, size_t count,
+	const glm::vec4* planes, uint8_t* visible)
+{
+	//4 spheres per iteration, a sphere survives if it isn't fully behind any plane
+	__m128 px[6], py[6], pz[6], pw[6];
+	for (int p = 0; p < 6; ++p)
+	{
+		px[p] = _mm_set1_ps(planes[p].x);
+		py[p] = _mm_set1_ps(planes[p].y);
+		pz[p] = _mm_set1_ps(planes[p].z);
+		pw[p] = _mm_set1_ps(planes[p].w);
+	}
+
+	auto zero = _mm_setzero_ps();
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		auto sx = _mm_loadu_ps(x + i);
+		auto sy = _mm_loadu_ps(y + i);
+		auto sz = _mm_loadu_ps(z + i);
+		auto negR = _mm_sub_ps(zero, _mm_loadu_ps(r + i));
+
+		auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; ++p)
+		{
+			auto dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], sx), _mm_mul_ps(py[p], sy)),
+				_mm_add_ps(_mm_mul_ps(pz[p], sz), pw[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negR));
+		}
+
+		auto mask = _mm_movemask_ps(inside);
+		visible[i] = mask & 1;
+		visible[i + 1] = (mask >> 1) & 1;
+		visible[i + 2] = (mask >> 2) & 1;
+		visible[i + 3] = (mask >> 3) & 1;
+	}
+}
+
+DrawList::~DrawList()
+{
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include "MeshModel.h"
+
+//every mesh of every model flattened into parallel arrays, rebuilt only when models come or go
+class DrawList
+{
+public:
+	DrawList();
+
+	void Build(std::vector<MeshModel>& models);
+
+	//orders draws by pipeline, texture, geometry buffer, mesh, then front to back by the owning object's view depth
+	void Sort(const std::vector<float>& objectDepths);
+	//draw indices in sorted order, identity until the first Sort
+	const std::vector<uint32_t>& GetOrder();
+
+	//tests every draw's world space bounding sphere against the frustum of viewProj, BuildBatches skips the culled ones
+	//objectModels is indexed by object id, returns the number of visible draws
+	size_t Cull(const glm::mat4& viewProj, const std::vector<glm::mat4>& objectModels);
+	size_t GetVisibleCount();
+	size_t GetCulledCount();
+
+	//after Cull: hides the visible draws whose world sphere is behind the occlusion buffer, returns how many
+	size_t CullOccluded(const OcclusionBuffer& occlusionBuffer);
+	size_t GetOccludedCount();
+
+	//after Cull: per visible draw the coarsest level whose error stays under LOD_PIXEL_ERROR pixels,
+	//pixelsPerUnit is the projection's screen scale at distance 1, levels are kept between calls for the hysteresis
+	void SelectLods(const glm::vec3& cameraPos, float pixelsPerUnit);
+	//triangles of the visible draws at their selected levels, or all at level 0 for comparison
+	uint64_t GetVisibleTriangles(bool selectedLods);
+
+	//a contiguous part of the index buffer
+	struct IndexRun
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	//full level meshlets of draw d that face the camera and touch the frustum, neighbours merged into runs
+	//returns how many meshlets were dropped, only meaningful for a draw drawn with a single instance
+	size_t CullClusters(uint32_t d, const glm::mat4& model, const glm::vec4* planes, const glm::vec3& cameraPos,
+		std::vector<IndexRun>* runs);
+
+	//left, right, bottom, top, near, far, normalised so plane.xyz . p + plane.w is a distance
+	static void ExtractFrustumPlanes(const glm::mat4& viewProj, glm::vec4* planes);
+
+	//merges sorted draws of the same mesh, level and texture into instanced batches, skipping draws still uploading
+	//instanceObjects gets the object id of every instance, returns the highest upload value drawn
+	uint64_t BuildBatches(uint64_t completedUploadValue, uint32_t* instanceObjects, size_t maxInstances);
+
+	//per batch: a draw to take mesh and texture from, its instances in the instance stream
+	size_t GetBatchCount();
+	size_t GetInstanceCount();
+	const std::vector<uint32_t>& GetBatchDraws();
+	const std::vector<uint32_t>& GetBatchFirstInstances();
+	const std::vector<uint32_t>& GetBatchInstanceCounts();
+
+	void MarkDirty();
+	bool IsDirty();
+
+	size_t GetDrawCount();
+
+	const std::vector<uint32_t>& GetIndexCounts();
+	const std::vector<uint32_t>& GetFirstIndices();
+	const std::vector<int32_t>& GetVertexOffsets();
+	const std::vector<uint32_t>& GetTexIds();
+	const std::vector<uint32_t>& GetObjectIds();
+	const std::vector<uint64_t>& GetUploadValues();
+	const std::vector<uint32_t>& GetMeshIds();
+	const std::vector<glm::vec4>& GetLocalSpheres();
+	//MAX_MESH_LODS entries per draw, level 0 is the draw's full index range
+	const std::vector<uint8_t>& GetLodCounts();
+	const std::vector<uint32_t>& GetLodIndexCounts();
+	const std::vector<uint32_t>& GetLodFirstIndices();
+	const std::vector<float>& GetLodErrors();
+	//selected level per draw, 0 until the first SelectLods
+	const std::vector<uint8_t>& GetLods();
+	//the draw's mesh's meshlets, owned by the mesh
+	const std::vector<const Meshlet*>& GetMeshlets();
+	const std::vector<uint32_t>& GetMeshletCounts();
+	//index pool offsets of the mesh's meshlet vertices and triangles, UINT32_MAX when it has none
+	const std::vector<uint32_t>& GetMeshletVertexOffsets();
+	const std::vector<uint32_t>& GetMeshletTriangleOffsets();
+
+	~DrawList();
+
+private:
+	bool dirty = true;
+
+	std::vector<uint32_t> indexCounts;
+	std::vector<uint32_t> firstIndices;
+	std::vector<int32_t> vertexOffsets;
+	std::vector<uint32_t> texIds;
+	std::vector<uint32_t> objectIds; //model idx, also the object buffer entry
+	std::vector<uint64_t> uploadValues; //of the owning model
+	std::vector<uint32_t> meshIds; //equal for draws of the same pool geometry
+	std::vector<glm::vec4> localSpheres;
+	std::vector<uint8_t> lodCounts;
+	std::vector<uint32_t> lodIndexCounts;
+	std::vector<uint32_t> lodFirstIndices;
+	std::vector<float> lodErrors;
+	std::vector<uint8_t> lods;
+	std::vector<const Meshlet*> meshlets;
+	std::vector<uint32_t> meshletCounts;
+	std::vector<uint32_t> meshletVertexOffsets;
+	std::vector<uint32_t> meshletTriangleOffsets;
+
+	//world space spheres, padded to a multiple of 4 for the sse kernel
+	std::vector<float> sphereX;
+	std::vector<float> sphereY;
+	std::vector<float> sphereZ;
+	std::vector<float> sphereR;
+	std::vector<uint8_t> visible;
+	size_t visibleCount = 0;
+	size_t occludedCount = 0;
+
+	std::vector<uint64_t> sortKeys;
+	std::vector<uint32_t> order;
+	std::vector<uint64_t> keyScratch;
+	std::vector<uint32_t> orderScratch;
+
+	std::vector<uint32_t> batchDraws;
+	std::vector<uint32_t> batchFirstInstances;
+	std::vector<uint32_t> batchInstanceCounts;
+	size_t instanceCount = 0;
+
+	static uint64_t MakeSortKey(uint32_t pipelineId, uint32_t texId, uint32_t geometryId, uint32_t meshId, float depth);
+	void RadixSort();
+	static void CullSpheres(const float* x, const float* y, const float* z, const float* r, size_t count,
+		const glm::vec4* planes, uint8_t* visible);
+};
@@ -0,0 +1,99 @@
+#include "GeometryPool.h"
+
+#include <iostream>
+#include <stdexcept>
+
+GeometryPool::GeometryPool()
+{
+}
+
+void GeometryPool::Init(VkDevice newLogicDevice, MemoryAllocator* newAllocator, uint32_t newVertexCapacity, uint32_t newIndexCapacity)
+{
+	logicDevice = newLogicDevice;
+	allocator = newAllocator;
+
+	//storage use is for the mesh shaders, they fetch vertices and indices themselves
+	CreateBuffer(logicDevice, allocator, sizeof(Vertex) * static_cast<VkDeviceSize>(newVertexCapacity),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&vertexBuffer, &vertexBufferMemory);
+	vertexRanges = RangeAllocator(newVertexCapacity);
+
+	CreateBuffer(logicDevice, allocator, sizeof(uint32_t) * static_cast<VkDeviceSize>(newIndexCapacity),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&idxBuffer, &idxBufferMemory);
+	idxRanges = RangeAllocator(newIndexCapacity);
+}
+
+uint32_t GeometryPool::CopyVertices(UploadBatch* uploadBatch, VkBuffer stagingBuffer, VkDeviceSize stagingOffset, uint32_t count)
+{
+	if (count == 0)
+		return 0;
+
+	uint64_t firstVertex;
+	if (!vertexRanges.Allocate(count, 1, &firstVertex))
+		throw std::runtime_error("geometry pool out of vertex space");
+
+	uploadBatch->CopyBuffer(stagingBuffer, vertexBuffer, sizeof(Vertex) * static_cast<VkDeviceSize>(count),
+		stagingOffset, sizeof(Vertex) * firstVertex);
+
+	return static_cast<uint32_t>(firstVertex);
+}
+
+uint32_t GeometryPool::CopyIndices(UploadBatch* uploadBatch, VkBuffer stagingBuffer, VkDeviceSize stagingOffset, uint32_t count)
+{
+	if (count == 0)
+		return 0;
+
+	uint64_t firstIndex;
+	if (!idxRanges.Allocate(count, 1, &firstIndex))
+		throw std::runtime_error("geometry pool out of index space");
+
+	uploadBatch->CopyBuffer(stagingBuffer, idxBuffer, sizeof(uint32_t) * static_cast<VkDeviceSize>(count),
+		stagingOffset, sizeof(uint32_t) * firstIndex);
+
+	return static_cast<uint32_t>(firstIndex);
+}
+
+void GeometryPool::FreeVertices(uint32_t firstVertex, uint32_t count)
+{
+	if (count > 0)
+		vertexRanges.Free(firstVertex, count);
+}
+
+void GeometryPool::FreeIndices(uint32_t firstIndex, uint32_t count)
+{
+	if (count > 0)
+		idxRanges.Free(firstIndex, count);
+}
+
+VkBuffer GeometryPool::GetVertexBuffer()
+{
+	return vertexBuffer;
+}
+
+VkBuffer GeometryPool::GetIndexBuffer()
+{
+	return idxBuffer;
+}
+
+void GeometryPool::PrintStats()
+{
+	auto vertsUsed = vertexRanges.GetCapacity() - vertexRanges.GetFreeBytes();
+	auto indicesUsed = idxRanges.GetCapacity() - idxRanges.GetFreeBytes();
+
+	std::cout << "geometry pool: " << vertsUsed << "/" << vertexRanges.GetCapacity() << " verts ("
+		<< vertexRanges.GetFreeRangeCount() << " free ranges), " << indicesUsed << "/" << idxRanges.GetCapacity()
+		<< " indices (" << idxRanges.GetFreeRangeCount() << " free ranges)" << std::endl;
+}
+
+void GeometryPool::Destroy()
+{
+	DestroyBuffer(logicDevice, allocator, vertexBuffer, vertexBufferMemory);
+	DestroyBuffer(logicDevice, allocator, idxBuffer, idxBufferMemory);
+}
+
+GeometryPool::~GeometryPool()
+{
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "Utils.h"
+#include "RangeAllocator.h"
+#include "UploadBatch.h"
+
+//one vertex and one index buffer shared by every mesh, ranges are handed out in elements
+class GeometryPool
+{
+public:
+	GeometryPool();
+
+	void Init(VkDevice newLogicDevice, MemoryAllocator* newAllocator, uint32_t newVertexCapacity, uint32_t newIndexCapacity);
+
+	//copies count elements starting stagingOffset bytes into a staging buffer, returns the first vertex/index in the pool
+	uint32_t CopyVertices(UploadBatch* uploadBatch, VkBuffer stagingBuffer, VkDeviceSize stagingOffset, uint32_t count);
+	uint32_t CopyIndices(UploadBatch* uploadBatch, VkBuffer stagingBuffer, VkDeviceSize stagingOffset, uint32_t count);
+
+	void FreeVertices(uint32_t firstVertex, uint32_t count);
+	void FreeIndices(uint32_t firstIndex, uint32_t count);
+
+	VkBuffer GetVertexBuffer();
+	VkBuffer GetIndexBuffer();
+
+	void PrintStats();
+
+	void Destroy();
+
+	~GeometryPool();
+
+private:
+	VkDevice logicDevice;
+	MemoryAllocator* allocator;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation vertexBufferMemory;
+	RangeAllocator vertexRanges;
+
+	VkBuffer idxBuffer = VK_NULL_HANDLE;
+	MemoryAllocation idxBufferMemory;
+	RangeAllocator idxRanges;
+};
@@ -0,0 +1,621 @@
+#include "GpuDrawList.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <stdexcept>
+
+GpuDrawList::GpuDrawList()
+{
+}
+
+void GpuDrawList::Init(VkPhysicalDevice physDevice, VkDevice newLogicDevice, MemoryAllocator* newAllocator,
+	VkDescriptorSetLayout frameSetLayout, UniformRing* newUniformRing, HiZPyramid* newHiZ, uint32_t newMaxDraws,
+	GeometryPool* geometryPool, bool newMeshShading)
+{
+	logicDevice = newLogicDevice;
+	allocator = newAllocator;
+	uniformRing = newUniformRing;
+	hiZ = newHiZ;
+	maxDraws = newMaxDraws;
+	meshShading = newMeshShading;
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physDevice, &props);
+	auto alignment = props.limits.minStorageBufferOffsetAlignment;
+
+	commandStride = (sizeof(VkDrawIndexedIndirectCommand) * maxDraws + alignment - 1) / alignment * alignment;
+	//without mesh shading nothing writes task commands, a one command slice keeps the descriptors valid
+	taskStride = (sizeof(TaskCommand) * (meshShading ? maxDraws : 1) + alignment - 1) / alignment * alignment;
+	countStride = (sizeof(uint32_t) * MAX_TEXTURES * 2 + alignment - 1) / alignment * alignment;
+	occludedStride = (sizeof(uint32_t) * maxDraws + alignment - 1) / alignment * alignment;
+	auto sliceCount = MAX_QUEUED_DRAWS * CULL_PHASE_COUNT;
+
+	CreateBuffer(logicDevice, allocator, sizeof(GpuDraw) * maxDraws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&drawBuffer, &drawBufferMemory);
+
+	CreateBuffer(logicDevice, allocator, commandStride * sliceCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&commandBuffer, &commandBufferMemory);
+
+	CreateBuffer(logicDevice, allocator, taskStride * sliceCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&taskBuffer, &taskBufferMemory);
+
+	CreateBuffer(logicDevice, allocator, countStride * sliceCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&countBuffer, &countBufferMemory);
+
+	CreateBuffer(logicDevice, allocator, occludedStride * MAX_QUEUED_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&occludedBuffer, &occludedBufferMemory);
+
+	CreateBuffer(logicDevice, allocator, sizeof(Meshlet) * MAX_GPU_MESHLETS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&meshletBuffer, &meshletBufferMemory);
+
+	CreateBuffer(logicDevice, allocator, sizeof(uint32_t) * maxDraws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&lodBuffer, &lodBufferMemory);
+
+	memset(countBufferMemory.mapped, 0, countStride * sliceCount);
+
+	CreateDescriptors();
+	CreatePipeline(frameSetLayout);
+
+	if (meshShading)
+	{
+		CreateMeshDescriptors(geometryPool);
+		cmdDrawMeshTasksIndirectCount = reinterpret_cast<PFN_vkCmdDrawMeshTasksIndirectCountEXT>(
+			vkGetDeviceProcAddr(logicDevice, "vkCmdDrawMeshTasksIndirectCountEXT"));
+		if (!cmdDrawMeshTasksIndirectCount)
+			throw std::runtime_error("failed to load vkCmdDrawMeshTasksIndirectCountEXT");
+	}
+}
+
+bool GpuDrawList::NeedsUpdate(uint64_t completedUploadValue)
+{
+	return minPendingUploadValue > 0 && completedUploadValue >= minPendingUploadValue;
+}
+
+uint64_t GpuDrawList::Update(DrawList* drawList, uint64_t completedUploadValue)
+{
+	auto vertexOffsets = drawList->GetVertexOffsets().data();
+	auto texIds = drawList->GetTexIds().data();
+	auto objectIds = drawList->GetObjectIds().data();
+	auto uploadValues = drawList->GetUploadValues().data();
+	auto localSpheres = drawList->GetLocalSpheres().data();
+	auto lodCounts = drawList->GetLodCounts().data();
+	auto lodIndexCounts = drawList->GetLodIndexCounts().data();
+	auto lodFirstIndices = drawList->GetLodFirstIndices().data();
+	auto lodErrors = drawList->GetLodErrors().data();
+	auto meshIds = drawList->GetMeshIds().data();
+	auto drawMeshlets = drawList->GetMeshlets().data();
+	auto meshletCounts = drawList->GetMeshletCounts().data();
+	auto meshletVertexOffsets = drawList->GetMeshletVertexOffsets().data();
+	auto meshletTriangleOffsets = drawList->GetMeshletTriangleOffsets().data();
+
+	//meshlets of every ready mesh once, draws of the same mesh share them
+	std::unordered_map<uint32_t, uint32_t> meshToMeshlet;
+	auto gpuMeshlets = static_cast<Meshlet*>(meshletBufferMemory.mapped);
+	uint32_t meshletTotal = 0;
+	bool clusters = CLUSTER_CULLING;
+
+	for (size_t d = 0; d < drawList->GetDrawCount() && clusters; ++d)
+	{
+		if (uploadValues[d] > completedUploadValue || meshletCounts[d] == 0)
+			continue;
+
+		auto found = meshToMeshlet.emplace(meshIds[d], meshletTotal);
+		if (!found.second)
+			continue;
+
+		if (meshletTotal + meshletCounts[d] > MAX_GPU_MESHLETS)
+		{
+			clusters = false;
+			break;
+		}
+
+		for (uint32_t k = 0; k < meshletCounts[d]; ++k)
+		{
+			auto m = drawMeshlets[d][k];
+			m.firstIndex += lodFirstIndices[d * MAX_MESH_LODS];
+			if (meshletVertexOffsets[d] != UINT32_MAX)
+				m.vertexOffset += meshletVertexOffsets[d];
+			gpuMeshlets[meshletTotal + k] = m;
+		}
+		meshletTotal += meshletCounts[d];
+	}
+
+	//a bucket per texture, sized by how many commands its ready draws can emit
+	//every other meshlet culled is the worst case for a draw split into runs, a mesh shaded draw emits one either way
+	std::map<uint32_t, uint32_t> texToBucket;
+	minPendingUploadValue = 0;
+	uint64_t maxUploadValue = 0;
+	uint32_t commandBase = 0;
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		texToBucket.clear();
+		buckets.clear();
+
+		for (size_t d = 0; d < drawList->GetDrawCount(); ++d)
+		{
+			//still streaming in, written once its upload is done
+			if (uploadValues[d] > completedUploadValue)
+			{
+				if (minPendingUploadValue == 0 || uploadValues[d] < minPendingUploadValue)
+					minPendingUploadValue = uploadValues[d];
+				continue;
+			}
+
+			auto found = texToBucket.emplace(texIds[d], static_cast<uint32_t>(buckets.size()));
+			if (found.second)
+				buckets.push_back({ texIds[d], 0, 0, 0, 0 });
+
+			auto& bucket = buckets[found.first->second];
+			bool runs = clusters && meshletCounts[d] > 0 && !(meshShading && meshletTriangleOffsets[d] != UINT32_MAX);
+			bucket.capacity += runs ? (meshletCounts[d] + 1) / 2 : 1;
+			++bucket.drawCount;
+			maxUploadValue = std::max(maxUploadValue, uploadValues[d]);
+		}
+
+		commandBase = 0;
+		uint32_t drawBase = 0;
+		for (auto& b : buckets)
+		{
+			b.commandBase = commandBase;
+			b.drawBase = drawBase;
+			commandBase += b.capacity;
+			drawBase += b.drawCount;
+		}
+
+		//too many runs to hold, whole meshes still fit
+		if (commandBase <= maxDraws || !clusters)
+			break;
+
+		clusters = false;
+	}
+
+	if (commandBase > maxDraws)
+		throw std::runtime_error("more draws than the gpu draw list holds");
+
+	//second pass scatters the draws into their bucket's range, commandBase is then only kept for the shader
+	std::vector<uint32_t> bucketFill(buckets.size(), 0);
+	auto gpuDraws = static_cast<GpuDraw*>(drawBufferMemory.mapped);
+	drawCount = 0;
+
+	for (size_t d = 0; d < drawList->GetDrawCount(); ++d)
+	{
+		if (uploadValues[d] > completedUploadValue)
+			continue;
+
+		auto bucket = texToBucket[texIds[d]];
+
+		GpuDraw draw = {};
+		draw.vertexOffset = vertexOffsets[d];
+		draw.objectId = objectIds[d];
+		draw.commandBase = buckets[bucket].commandBase;
+		draw.bucket = bucket;
+		draw.bucketCapacity = buckets[bucket].capacity;
+		draw.meshletTriangleBase = UINT32_MAX;
+		draw.sphere = localSpheres[d];
+		draw.lodCount = lodCounts[d];
+		for (uint32_t l = 0; l < MAX_MESH_LODS; ++l)
+		{
+			draw.lodIndexCounts[l] = lodIndexCounts[d * MAX_MESH_LODS + l];
+			draw.lodFirstIndices[l] = lodFirstIndices[d * MAX_MESH_LODS + l];
+			draw.lodErrors[l] = lodErrors[d * MAX_MESH_LODS + l];
+		}
+
+		if (clusters && meshletCounts[d] > 0)
+		{
+			draw.firstMeshlet = meshToMeshlet[meshIds[d]];
+			draw.meshletCount = meshletCounts[d];
+			if (meshShading)
+				draw.meshletTriangleBase = meshletTriangleOffsets[d];
+		}
+
+		gpuDraws[buckets[bucket].drawBase + bucketFill[bucket]++] = draw;
+		++drawCount;
+	}
+
+	lodsReset = true;
+	return maxUploadValue;
+}
+
+void GpuDrawList::RecordCull(VkCommandBuffer cmdBuffer, uint32_t frameIdx, CullPhase phase, VkDescriptorSet frameSet,
+	const uint32_t* frameDynamicOffsets, uint32_t frameDynamicOffsetCount, const glm::mat4& viewProj,
+	const glm::mat4* occlusionViewProj, const glm::vec3& cameraPos, float pixelsPerUnit)
+{
+	if (drawCount == 0)
+		return;
+
+	auto slice = frameIdx * CULL_PHASE_COUNT + phase;
+	vkCmdFillBuffer(cmdBuffer, countBuffer, countStride * slice, countStride, 0);
+
+	//levels of the old draw order mean nothing for the new one, start from the full meshes
+	if (lodsReset && phase == CULL_PHASE_EARLY)
+	{
+		vkCmdFillBuffer(cmdBuffer, lodBuffer, 0, VK_WHOLE_SIZE, 0);
+		lodsReset = false;
+	}
+
+	//the late phase also reads the flags the early one wrote
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	CullParams params = {};
+	DrawList::ExtractFrustumPlanes(viewProj, params.planes);
+	params.drawCount = drawCount;
+	params.phase = phase;
+	params.occlusionEnabled = occlusionViewProj != nullptr;
+	if (occlusionViewProj)
+		params.occlusionViewProj = *occlusionViewProj;
+	params.pyramidSize = glm::vec2(static_cast<float>(hiZ->GetExtent().width), static_cast<float>(hiZ->GetExtent().height));
+	params.pyramidLevels = hiZ->GetLevelCount();
+	params.camera = glm::vec4(cameraPos, pixelsPerUnit);
+	params.lodPixelError = LOD_PIXEL_ERROR;
+	params.lodHysteresis = LOD_HYSTERESIS;
+	params.meshShading = meshShading;
+	params.taskCountBase = MAX_TEXTURES;
+
+	//set 1's only dynamic offset comes after set 0's
+	std::array<uint32_t, 8> dynamicOffsets = {};
+	std::copy(frameDynamicOffsets, frameDynamicOffsets + frameDynamicOffsetCount, dynamicOffsets.begin());
+	dynamicOffsets[frameDynamicOffsetCount] = uniformRing->Push(params);
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+
+	std::array<VkDescriptorSet, 2> sets = { frameSet, cullDescriptorSets[slice] };
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout,
+		0, static_cast<uint32_t>(sets.size()), sets.data(), frameDynamicOffsetCount + 1, dynamicOffsets.data());
+
+	vkCmdDispatch(cmdBuffer, (drawCount + 63) / 64, 1, 1);
+
+	//commands and counts feed the indirect draws, the instance stream the vertex shader, task commands the task shader
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+	if (meshShading)
+		dstStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0,
+		1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuDrawList::RecordDraws(VkCommandBuffer cmdBuffer, uint32_t frameIdx, CullPhase phase, VkPipelineLayout pipelineLayout,
+	const std::vector<VkDescriptorSet>& samplerSets)
+{
+	if (drawCount == 0)
+		return;
+
+	auto slice = frameIdx * CULL_PHASE_COUNT + phase;
+
+	for (size_t b = 0; b < buckets.size(); ++b)
+	{
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+			1, 1, &samplerSets[buckets[b].texId], 0, nullptr);
+
+		vkCmdDrawIndexedIndirectCount(cmdBuffer,
+			commandBuffer, commandStride * slice + sizeof(VkDrawIndexedIndirectCommand) * buckets[b].commandBase,
+			countBuffer, countStride * slice + sizeof(uint32_t) * b,
+			buckets[b].capacity, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+void GpuDrawList::RecordMeshDraws(VkCommandBuffer cmdBuffer, uint32_t frameIdx, CullPhase phase, VkPipelineLayout meshPipelineLayout,
+	const std::vector<VkDescriptorSet>& samplerSets)
+{
+	if (drawCount == 0 || !meshShading)
+		return;
+
+	auto slice = frameIdx * CULL_PHASE_COUNT + phase;
+
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout,
+		2, 1, &meshDescriptorSets[slice], 0, nullptr);
+
+	//the task shader finds its command at commandBase + gl_DrawID
+	for (size_t b = 0; b < buckets.size(); ++b)
+	{
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout,
+			1, 1, &samplerSets[buckets[b].texId], 0, nullptr);
+		vkCmdPushConstants(cmdBuffer, meshPipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT, 0, sizeof(uint32_t), &buckets[b].commandBase);
+
+		cmdDrawMeshTasksIndirectCount(cmdBuffer,
+			taskBuffer, taskStride * slice + sizeof(TaskCommand) * buckets[b].commandBase,
+			countBuffer, countStride * slice + sizeof(uint32_t) * (MAX_TEXTURES + b),
+			buckets[b].drawCount, sizeof(TaskCommand));
+	}
+}
+
+VkDescriptorSetLayout GpuDrawList::GetMeshSetLayout()
+{
+	return meshSetLayout;
+}
+
+size_t GpuDrawList::GetVisibleCount(uint32_t frameIdx)
+{
+	size_t visible = 0;
+	for (uint32_t phase = 0; phase < CULL_PHASE_COUNT; ++phase)
+	{
+		auto counts = reinterpret_cast<const uint32_t*>(static_cast<const char*>(countBufferMemory.mapped)
+			+ countStride * (frameIdx * CULL_PHASE_COUNT + phase));
+
+		for (size_t b = 0; b < buckets.size(); ++b)
+			visible += counts[b] + counts[MAX_TEXTURES + b];
+	}
+
+	return visible;
+}
+
+size_t GpuDrawList::GetLateCount(uint32_t frameIdx)
+{
+	auto counts = reinterpret_cast<const uint32_t*>(static_cast<const char*>(countBufferMemory.mapped)
+		+ countStride * (frameIdx * CULL_PHASE_COUNT + CULL_PHASE_LATE));
+
+	size_t late = 0;
+	for (size_t b = 0; b < buckets.size(); ++b)
+		late += counts[b] + counts[MAX_TEXTURES + b];
+
+	return late;
+}
+
+size_t GpuDrawList::GetDrawCount()
+{
+	return drawCount;
+}
+
+size_t GpuDrawList::GetBucketCount()
+{
+	return buckets.size();
+}
+
+void GpuDrawList::Destroy()
+{
+	if (drawBuffer == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyPipeline(logicDevice, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(logicDevice, cullLayout, nullptr);
+	vkDestroyDescriptorPool(logicDevice, cullDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(logicDevice, cullSetLayout, nullptr);
+	if (meshShading)
+	{
+		vkDestroyDescriptorPool(logicDevice, meshDescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(logicDevice, meshSetLayout, nullptr);
+	}
+
+	DestroyBuffer(logicDevice, allocator, meshletBuffer, meshletBufferMemory);
+	DestroyBuffer(logicDevice, allocator, lodBuffer, lodBufferMemory);
+	DestroyBuffer(logicDevice, allocator, occludedBuffer, occludedBufferMemory);
+	DestroyBuffer(logicDevice, allocator, countBuffer, countBufferMemory);
+	DestroyBuffer(logicDevice, allocator, taskBuffer, taskBufferMemory);
+	DestroyBuffer(logicDevice, allocator, commandBuffer, commandBufferMemory);
+	DestroyBuffer(logicDevice, allocator, drawBuffer, drawBufferMemory);
+	drawBuffer = VK_NULL_HANDLE;
+}
+
+GpuDrawList::~GpuDrawList()
+{
+}
+
+void GpuDrawList::CreateDescriptors()
+{
+	std::array<VkDescriptorSetLayoutBinding, 9> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (VK_SUCCESS != vkCreateDescriptorSetLayout(logicDevice, &layoutInfo, nullptr, &cullSetLayout))
+		throw std::runtime_error("failed to create cull dsl");
+
+	auto setCount = MAX_QUEUED_DRAWS * CULL_PHASE_COUNT;
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = 7 * setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = setCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = setCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (VK_SUCCESS != vkCreateDescriptorPool(logicDevice, &poolInfo, nullptr, &cullDescriptorPool))
+		throw std::runtime_error("failed to create cull descriptor pool");
+
+	//one set per phase of each frame in flight, each pointing at its own command and count slice
+	cullDescriptorSets.resize(setCount);
+	std::vector<VkDescriptorSetLayout> layouts(setCount, cullSetLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = cullDescriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (VK_SUCCESS != vkAllocateDescriptorSets(logicDevice, &allocInfo, cullDescriptorSets.data()))
+		throw std::runtime_error("failed to alloc cull descriptors");
+
+	for (uint32_t i = 0; i < setCount; ++i)
+	{
+		auto frame = i / CULL_PHASE_COUNT;
+
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+		bufferInfos[0] = { drawBuffer, 0, sizeof(GpuDraw) * maxDraws };
+		bufferInfos[1] = { commandBuffer, commandStride * i, commandStride };
+		bufferInfos[2] = { countBuffer, countStride * i, countStride };
+		bufferInfos[3] = { occludedBuffer, occludedStride * frame, occludedStride };
+		bufferInfos[4] = { uniformRing->GetBuffer(), 0, sizeof(CullParams) };
+
+		VkDescriptorImageInfo hiZInfo = {};
+		hiZInfo.sampler = hiZ->GetSampler();
+		hiZInfo.imageView = hiZ->GetView();
+		hiZInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorBufferInfo lodInfo = { lodBuffer, 0, sizeof(uint32_t) * maxDraws };
+		VkDescriptorBufferInfo meshletInfo = { meshletBuffer, 0, sizeof(Meshlet) * MAX_GPU_MESHLETS };
+		VkDescriptorBufferInfo taskInfo = { taskBuffer, taskStride * i, taskStride };
+
+		std::array<VkWriteDescriptorSet, 9> writes = {};
+		for (uint32_t b = 0; b < writes.size(); ++b)
+		{
+			writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[b].dstSet = cullDescriptorSets[i];
+			writes[b].dstBinding = b;
+			writes[b].descriptorType = bindings[b].descriptorType;
+			writes[b].descriptorCount = 1;
+			if (b < bufferInfos.size())
+				writes[b].pBufferInfo = &bufferInfos[b];
+			else if (b == 5)
+				writes[b].pImageInfo = &hiZInfo;
+			else if (b == 6)
+				writes[b].pBufferInfo = &lodInfo;
+			else if (b == 7)
+				writes[b].pBufferInfo = &meshletInfo;
+			else
+				writes[b].pBufferInfo = &taskInfo;
+		}
+
+		vkUpdateDescriptorSets(logicDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void GpuDrawList::CreateMeshDescriptors(GeometryPool* geometryPool)
+{
+	//draws, meshlets, task commands, then the pool's vertices and indices (meshlet vertices and triangles live there too)
+	std::array<VkDescriptorSetLayoutBinding, 5> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (VK_SUCCESS != vkCreateDescriptorSetLayout(logicDevice, &layoutInfo, nullptr, &meshSetLayout))
+		throw std::runtime_error("failed to create mesh dsl");
+
+	auto setCount = MAX_QUEUED_DRAWS * CULL_PHASE_COUNT;
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = static_cast<uint32_t>(bindings.size()) * setCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (VK_SUCCESS != vkCreateDescriptorPool(logicDevice, &poolInfo, nullptr, &meshDescriptorPool))
+		throw std::runtime_error("failed to create mesh descriptor pool");
+
+	meshDescriptorSets.resize(setCount);
+	std::vector<VkDescriptorSetLayout> layouts(setCount, meshSetLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = meshDescriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (VK_SUCCESS != vkAllocateDescriptorSets(logicDevice, &allocInfo, meshDescriptorSets.data()))
+		throw std::runtime_error("failed to alloc mesh descriptors");
+
+	for (uint32_t i = 0; i < setCount; ++i)
+	{
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+		bufferInfos[0] = { drawBuffer, 0, sizeof(GpuDraw) * maxDraws };
+		bufferInfos[1] = { meshletBuffer, 0, sizeof(Meshlet) * MAX_GPU_MESHLETS };
+		bufferInfos[2] = { taskBuffer, taskStride * i, taskStride };
+		bufferInfos[3] = { geometryPool->GetVertexBuffer(), 0, VK_WHOLE_SIZE };
+		bufferInfos[4] = { geometryPool->GetIndexBuffer(), 0, VK_WHOLE_SIZE };
+
+		std::array<VkWriteDescriptorSet, 5> writes = {};
+		for (uint32_t b = 0; b < writes.size(); ++b)
+		{
+			writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[b].dstSet = meshDescriptorSets[i];
+			writes[b].dstBinding = b;
+			writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[b].descriptorCount = 1;
+			writes[b].pBufferInfo = &bufferInfos[b];
+		}
+
+		vkUpdateDescriptorSets(logicDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void GpuDrawList::CreatePipeline(VkDescriptorSetLayout frameSetLayout)
+{
+	auto shaderCode = ReadFile("Shaders/cull_comp.spv");
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = shaderCode.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule;
+	if (VK_SUCCESS != vkCreateShaderModule(logicDevice, &moduleInfo, nullptr, &shaderModule))
+		throw std::runtime_error("failed to create cull shader module");
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { frameSetLayout, cullSetLayout };
+
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	layoutInfo.pSetLayouts = setLayouts.data();
+
+	if (VK_SUCCESS != vkCreatePipelineLayout(logicDevice, &layoutInfo, nullptr, &cullLayout))
+		throw std::runtime_error("failed to create cull pipeline layout");
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = cullLayout;
+
+	auto result = vkCreateComputePipelines(logicDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline);
+	vkDestroyShaderModule(logicDevice, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to create cull pipeline");
+}
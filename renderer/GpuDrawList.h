@@ -0,0 +1,174 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include "Utils.h"
+#include "DrawList.h"
+#include "UniformRing.h"
+#include "HiZPyramid.h"
+#include "GeometryPool.h"
+
+//early draws what passes last frame's hi-z, late re-tests the rest against the pyramid of the early depth
+enum CullPhase
+{
+	CULL_PHASE_EARLY,
+	CULL_PHASE_LATE,
+	CULL_PHASE_COUNT
+};
+
+//the draw list mirrored on the gpu, a compute pass culls it (and the meshlets of full level draws) into indirect commands and
+//subpass 0 draws them with one indirect count draw per texture, cpu cost no longer grows with the scene
+//with mesh shading full level meshlet draws become task commands instead, the task shader culls their meshlets
+class GpuDrawList
+{
+public:
+	GpuDrawList();
+
+	//cull parameters are pushed to uniformRing, the late phase tests against hiZ
+	//newMeshShading needs a device with VK_EXT_mesh_shader enabled, the mesh shaders read geometryPool's buffers
+	void Init(VkPhysicalDevice physDevice, VkDevice newLogicDevice, MemoryAllocator* newAllocator,
+		VkDescriptorSetLayout frameSetLayout, UniformRing* newUniformRing, HiZPyramid* newHiZ, uint32_t newMaxDraws,
+		GeometryPool* geometryPool, bool newMeshShading);
+
+	//true once a draw skipped by the last Update has finished uploading
+	bool NeedsUpdate(uint64_t completedUploadValue);
+
+	//rewrites the gpu side inputs, no frame in flight may still read them
+	//returns the highest upload value of the draws written
+	uint64_t Update(DrawList* drawList, uint64_t completedUploadValue);
+
+	//outside the render pass: resets the phase's counts and dispatches the cull
+	//frameDynamicOffsets are set 0's, the shader writes the instance stream there too
+	//occlusionViewProj is what the pyramid was rendered with, null skips the occlusion test
+	//the early phase also picks every frustum visible draw's level like DrawList::SelectLods, the late one reuses it
+	void RecordCull(VkCommandBuffer cmdBuffer, uint32_t frameIdx, CullPhase phase, VkDescriptorSet frameSet,
+		const uint32_t* frameDynamicOffsets, uint32_t frameDynamicOffsetCount, const glm::mat4& viewProj,
+		const glm::mat4* occlusionViewProj, const glm::vec3& cameraPos, float pixelsPerUnit);
+
+	//inside subpass 0 with the scene pipeline, geometry and set 0 already bound
+	void RecordDraws(VkCommandBuffer cmdBuffer, uint32_t frameIdx, CullPhase phase, VkPipelineLayout pipelineLayout,
+		const std::vector<VkDescriptorSet>& samplerSets);
+	//mesh shading only, after RecordDraws with the mesh pipeline and set 0 bound, meshPipelineLayout's set 2 is GetMeshSetLayout
+	void RecordMeshDraws(VkCommandBuffer cmdBuffer, uint32_t frameIdx, CullPhase phase, VkPipelineLayout meshPipelineLayout,
+		const std::vector<VkDescriptorSet>& samplerSets);
+	VkDescriptorSetLayout GetMeshSetLayout();
+
+	//commands emitted by the gpu the last time frameIdx's slices were used, read once its fence is waited on
+	//a draw split into meshlet runs counts once per run, a task command once
+	size_t GetVisibleCount(uint32_t frameIdx);
+	//the part of them only found by the late phase
+	size_t GetLateCount(uint32_t frameIdx);
+	size_t GetDrawCount();
+	size_t GetBucketCount();
+
+	void Destroy();
+
+	~GpuDrawList();
+
+private:
+	//matches GpuDraw in cull.comp, std430
+	struct GpuDraw
+	{
+		int32_t vertexOffset;
+		uint32_t objectId;
+		uint32_t commandBase; //first command slot of the draw's bucket
+		uint32_t bucket;
+		uint32_t bucketCapacity;
+		uint32_t lodCount;
+		uint32_t firstMeshlet; //into the meshlet buffer
+		uint32_t meshletCount; //0 = drawn whole
+		glm::vec4 sphere; //local space
+		uint32_t lodIndexCounts[MAX_MESH_LODS];
+		uint32_t lodFirstIndices[MAX_MESH_LODS];
+		float lodErrors[MAX_MESH_LODS];
+		uint32_t meshletTriangleBase; //index pool offset of the mesh's packed triangles, UINT32_MAX = no mesh shading
+		uint32_t padding[3];
+	};
+
+	//VkDrawMeshTasksIndirectCommandEXT followed by what the task shader needs to find its draw, matches cull.comp
+	struct TaskCommand
+	{
+		uint32_t groupCountX;
+		uint32_t groupCountY;
+		uint32_t groupCountZ;
+		uint32_t drawIdx;
+		uint32_t padding;
+	};
+
+	//matches CullParams in cull.comp, std140
+	struct CullParams
+	{
+		glm::vec4 planes[6];
+		glm::mat4 occlusionViewProj;
+		glm::vec2 pyramidSize;
+		uint32_t drawCount;
+		uint32_t phase;
+		uint32_t occlusionEnabled;
+		uint32_t pyramidLevels;
+		uint32_t padding[2];
+		glm::vec4 camera; //xyz position, w pixels per unit at distance 1 for the level choice
+		float lodPixelError;
+		float lodHysteresis;
+		uint32_t meshShading;
+		uint32_t taskCountBase; //task command counts follow the indexed ones in each count slice
+	};
+
+	struct Bucket
+	{
+		uint32_t texId;
+		uint32_t commandBase;
+		uint32_t capacity; //commands, a draw split into meshlet runs can emit several
+		uint32_t drawBase;
+		uint32_t drawCount;
+	};
+
+	VkDevice logicDevice;
+	MemoryAllocator* allocator;
+	UniformRing* uniformRing;
+	HiZPyramid* hiZ;
+
+	uint32_t maxDraws = 0;
+	uint32_t drawCount = 0;
+	bool meshShading = false;
+	std::vector<Bucket> buckets;
+	uint64_t minPendingUploadValue = 0; //0 = nothing was skipped
+
+	//draw inputs are written rarely and read every frame, commands and counts have a slice per phase and frame in flight
+	VkBuffer drawBuffer = VK_NULL_HANDLE;
+	MemoryAllocation drawBufferMemory;
+	VkBuffer commandBuffer = VK_NULL_HANDLE;
+	MemoryAllocation commandBufferMemory;
+	VkBuffer taskBuffer = VK_NULL_HANDLE; //TaskCommands, sliced like commandBuffer
+	MemoryAllocation taskBufferMemory;
+	VkBuffer countBuffer = VK_NULL_HANDLE; //host visible so the counts can be read back for stats
+	MemoryAllocation countBufferMemory;
+	VkBuffer occludedBuffer = VK_NULL_HANDLE; //per draw flag, set by the early phase for the late one to re-test
+	MemoryAllocation occludedBufferMemory;
+	VkBuffer meshletBuffer = VK_NULL_HANDLE; //Meshlets of every mesh drawn, first indices made absolute
+	MemoryAllocation meshletBufferMemory;
+	VkBuffer lodBuffer = VK_NULL_HANDLE; //per draw level picked last frame, shared by all frames for the hysteresis
+	MemoryAllocation lodBufferMemory;
+	bool lodsReset = true; //draws moved, the levels are cleared by the next early cull
+	VkDeviceSize commandStride = 0;
+	VkDeviceSize taskStride = 0;
+	VkDeviceSize countStride = 0;
+	VkDeviceSize occludedStride = 0;
+
+	VkDescriptorSetLayout cullSetLayout;
+	VkDescriptorPool cullDescriptorPool;
+	std::vector<VkDescriptorSet> cullDescriptorSets; //[frameIdx * CULL_PHASE_COUNT + phase]
+	VkPipelineLayout cullLayout;
+	VkPipeline cullPipeline;
+
+	//set 2 of the mesh pipeline, one per phase of each frame in flight like the cull sets
+	VkDescriptorSetLayout meshSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool meshDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> meshDescriptorSets;
+	PFN_vkCmdDrawMeshTasksIndirectCountEXT cmdDrawMeshTasksIndirectCount = nullptr;
+
+	void CreateDescriptors();
+	void CreateMeshDescriptors(GeometryPool* geometryPool);
+	void CreatePipeline(VkDescriptorSetLayout frameSetLayout);
+};
@@ -0,0 +1,328 @@
+#include "HiZPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+HiZPyramid::HiZPyramid()
+{
+}
+
+void HiZPyramid::Init(VkDevice newLogicDevice, MemoryAllocator* newAllocator, VkExtent2D newDepthExtent,
+	const std::vector<VkImageView>& depthViews)
+{
+	logicDevice = newLogicDevice;
+	allocator = newAllocator;
+	depthExtent = newDepthExtent;
+
+	extent = GetLevelExtent(depthExtent, 1);
+
+	levelCount = 1;
+	while (std::max(extent.width, extent.height) >> levelCount > 0)
+		++levelCount;
+
+	CreateImage();
+	CreateDescriptors(depthViews);
+	CreatePipeline();
+}
+
+void HiZPyramid::RecordBuild(VkCommandBuffer cmdBuffer, uint32_t depthIdx)
+{
+	VkImageMemoryBarrier imgBarrier = {};
+	imgBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imgBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	imgBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	imgBarrier.oldLayout = initialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	imgBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	imgBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imgBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imgBarrier.image = image;
+	imgBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imgBarrier.subresourceRange.baseMipLevel = 0;
+	imgBarrier.subresourceRange.levelCount = levelCount;
+	imgBarrier.subresourceRange.baseArrayLayer = 0;
+	imgBarrier.subresourceRange.layerCount = 1;
+
+	//earlier culls may still be reading last frame's pyramid
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &imgBarrier);
+	initialized = true;
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, buildPipeline);
+
+	VkMemoryBarrier levelBarrier = {};
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	auto srcExtent = depthExtent;
+
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		auto dstExtent = GetLevelExtent(extent, level);
+
+		auto set = level == 0 ? depthSets[depthIdx] : levelSets[level - 1];
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, buildLayout, 0, 1, &set, 0, nullptr);
+
+		BuildParams params = { srcExtent.width, srcExtent.height, dstExtent.width, dstExtent.height };
+		vkCmdPushConstants(cmdBuffer, buildLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BuildParams), &params);
+
+		vkCmdDispatch(cmdBuffer, (dstExtent.width + 7) / 8, (dstExtent.height + 7) / 8, 1);
+
+		//each level reads the one before, the last one is read by the cull
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+		srcExtent = dstExtent;
+	}
+}
+
+VkImageView HiZPyramid::GetView()
+{
+	return view;
+}
+
+VkSampler HiZPyramid::GetSampler()
+{
+	return sampler;
+}
+
+VkExtent2D HiZPyramid::GetExtent()
+{
+	return extent;
+}
+
+uint32_t HiZPyramid::GetLevelCount()
+{
+	return levelCount;
+}
+
+void HiZPyramid::Destroy()
+{
+	if (image == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyPipeline(logicDevice, buildPipeline, nullptr);
+	vkDestroyPipelineLayout(logicDevice, buildLayout, nullptr);
+	vkDestroyDescriptorPool(logicDevice, buildDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(logicDevice, buildSetLayout, nullptr);
+
+	vkDestroySampler(logicDevice, sampler, nullptr);
+	for (auto levelView : levelViews)
+		vkDestroyImageView(logicDevice, levelView, nullptr);
+	vkDestroyImageView(logicDevice, view, nullptr);
+
+	vkDestroyImage(logicDevice, image, nullptr);
+	allocator->Free(imageMemory);
+	image = VK_NULL_HANDLE;
+}
+
+HiZPyramid::~HiZPyramid()
+{
+}
+
+void HiZPyramid::CreateImage()
+{
+	VkImageCreateInfo imgInfo = {};
+	imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imgInfo.imageType = VK_IMAGE_TYPE_2D;
+	imgInfo.extent.width = extent.width;
+	imgInfo.extent.height = extent.height;
+	imgInfo.extent.depth = 1;
+	imgInfo.mipLevels = levelCount;
+	imgInfo.arrayLayers = 1;
+	imgInfo.format = VK_FORMAT_R32_SFLOAT;
+	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imgInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (VK_SUCCESS != vkCreateImage(logicDevice, &imgInfo, nullptr, &image))
+		throw std::runtime_error("failed to create hi-z image");
+
+	VkMemoryRequirements memReq;
+	vkGetImageMemoryRequirements(logicDevice, image, &memReq);
+	imageMemory = allocator->Allocate(memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+	vkBindImageMemory(logicDevice, image, imageMemory.memory, imageMemory.offset);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = levelCount;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (VK_SUCCESS != vkCreateImageView(logicDevice, &viewInfo, nullptr, &view))
+		throw std::runtime_error("failed to create hi-z view");
+
+	//storage images bind a single level
+	levelViews.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+
+		if (VK_SUCCESS != vkCreateImageView(logicDevice, &viewInfo, nullptr, &levelViews[level]))
+			throw std::runtime_error("failed to create hi-z level view");
+	}
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (VK_SUCCESS != vkCreateSampler(logicDevice, &samplerInfo, nullptr, &sampler))
+		throw std::runtime_error("failed to create hi-z sampler");
+}
+
+void HiZPyramid::CreateDescriptors(const std::vector<VkImageView>& depthViews)
+{
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (VK_SUCCESS != vkCreateDescriptorSetLayout(logicDevice, &layoutInfo, nullptr, &buildSetLayout))
+		throw std::runtime_error("failed to create hi-z dsl");
+
+	auto setCount = static_cast<uint32_t>(depthViews.size()) + levelCount - 1;
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = setCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (VK_SUCCESS != vkCreateDescriptorPool(logicDevice, &poolInfo, nullptr, &buildDescriptorPool))
+		throw std::runtime_error("failed to create hi-z descriptor pool");
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount, buildSetLayout);
+	std::vector<VkDescriptorSet> sets(setCount);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = buildDescriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (VK_SUCCESS != vkAllocateDescriptorSets(logicDevice, &allocInfo, sets.data()))
+		throw std::runtime_error("failed to alloc hi-z descriptors");
+
+	depthSets.assign(sets.begin(), sets.begin() + depthViews.size());
+	levelSets.assign(sets.begin() + depthViews.size(), sets.end());
+
+	auto writeSet = [&](VkDescriptorSet set, VkImageView srcView, VkImageLayout srcLayout, VkImageView dstView)
+	{
+		VkDescriptorImageInfo srcInfo = {};
+		srcInfo.sampler = sampler;
+		srcInfo.imageView = srcView;
+		srcInfo.imageLayout = srcLayout;
+
+		VkDescriptorImageInfo dstInfo = {};
+		dstInfo.imageView = dstView;
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writes = {};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = set;
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &srcInfo;
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = set;
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo = &dstInfo;
+
+		vkUpdateDescriptorSets(logicDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	};
+
+	for (size_t i = 0; i < depthViews.size(); ++i)
+		writeSet(depthSets[i], depthViews[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelViews[0]);
+
+	for (uint32_t level = 1; level < levelCount; ++level)
+		writeSet(levelSets[level - 1], levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL, levelViews[level]);
+}
+
+void HiZPyramid::CreatePipeline()
+{
+	auto shaderCode = ReadFile("Shaders/hiz_comp.spv");
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = shaderCode.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule;
+	if (VK_SUCCESS != vkCreateShaderModule(logicDevice, &moduleInfo, nullptr, &shaderModule))
+		throw std::runtime_error("failed to create hi-z shader module");
+
+	VkPushConstantRange pushRange = {};
+	pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushRange.offset = 0;
+	pushRange.size = sizeof(BuildParams);
+
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &buildSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushRange;
+
+	if (VK_SUCCESS != vkCreatePipelineLayout(logicDevice, &layoutInfo, nullptr, &buildLayout))
+		throw std::runtime_error("failed to create hi-z pipeline layout");
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = buildLayout;
+
+	auto result = vkCreateComputePipelines(logicDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &buildPipeline);
+	vkDestroyShaderModule(logicDevice, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to create hi-z pipeline");
+}
+
+VkExtent2D HiZPyramid::GetLevelExtent(VkExtent2D levelZero, uint32_t level)
+{
+	//rounded up, a level never covers less than the one above it
+	VkExtent2D levelExtent = levelZero;
+	for (uint32_t i = 0; i < level; ++i)
+	{
+		levelExtent.width = std::max(1u, (levelExtent.width + 1) / 2);
+		levelExtent.height = std::max(1u, (levelExtent.height + 1) / 2);
+	}
+	return levelExtent;
+}
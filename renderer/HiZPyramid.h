@@ -0,0 +1,68 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include "Utils.h"
+
+//max depth mip chain of the scene depth, a texel holds the farthest depth of the screen area it covers
+//so anything nearer than it over a whole bounding box is hidden
+class HiZPyramid
+{
+public:
+	HiZPyramid();
+
+	//one level 0 source per depth buffer, they're read in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	void Init(VkDevice newLogicDevice, MemoryAllocator* newAllocator, VkExtent2D newDepthExtent,
+		const std::vector<VkImageView>& depthViews);
+
+	//outside a render pass, after the depth of depthIdx was written
+	void RecordBuild(VkCommandBuffer cmdBuffer, uint32_t depthIdx);
+
+	//the whole chain in VK_IMAGE_LAYOUT_GENERAL, for texelFetch only
+	VkImageView GetView();
+	VkSampler GetSampler();
+	VkExtent2D GetExtent();
+	uint32_t GetLevelCount();
+
+	void Destroy();
+
+	~HiZPyramid();
+
+private:
+	struct BuildParams
+	{
+		uint32_t srcWidth;
+		uint32_t srcHeight;
+		uint32_t dstWidth;
+		uint32_t dstHeight;
+	};
+
+	VkDevice logicDevice;
+	MemoryAllocator* allocator;
+
+	VkExtent2D depthExtent = {};
+	VkExtent2D extent = {}; //level 0, half the depth resolution
+	uint32_t levelCount = 0;
+	bool initialized = false; //the first build also moves the image to VK_IMAGE_LAYOUT_GENERAL
+
+	VkImage image = VK_NULL_HANDLE;
+	MemoryAllocation imageMemory;
+	VkImageView view;
+	std::vector<VkImageView> levelViews;
+	VkSampler sampler;
+
+	VkDescriptorSetLayout buildSetLayout;
+	VkDescriptorPool buildDescriptorPool;
+	std::vector<VkDescriptorSet> depthSets; //level 0, one per depth buffer
+	std::vector<VkDescriptorSet> levelSets; //level i + 1 from level i
+	VkPipelineLayout buildLayout;
+	VkPipeline buildPipeline;
+
+	void CreateImage();
+	void CreateDescriptors(const std::vector<VkImageView>& depthViews);
+	void CreatePipeline();
+
+	static VkExtent2D GetLevelExtent(VkExtent2D levelZero, uint32_t level);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//read only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+
+	//false if the file doesn't exist or can't be mapped
+	bool Open(const std::string& fileName);
+	void Close();
+
+	const char* GetData();
+	size_t GetSize();
+	bool IsOpen();
+
+	~MappedFile();
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
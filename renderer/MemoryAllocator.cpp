@@ -0,0 +1,235 @@
+#include "MemoryAllocator.h"
+
+#include <iostream>
+#include <stdexcept>
+#include "Utils.h"
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+void MemoryAllocator::Init(VkPhysicalDevice newPhysDevice, VkDevice newLogicDevice)
+{
+	physDevice = newPhysDevice;
+	logicDevice = newLogicDevice;
+}
+
+MemoryAllocation MemoryAllocator::Allocate(VkMemoryRequirements memReq, VkMemoryPropertyFlags props, bool linear)
+{
+	MemoryAllocation allocation;
+	allocation.requestedSize = memReq.size;
+
+	uint32_t memTypeIdx = FindMemoryTypeIndex(physDevice, memReq.memoryTypeBits, props);
+
+	//big resources would eat most of a block, give them their own memory
+	if (memReq.size >= DEDICATED_ALLOC_SIZE)
+	{
+		allocation.memory = AllocateDeviceMemory(memReq.size, memTypeIdx, &allocation.mapped);
+		allocation.size = memReq.size;
+
+		++dedicatedCount;
+		dedicatedBytes += memReq.size;
+		return allocation;
+	}
+
+	VkDeviceSize size = RoundToSizeClass(memReq.size);
+
+	int blockIdx = -1;
+	VkDeviceSize offset = 0;
+
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		auto& b = blocks[i];
+		if (b.memory == VK_NULL_HANDLE || b.memTypeIdx != memTypeIdx || b.linear != linear)
+			continue;
+
+		if (b.ranges.Allocate(size, memReq.alignment, &offset))
+		{
+			blockIdx = static_cast<int>(i);
+			break;
+		}
+	}
+
+	if (blockIdx < 0)
+	{
+		blockIdx = CreateBlock(memTypeIdx, linear);
+		if (!blocks[blockIdx].ranges.Allocate(size, memReq.alignment, &offset))
+			throw std::runtime_error("allocation doesn't fit a fresh memory block");
+	}
+
+	auto& block = blocks[blockIdx];
+	++block.allocationCount;
+
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.blockIdx = blockIdx;
+	if (block.mapped)
+		allocation.mapped = static_cast<char*>(block.mapped) + offset;
+
+	++allocationCount;
+	requestedBytes += memReq.size;
+	allocatedBytes += size;
+
+	return allocation;
+}
+
+void MemoryAllocator::Free(const MemoryAllocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	if (allocation.blockIdx < 0)
+	{
+		vkFreeMemory(logicDevice, allocation.memory, nullptr);
+
+		--dedicatedCount;
+		dedicatedBytes -= allocation.size;
+		return;
+	}
+
+	auto& block = blocks[allocation.blockIdx];
+	block.ranges.Free(allocation.offset, allocation.size);
+
+	--allocationCount;
+	requestedBytes -= allocation.requestedSize;
+	allocatedBytes -= allocation.size;
+
+	//hand empty blocks back to the driver, the slot gets reused
+	if (--block.allocationCount == 0)
+	{
+		vkFreeMemory(logicDevice, block.memory, nullptr);
+		block.memory = VK_NULL_HANDLE;
+		block.mapped = nullptr;
+	}
+}
+
+VkMemoryPropertyFlags MemoryAllocator::PreferProps(VkMemoryPropertyFlags wantedProps, VkMemoryPropertyFlags preferredProps)
+{
+	VkPhysicalDeviceMemoryProperties memProps;
+	vkGetPhysicalDeviceMemoryProperties(physDevice, &memProps);
+
+	auto props = wantedProps | preferredProps;
+	for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i)
+	{
+		if ((memProps.memoryTypes[i].propertyFlags & props) == props)
+			return props;
+	}
+
+	return wantedProps;
+}
+
+MemoryStats MemoryAllocator::GetStats()
+{
+	MemoryStats stats;
+	stats.dedicatedCount = dedicatedCount;
+	stats.dedicatedBytes = dedicatedBytes;
+	stats.allocationCount = allocationCount + dedicatedCount;
+	stats.usedBytes = allocatedBytes;
+	stats.wastedBytes = allocatedBytes - requestedBytes;
+
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeBytes = 0;
+
+	for (auto& b : blocks)
+	{
+		if (b.memory == VK_NULL_HANDLE)
+			continue;
+
+		++stats.blockCount;
+		stats.blockBytes += b.ranges.GetCapacity();
+		freeBytes += b.ranges.GetFreeBytes();
+		largestFreeBytes += b.ranges.GetLargestFreeRange();
+	}
+
+	if (freeBytes > 0)
+		stats.fragmentation = 1.0f - static_cast<float>(largestFreeBytes) / static_cast<float>(freeBytes);
+
+	return stats;
+}
+
+void MemoryAllocator::PrintStats()
+{
+	auto stats = GetStats();
+
+	std::cout << "gpu memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks ("
+		<< stats.blockBytes / (1024 * 1024) << " MB) + " << stats.dedicatedCount << " dedicated ("
+		<< stats.dedicatedBytes / (1024 * 1024) << " MB), " << stats.usedBytes / 1024 << " KB used, "
+		<< stats.wastedBytes / 1024 << " KB wasted, fragmentation " << stats.fragmentation << std::endl;
+}
+
+void MemoryAllocator::Destroy()
+{
+	for (auto& b : blocks)
+	{
+		if (b.memory != VK_NULL_HANDLE)
+			vkFreeMemory(logicDevice, b.memory, nullptr);
+	}
+
+	blocks.clear();
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+}
+
+VkDeviceMemory MemoryAllocator::AllocateDeviceMemory(VkDeviceSize size, uint32_t memTypeIdx, void** mapped)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memTypeIdx;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(logicDevice, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate device memory");
+
+	VkPhysicalDeviceMemoryProperties memProps;
+	vkGetPhysicalDeviceMemoryProperties(physDevice, &memProps);
+
+	//blocks are shared by memory type, map whenever the type is host visible, not only when this request asked for it
+	*mapped = nullptr;
+	if (memProps.memoryTypes[memTypeIdx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		vkMapMemory(logicDevice, memory, 0, size, 0, mapped);
+
+	return memory;
+}
+
+int MemoryAllocator::CreateBlock(uint32_t memTypeIdx, bool linear)
+{
+	size_t slot = blocks.size();
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		if (blocks[i].memory == VK_NULL_HANDLE)
+		{
+			slot = i;
+			break;
+		}
+	}
+
+	if (slot == blocks.size())
+		blocks.emplace_back();
+
+	auto& block = blocks[slot];
+	block.memory = AllocateDeviceMemory(MEMORY_BLOCK_SIZE, memTypeIdx, &block.mapped);
+	block.memTypeIdx = memTypeIdx;
+	block.linear = linear;
+	block.allocationCount = 0;
+	block.ranges = RangeAllocator(MEMORY_BLOCK_SIZE);
+
+	return static_cast<int>(slot);
+}
+
+VkDeviceSize MemoryAllocator::RoundToSizeClass(VkDeviceSize size)
+{
+	//8 classes per power of two, at most 12.5% lost, but freed ranges fit the next resource of similar size
+	if (size <= MIN_ALLOC_SIZE)
+		return MIN_ALLOC_SIZE;
+
+	VkDeviceSize pow2 = MIN_ALLOC_SIZE;
+	while (pow2 * 2 <= size)
+		pow2 *= 2;
+
+	VkDeviceSize step = pow2 / 8;
+	return (size + step - 1) / step * step;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include "RangeAllocator.h"
+
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0; //size class actually taken from the block
+	VkDeviceSize requestedSize = 0;
+	void* mapped = nullptr; //host visible memory stays mapped for its whole life
+	int blockIdx = -1; //-1 = dedicated allocation
+};
+
+struct MemoryStats
+{
+	size_t blockCount = 0;
+	size_t dedicatedCount = 0;
+	size_t allocationCount = 0;
+
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	VkDeviceSize wastedBytes = 0; //lost to size class rounding
+
+	float fragmentation = 0.0f; //0 = all free space in one range per block
+};
+
+//carves buffers and images out of a few big vkAllocateMemory blocks instead of one allocation each
+class MemoryAllocator
+{
+public:
+	MemoryAllocator();
+
+	void Init(VkPhysicalDevice newPhysDevice, VkDevice newLogicDevice);
+
+	//linear = buffers, images with optimal tiling get their own blocks so granularity never matters
+	MemoryAllocation Allocate(VkMemoryRequirements memReq, VkMemoryPropertyFlags props, bool linear);
+	void Free(const MemoryAllocation& allocation);
+
+	//wanted | preferred if some memory type has all of them, otherwise just wanted
+	VkMemoryPropertyFlags PreferProps(VkMemoryPropertyFlags wantedProps, VkMemoryPropertyFlags preferredProps);
+
+	MemoryStats GetStats();
+	void PrintStats();
+
+	void Destroy();
+
+	~MemoryAllocator();
+
+private:
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE; //null = slot free for reuse
+		uint32_t memTypeIdx;
+		bool linear;
+		void* mapped = nullptr;
+		size_t allocationCount = 0;
+		RangeAllocator ranges;
+	};
+
+	VkPhysicalDevice physDevice;
+	VkDevice logicDevice;
+
+	std::vector<MemoryBlock> blocks;
+
+	size_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	size_t allocationCount = 0;
+	VkDeviceSize requestedBytes = 0;
+	VkDeviceSize allocatedBytes = 0;
+
+	VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, uint32_t memTypeIdx, void** mapped);
+	int CreateBlock(uint32_t memTypeIdx, bool linear);
+
+	static VkDeviceSize RoundToSizeClass(VkDeviceSize size);
+};
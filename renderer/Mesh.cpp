@@ -1,21 +1,53 @@
 #include "Mesh.h"
+#include <algorithm>
 #include <iostream>
 
 Mesh::Mesh()
 {
 }
 
-Mesh::Mesh(VkPhysicalDevice newPhysDevice, VkDevice newLogicDevice,
-	VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<Vertex>* verts, std::vector<uint32_t>* indices,
-	size_t textureId) :
+Mesh::Mesh(GeometryPool* newGeometryPool, UploadBatch* uploadBatch, const GeometryStaging& staging,
+	const MeshRange& range, const Meshlet* modelMeshlets, size_t textureId) :
 	texId(textureId),
-	vertexCount(static_cast<int>(verts->size())),
-	indexCount(static_cast<int>(indices->size())),
-	physDevice(newPhysDevice),
-	logicDevice(newLogicDevice)
+	vertexCount(static_cast<int>(range.vertexCount)),
+	indexCount(static_cast<int>(range.indexCount)),
+	boundsMin(range.boundsMin),
+	boundsMax(range.boundsMax),
+	sphere(range.sphere),
+	geometryPool(newGeometryPool)
 {
-	CreateVertexBuffer(transferQueue, transferCmdPool, verts);
-	CreateIndexBuffer(transferQueue, transferCmdPool, indices);
+	vertexOffset = geometryPool->CopyVertices(uploadBatch, staging.buffer,
+		sizeof(Vertex) * range.firstVertex, range.vertexCount);
+	firstIndex = geometryPool->CopyIndices(uploadBatch, staging.buffer,
+		staging.indexOffset + sizeof(uint32_t) * range.firstIndex, range.indexCount);
+
+	lodIndexCounts[0] = indexCount;
+	lodFirstIndices[0] = firstIndex;
+
+	//simplified levels get pool ranges of their own, their indices are relative to the same vertex offset
+	lodCount = 1 + static_cast<int>(std::min(range.lodCount, MAX_MESH_LODS - 1));
+	for (int l = 1; l < lodCount; ++l)
+	{
+		const auto& lod = range.lods[l - 1];
+		lodIndexCounts[l] = static_cast<int>(lod.indexCount);
+		lodFirstIndices[l] = geometryPool->CopyIndices(uploadBatch, staging.extraBuffer,
+			staging.lodIndexOffset + sizeof(uint32_t) * lod.firstIndex, lod.indexCount);
+		lodErrors[l] = lod.error;
+	}
+
+	meshlets = std::make_shared<const std::vector<Meshlet>>(modelMeshlets + range.firstMeshlet,
+		modelMeshlets + range.firstMeshlet + range.meshletCount);
+
+	//both are plain uint32 arrays, the index pool holds them for the task and mesh shaders
+	if (staging.meshletGeometry && range.meshletCount > 0)
+	{
+		meshletGeometry = true;
+		meshletVertexCount = range.meshletVertexCount;
+		meshletVertexOffset = geometryPool->CopyIndices(uploadBatch, staging.extraBuffer,
+			staging.meshletVertexOffset + sizeof(uint32_t) * range.firstMeshletVertex, meshletVertexCount);
+		meshletTriangleOffset = geometryPool->CopyIndices(uploadBatch, staging.extraBuffer,
+			staging.meshletTriangleOffset + sizeof(uint32_t) * (range.firstIndex / 3), range.indexCount / 3);
+	}
 
 	model.model = glm::mat4(1.0f);
 }
@@ -40,9 +72,9 @@ int Mesh::GetVertexCount()
 	return vertexCount;
 }
 
-VkBuffer Mesh::GetVertexBuffer()
+uint32_t Mesh::GetVertexOffset()
 {
-	return vertexBuffer;
+	return vertexOffset;
 }
 
 int Mesh::GetIndexCount()
@@ -50,74 +82,83 @@ int Mesh::GetIndexCount()
 	return indexCount;
 }
 
-VkBuffer Mesh::GetIndexBuffer()
+uint32_t Mesh::GetFirstIndex()
 {
-	return idxBuffer;
+	return firstIndex;
 }
 
-void Mesh::DestroyBuffers()
+int Mesh::GetLodCount()
 {
-	vkDestroyBuffer(logicDevice, vertexBuffer, nullptr);
-	vkFreeMemory(logicDevice, vertexBufferMemory, nullptr);
-
-	vkDestroyBuffer(logicDevice, idxBuffer, nullptr);
-	vkFreeMemory(logicDevice, idxBufferMemory, nullptr);
+	return lodCount;
 }
 
-Mesh::~Mesh()
+int Mesh::GetLodIndexCount(int lod)
 {
+	return lodIndexCounts[lod];
 }
 
-void Mesh::CreateVertexBuffer(VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<Vertex>* verts)
+uint32_t Mesh::GetLodFirstIndex(int lod)
 {
-	VkDeviceSize bufferSize = sizeof(Vertex) * verts->size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	CreateBuffer(physDevice, logicDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer, &stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(logicDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, verts->data(), bufferSize);
-	vkUnmapMemory(logicDevice, stagingBufferMemory);
+	return lodFirstIndices[lod];
+}
 
-	CreateBuffer(physDevice, logicDevice, bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&vertexBuffer, &vertexBufferMemory);
+float Mesh::GetLodError(int lod)
+{
+	return lodErrors[lod];
+}
 
-	CopyBuffer(logicDevice, transferQueue, transferCmdPool, stagingBuffer, vertexBuffer, bufferSize);
+const std::vector<Meshlet>& Mesh::GetMeshlets()
+{
+	static const std::vector<Meshlet> none;
+	return meshlets ? *meshlets : none;
+}
 
-	vkDestroyBuffer(logicDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicDevice, stagingBufferMemory, nullptr);
+bool Mesh::HasMeshletGeometry()
+{
+	return meshletGeometry;
 }
 
-void Mesh::CreateIndexBuffer(VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<uint32_t>* indices)
+uint32_t Mesh::GetMeshletVertexOffset()
 {
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
+	return meshletVertexOffset;
+}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+uint32_t Mesh::GetMeshletTriangleOffset()
+{
+	return meshletTriangleOffset;
+}
 
-	CreateBuffer(physDevice, logicDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer, &stagingBufferMemory);
+glm::vec3 Mesh::GetBoundsMin()
+{
+	return boundsMin;
+}
 
-	void* data;
-	vkMapMemory(logicDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices->data(), bufferSize);
-	vkUnmapMemory(logicDevice, stagingBufferMemory);
+glm::vec3 Mesh::GetBoundsMax()
+{
+	return boundsMax;
+}
 
-	CreateBuffer(physDevice, logicDevice, bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&idxBuffer, &idxBufferMemory);
+glm::vec4 Mesh::GetBoundingSphere()
+{
+	return sphere;
+}
 
-	CopyBuffer(logicDevice, transferQueue, transferCmdPool, stagingBuffer, idxBuffer, bufferSize);
+void Mesh::DestroyBuffers()
+{
+	//ranges go back to the pool, merged with free neighbours
+	geometryPool->FreeVertices(vertexOffset, vertexCount);
+	geometryPool->FreeIndices(firstIndex, indexCount);
+
+	for (int l = 1; l < lodCount; ++l)
+		geometryPool->FreeIndices(lodFirstIndices[l], lodIndexCounts[l]);
+
+	if (meshletGeometry)
+	{
+		geometryPool->FreeIndices(meshletVertexOffset, meshletVertexCount);
+		geometryPool->FreeIndices(meshletTriangleOffset, indexCount / 3);
+	}
+}
 
-	vkDestroyBuffer(logicDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicDevice, stagingBufferMemory, nullptr);
+Mesh::~Mesh()
+{
 }
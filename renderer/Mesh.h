@@ -3,31 +3,75 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <array>
+#include <memory>
 #include <vector>
 #include "Utils.h"
+#include "UploadBatch.h"
+#include "GeometryPool.h"
 
 struct Model
 {
 	glm::mat4 model;
 };
 
+//one entry of the per-frame object buffer, std430 layout, draws find theirs through firstInstance
+struct ObjectData
+{
+	glm::mat4 model;
+	glm::vec4 params; //free for per-object shader parameters
+};
+
+//where a model's packed arrays start in its staging buffers, in bytes
+struct GeometryStaging
+{
+	VkBuffer buffer;
+	VkDeviceSize indexOffset;
+	//lod indices and meshlet geometry, the same buffer as the rest unless they were staged after it
+	VkBuffer extraBuffer;
+	VkDeviceSize lodIndexOffset;
+	//only staged for the mesh shading path, false = the meshes get no meshlet geometry
+	bool meshletGeometry;
+	VkDeviceSize meshletVertexOffset;
+	VkDeviceSize meshletTriangleOffset;
+};
+
 class Mesh
 {
 public:
 	Mesh();
-	Mesh(VkPhysicalDevice newPhysDevice, VkDevice newLogicDevice,
-		VkQueue transferQueue, VkCommandPool transferCmdPool,
-		std::vector<Vertex>* verts, std::vector<uint32_t>* indices, size_t textureId);
+	//range points into the model's packed staging buffer and into modelMeshlets, the mesh keeps a copy of its own
+	Mesh(GeometryPool* newGeometryPool, UploadBatch* uploadBatch, const GeometryStaging& staging,
+		const MeshRange& range, const Meshlet* modelMeshlets, size_t textureId);
 
 	void SetModel(glm::mat4 newModel);
 	Model GetModel();
 	size_t GetTexId();
 
+	//offsets into the shared geometry pool buffers
 	int GetVertexCount();
-	VkBuffer GetVertexBuffer();
+	uint32_t GetVertexOffset();
 
 	int GetIndexCount();
-	VkBuffer GetIndexBuffer();
+	uint32_t GetFirstIndex();
+
+	//level 0 is the full mesh above, every level uses the same vertices
+	int GetLodCount();
+	int GetLodIndexCount(int lod);
+	uint32_t GetLodFirstIndex(int lod);
+	float GetLodError(int lod);
+
+	//cover the full index list, first indices relative to GetFirstIndex, shared by copies of the mesh
+	const std::vector<Meshlet>& GetMeshlets();
+	//index pool offsets of the meshlet vertices (values relative to GetVertexOffset) and packed triangles, false if none were staged
+	bool HasMeshletGeometry();
+	uint32_t GetMeshletVertexOffset();
+	uint32_t GetMeshletTriangleOffset();
+
+	//local space
+	glm::vec3 GetBoundsMin();
+	glm::vec3 GetBoundsMax();
+	glm::vec4 GetBoundingSphere();
 
 	void DestroyBuffers();
 
@@ -39,17 +83,26 @@ private:
 	size_t texId;
 
 	int vertexCount;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	uint32_t vertexOffset;
 
 	int indexCount;
-	VkBuffer idxBuffer;
-	VkDeviceMemory idxBufferMemory;
+	uint32_t firstIndex;
+
+	int lodCount = 1;
+	std::array<int, MAX_MESH_LODS> lodIndexCounts = {};
+	std::array<uint32_t, MAX_MESH_LODS> lodFirstIndices = {};
+	std::array<float, MAX_MESH_LODS> lodErrors = {};
+
+	std::shared_ptr<const std::vector<Meshlet>> meshlets;
+	bool meshletGeometry = false;
+	uint32_t meshletVertexCount = 0;
+	uint32_t meshletVertexOffset = 0;
+	uint32_t meshletTriangleOffset = 0;
 
-	VkPhysicalDevice physDevice;
-	VkDevice logicDevice;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec4 sphere;
 
-	void CreateVertexBuffer(VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<Vertex>* verts);
-	void CreateIndexBuffer(VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<uint32_t>* indices);
+	GeometryPool* geometryPool;
 };
 
@@ -0,0 +1,287 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static const char COOKED_MAGIC[4] = { 'M', 'C', 'K', 'D' };
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+MeshCache::MeshCache()
+{
+}
+
+uint64_t MeshCache::HashFile(const std::string& fileName)
+{
+	MappedFile source;
+	if (!source.Open(fileName))
+		throw std::runtime_error("failed to open file: " + fileName);
+
+	//fnv-1a 64
+	uint64_t hash = 14695981039346656037ull;
+	auto bytes = reinterpret_cast<const unsigned char*>(source.GetData());
+	for (size_t i = 0; i < source.GetSize(); ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+void MeshCache::Write(const std::string& cookedName, uint64_t sourceHash, const std::vector<std::string>& texNames,
+	const std::vector<MeshRange>& meshRanges, const Vertex* verts, uint64_t totalVertices, const uint32_t* indices, uint64_t totalIndices,
+	const uint32_t* lodIndices, uint64_t totalLodIndices, const Meshlet* meshlets, uint64_t totalMeshlets,
+	const uint32_t* meshletVertices, uint64_t totalMeshletVertices, const uint32_t* meshletTriangles)
+{
+	CookedHeader header = {};
+	memcpy(header.magic, COOKED_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.texCount = static_cast<uint32_t>(texNames.size());
+	header.meshCount = static_cast<uint32_t>(meshRanges.size());
+	header.totalVertices = totalVertices;
+	header.totalIndices = totalIndices;
+	header.totalLodIndices = totalLodIndices;
+	header.totalMeshlets = totalMeshlets;
+	header.totalMeshletVertices = totalMeshletVertices;
+	header.maxMeshLods = MAX_MESH_LODS;
+	header.lodReduction = LOD_REDUCTION;
+	header.lodMaxError = LOD_MAX_ERROR;
+	header.lodMinTriangles = LOD_MIN_TRIANGLES;
+	header.meshletMaxVertices = MESHLET_MAX_VERTICES;
+	header.meshletMaxTriangles = MESHLET_MAX_TRIANGLES;
+
+	uint64_t offset = sizeof(CookedHeader);
+	for (const auto& t : texNames)
+		offset += sizeof(uint32_t) + t.size();
+
+	header.rangesOffset = AlignUp(offset, 8);
+	header.meshletsOffset = AlignUp(header.rangesOffset + sizeof(MeshRange) * meshRanges.size(), 16);
+	header.verticesOffset = AlignUp(header.meshletsOffset + sizeof(Meshlet) * totalMeshlets, 16);
+	header.indicesOffset = AlignUp(header.verticesOffset + sizeof(Vertex) * totalVertices, 16);
+	header.lodIndicesOffset = AlignUp(header.indicesOffset + sizeof(uint32_t) * totalIndices, 16);
+	header.meshletVerticesOffset = AlignUp(header.lodIndicesOffset + sizeof(uint32_t) * totalLodIndices, 16);
+	header.meshletTrianglesOffset = AlignUp(header.meshletVerticesOffset + sizeof(uint32_t) * totalMeshletVertices, 16);
+	uint64_t fileSize = AlignUp(header.meshletTrianglesOffset + sizeof(uint32_t) * (totalIndices / 3), 16);
+
+	//written next to the final name and swapped in, a crash mid write never leaves a valid looking file
+	auto tmpName = cookedName + ".tmp";
+	std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		throw std::runtime_error("failed to write cooked mesh: " + cookedName);
+
+	const char zeros[16] = {};
+	auto padTo = [&out, &zeros](uint64_t target)
+	{
+		uint64_t pos = static_cast<uint64_t>(out.tellp());
+		if (target > pos)
+			out.write(zeros, static_cast<std::streamsize>(target - pos));
+	};
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const auto& t : texNames)
+	{
+		uint32_t len = static_cast<uint32_t>(t.size());
+		out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		out.write(t.data(), len);
+	}
+
+	padTo(header.rangesOffset);
+	out.write(reinterpret_cast<const char*>(meshRanges.data()), sizeof(MeshRange) * meshRanges.size());
+
+	padTo(header.meshletsOffset);
+	out.write(reinterpret_cast<const char*>(meshlets), sizeof(Meshlet) * totalMeshlets);
+
+	padTo(header.verticesOffset);
+	out.write(reinterpret_cast<const char*>(verts), sizeof(Vertex) * totalVertices);
+	padTo(header.indicesOffset);
+	out.write(reinterpret_cast<const char*>(indices), sizeof(uint32_t) * totalIndices);
+	padTo(header.lodIndicesOffset);
+	out.write(reinterpret_cast<const char*>(lodIndices), sizeof(uint32_t) * totalLodIndices);
+	padTo(header.meshletVerticesOffset);
+	out.write(reinterpret_cast<const char*>(meshletVertices), sizeof(uint32_t) * totalMeshletVertices);
+	padTo(header.meshletTrianglesOffset);
+	out.write(reinterpret_cast<const char*>(meshletTriangles), sizeof(uint32_t) * (totalIndices / 3));
+	padTo(fileSize);
+
+	out.close();
+	if (out.fail())
+		throw std::runtime_error("failed to write cooked mesh: " + cookedName);
+
+	std::remove(cookedName.c_str());
+	if (std::rename(tmpName.c_str(), cookedName.c_str()) != 0)
+		throw std::runtime_error("failed to replace cooked mesh: " + cookedName);
+}
+
+bool MeshCache::Open(const std::string& cookedName, uint64_t sourceHash)
+{
+	texNames.clear();
+	meshRanges = nullptr;
+	meshCount = 0;
+
+	if (!file.Open(cookedName))
+		return false;
+
+	auto data = file.GetData();
+	auto size = file.GetSize();
+
+	if (size < sizeof(CookedHeader))
+		return false;
+
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, COOKED_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != MESH_CACHE_VERSION || header.sourceHash != sourceHash ||
+		header.maxMeshLods != MAX_MESH_LODS || header.lodReduction != LOD_REDUCTION || header.lodMaxError != LOD_MAX_ERROR ||
+		header.lodMinTriangles != LOD_MIN_TRIANGLES || header.meshletMaxVertices != MESHLET_MAX_VERTICES ||
+		header.meshletMaxTriangles != MESHLET_MAX_TRIANGLES)
+	{
+		file.Close();
+		return false;
+	}
+
+	//anything out of bounds means a damaged file, treat it as stale and recook
+	uint64_t offset = sizeof(CookedHeader);
+	for (uint32_t i = 0; i < header.texCount; ++i)
+	{
+		uint32_t len;
+		if (offset + sizeof(len) > size)
+			return false;
+		memcpy(&len, data + offset, sizeof(len));
+		offset += sizeof(len);
+
+		if (offset + len > size)
+			return false;
+		texNames.emplace_back(data + offset, len);
+		offset += len;
+	}
+
+	if (header.rangesOffset % 8 != 0 || header.rangesOffset + sizeof(MeshRange) * header.meshCount > size ||
+		header.verticesOffset + sizeof(Vertex) * header.totalVertices > size ||
+		header.indicesOffset + sizeof(uint32_t) * header.totalIndices > size ||
+		header.lodIndicesOffset + sizeof(uint32_t) * header.totalLodIndices > size ||
+		header.meshletsOffset % 16 != 0 || header.meshletsOffset + sizeof(Meshlet) * header.totalMeshlets > size ||
+		header.meshletVerticesOffset + sizeof(uint32_t) * header.totalMeshletVertices > size ||
+		header.meshletTrianglesOffset + sizeof(uint32_t) * (header.totalIndices / 3) > size)
+	{
+		return false;
+	}
+
+	auto ranges = reinterpret_cast<const MeshRange*>(data + header.rangesOffset);
+	for (uint32_t i = 0; i < header.meshCount; ++i)
+	{
+		const auto& r = ranges[i];
+		if (r.firstVertex + r.vertexCount > header.totalVertices ||
+			r.firstIndex + r.indexCount > header.totalIndices ||
+			r.materialIdx >= header.texCount || r.lodCount > MAX_MESH_LODS - 1 ||
+			r.firstMeshlet + r.meshletCount > header.totalMeshlets ||
+			r.firstMeshletVertex + r.meshletVertexCount > header.totalMeshletVertices)
+		{
+			return false;
+		}
+
+		for (uint32_t l = 0; l < r.lodCount; ++l)
+		{
+			if (r.lods[l].firstIndex + r.lods[l].indexCount > header.totalLodIndices)
+				return false;
+		}
+
+		auto meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletsOffset) + r.firstMeshlet;
+		for (uint32_t m = 0; m < r.meshletCount; ++m)
+		{
+			if (meshlets[m].firstIndex + meshlets[m].indexCount > r.indexCount ||
+				meshlets[m].vertexOffset + meshlets[m].vertexCount > r.meshletVertexCount ||
+				meshlets[m].vertexCount > MESHLET_MAX_VERTICES)
+			{
+				return false;
+			}
+		}
+	}
+
+	meshRanges = ranges;
+	meshCount = header.meshCount;
+	return true;
+}
+
+const std::vector<std::string>& MeshCache::GetTexNames()
+{
+	return texNames;
+}
+
+size_t MeshCache::GetMeshCount()
+{
+	return meshCount;
+}
+
+const MeshRange& MeshCache::GetMeshRange(size_t idx)
+{
+	if (idx >= meshCount)
+		throw std::runtime_error("oor cooked mesh access");
+
+	return meshRanges[idx];
+}
+
+const Vertex* MeshCache::GetVertices()
+{
+	return reinterpret_cast<const Vertex*>(file.GetData() + header.verticesOffset);
+}
+
+const uint32_t* MeshCache::GetIndices()
+{
+	return reinterpret_cast<const uint32_t*>(file.GetData() + header.indicesOffset);
+}
+
+uint64_t MeshCache::GetTotalVertices()
+{
+	return header.totalVertices;
+}
+
+uint64_t MeshCache::GetTotalIndices()
+{
+	return header.totalIndices;
+}
+
+const uint32_t* MeshCache::GetLodIndices()
+{
+	return reinterpret_cast<const uint32_t*>(file.GetData() + header.lodIndicesOffset);
+}
+
+uint64_t MeshCache::GetTotalLodIndices()
+{
+	return header.totalLodIndices;
+}
+
+const Meshlet* MeshCache::GetMeshlets()
+{
+	return reinterpret_cast<const Meshlet*>(file.GetData() + header.meshletsOffset);
+}
+
+uint64_t MeshCache::GetTotalMeshlets()
+{
+	return header.totalMeshlets;
+}
+
+const uint32_t* MeshCache::GetMeshletVertices()
+{
+	return reinterpret_cast<const uint32_t*>(file.GetData() + header.meshletVerticesOffset);
+}
+
+uint64_t MeshCache::GetTotalMeshletVertices()
+{
+	return header.totalMeshletVertices;
+}
+
+const uint32_t* MeshCache::GetMeshletTriangles()
+{
+	return reinterpret_cast<const uint32_t*>(file.GetData() + header.meshletTrianglesOffset);
+}
+
+MeshCache::~MeshCache()
+{
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "MappedFile.h"
+
+//on disk layout: header, texture names, one MeshRange per mesh, then all meshlets, vertices, indices, lod indices,
+//meshlet vertices and meshlet triangles (16 byte aligned)
+struct CookedHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t texCount;
+	uint32_t meshCount;
+	uint64_t rangesOffset;
+	uint64_t totalVertices;
+	uint64_t totalIndices;
+	uint64_t verticesOffset; //bytes from the start of the file
+	uint64_t indicesOffset;
+	uint64_t totalLodIndices;
+	uint64_t lodIndicesOffset;
+	uint64_t totalMeshlets;
+	uint64_t meshletsOffset;
+	uint64_t totalMeshletVertices;
+	uint64_t meshletVerticesOffset;
+	uint64_t meshletTrianglesOffset; //totalIndices / 3 of them
+	//cook settings from Utils.h, a file cooked with other ones is stale like one from another version
+	uint32_t maxMeshLods;
+	float lodReduction;
+	float lodMaxError;
+	uint32_t lodMinTriangles;
+	uint32_t meshletMaxVertices;
+	uint32_t meshletMaxTriangles;
+};
+
+//converted meshes of a source model, so warm starts map them instead of running assimp
+class MeshCache
+{
+public:
+	MeshCache();
+
+	static uint64_t HashFile(const std::string& fileName);
+	static void Write(const std::string& cookedName, uint64_t sourceHash, const std::vector<std::string>& texNames,
+		const std::vector<MeshRange>& meshRanges, const Vertex* verts, uint64_t totalVertices, const uint32_t* indices, uint64_t totalIndices,
+		const uint32_t* lodIndices, uint64_t totalLodIndices, const Meshlet* meshlets, uint64_t totalMeshlets,
+		const uint32_t* meshletVertices, uint64_t totalMeshletVertices, const uint32_t* meshletTriangles);
+
+	//false if missing, from another version, cooked with other settings or from different source content
+	bool Open(const std::string& cookedName, uint64_t sourceHash);
+
+	const std::vector<std::string>& GetTexNames();
+	size_t GetMeshCount();
+	const MeshRange& GetMeshRange(size_t idx);
+
+	//packed the same way the importer lays out staging memory
+	const Vertex* GetVertices();
+	const uint32_t* GetIndices();
+	uint64_t GetTotalVertices();
+	uint64_t GetTotalIndices();
+	const uint32_t* GetLodIndices();
+	uint64_t GetTotalLodIndices();
+	const Meshlet* GetMeshlets();
+	uint64_t GetTotalMeshlets();
+	const uint32_t* GetMeshletVertices();
+	uint64_t GetTotalMeshletVertices();
+	const uint32_t* GetMeshletTriangles();
+
+	~MeshCache();
+
+private:
+	MappedFile file;
+	std::vector<std::string> texNames;
+	const MeshRange* meshRanges = nullptr;
+	size_t meshCount = 0;
+	CookedHeader header = {};
+};
@@ -0,0 +1,155 @@
+#include "MeshImporter.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <assimp/postprocess.h>
+
+#include "MeshModel.h"
+
+MeshImporter::MeshImporter()
+{
+}
+
+void MeshImporter::Open(const std::string& newFileName)
+{
+	auto importStart = std::chrono::high_resolution_clock::now();
+
+	fileName = newFileName;
+	scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+	if (!scene) throw std::runtime_error("failed to load model: " + fileName);
+
+	texNames = MeshModel::LoadMaterials(scene);
+
+	//node order decides mesh order, flatten it first so the parallel conversion can't change it
+	sceneMeshes.clear();
+	MeshModel::LoadNode(scene->mRootNode, scene, &sceneMeshes);
+
+	meshRanges.resize(sceneMeshes.size());
+	totalVertices = 0;
+	totalIndices = 0;
+
+	for (size_t i = 0; i < sceneMeshes.size(); ++i)
+	{
+		auto& r = meshRanges[i];
+		r = {};
+		r.firstVertex = totalVertices;
+		r.firstIndex = totalIndices;
+		r.vertexCount = sceneMeshes[i]->mNumVertices;
+		r.indexCount = MeshModel::CountIndices(sceneMeshes[i]);
+		r.materialIdx = sceneMeshes[i]->mMaterialIndex;
+
+		totalVertices += r.vertexCount;
+		totalIndices += r.indexCount;
+	}
+
+	if (totalVertices == 0 || totalIndices == 0)
+		throw std::runtime_error("model has no geometry: " + fileName);
+
+	importMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - importStart).count();
+}
+
+const std::vector<std::string>& MeshImporter::GetTexNames()
+{
+	return texNames;
+}
+
+const std::vector<MeshRange>& MeshImporter::GetMeshRanges()
+{
+	return meshRanges;
+}
+
+uint64_t MeshImporter::GetTotalVertices()
+{
+	return totalVertices;
+}
+
+uint64_t MeshImporter::GetTotalIndices()
+{
+	return totalIndices;
+}
+
+void MeshImporter::Convert(ThreadPool* threadPool, Vertex* verts, uint32_t* indices)
+{
+	if (!scene)
+		throw std::runtime_error("mesh importer used before open");
+
+	auto convertStart = std::chrono::high_resolution_clock::now();
+
+	//ranges never overlap, so workers need no synchronisation
+	std::vector<std::vector<Meshlet>> meshMeshlets(sceneMeshes.size());
+	std::vector<std::vector<uint32_t>> meshMeshletVertices(sceneMeshes.size());
+	meshletTriangles.assign(totalIndices / 3, 0);
+	threadPool->ParallelFor(sceneMeshes.size(), [&](size_t i)
+	{
+		MeshModel::LoadMesh(sceneMeshes[i], verts + meshRanges[i].firstVertex, indices + meshRanges[i].firstIndex, &meshRanges[i]);
+		MeshModel::BuildMeshlets(verts, indices, meshRanges[i], &meshMeshlets[i], &meshMeshletVertices[i], meshletTriangles.data());
+	});
+
+	meshlets.clear();
+	meshletVertices.clear();
+	for (size_t i = 0; i < meshRanges.size(); ++i)
+	{
+		meshRanges[i].firstMeshlet = meshlets.size();
+		meshRanges[i].meshletCount = static_cast<uint32_t>(meshMeshlets[i].size());
+		meshlets.insert(meshlets.end(), meshMeshlets[i].begin(), meshMeshlets[i].end());
+
+		meshRanges[i].firstMeshletVertex = meshletVertices.size();
+		meshRanges[i].meshletVertexCount = static_cast<uint32_t>(meshMeshletVertices[i].size());
+		meshletVertices.insert(meshletVertices.end(), meshMeshletVertices[i].begin(), meshMeshletVertices[i].end());
+	}
+
+	auto convertMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - convertStart).count();
+	std::cout << "imported " << fileName << ": assimp " << importMs << " ms, converted " << sceneMeshes.size() << " meshes ("
+		<< totalVertices << " verts, " << totalIndices << " indices, " << meshlets.size() << " meshlets) in " << convertMs << " ms on "
+		<< threadPool->GetThreadCount() + 1 << " threads" << std::endl;
+}
+
+void MeshImporter::BuildLods(ThreadPool* threadPool, const Vertex* verts, const uint32_t* indices)
+{
+	auto lodStart = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::vector<uint32_t>> meshLodIndices(meshRanges.size());
+	threadPool->ParallelFor(meshRanges.size(), [&](size_t i)
+	{
+		MeshModel::BuildLods(verts, indices, &meshRanges[i], &meshLodIndices[i]);
+	});
+
+	//concatenated in mesh order so the cook doesn't depend on which worker finished first
+	lodIndices.clear();
+	for (size_t i = 0; i < meshRanges.size(); ++i)
+	{
+		for (uint32_t l = 0; l < meshRanges[i].lodCount; ++l)
+			meshRanges[i].lods[l].firstIndex += lodIndices.size();
+
+		lodIndices.insert(lodIndices.end(), meshLodIndices[i].begin(), meshLodIndices[i].end());
+	}
+
+	auto lodMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - lodStart).count();
+	std::cout << "built lods of " << fileName << ": " << lodIndices.size() << " indices over " << totalIndices
+		<< " full ones in " << lodMs << " ms" << std::endl;
+}
+
+const std::vector<Meshlet>& MeshImporter::GetMeshlets()
+{
+	return meshlets;
+}
+
+const std::vector<uint32_t>& MeshImporter::GetMeshletVertices()
+{
+	return meshletVertices;
+}
+
+const std::vector<uint32_t>& MeshImporter::GetMeshletTriangles()
+{
+	return meshletTriangles;
+}
+
+const std::vector<uint32_t>& MeshImporter::GetLodIndices()
+{
+	return lodIndices;
+}
+
+MeshImporter::~MeshImporter()
+{
+}
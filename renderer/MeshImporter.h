@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "Utils.h"
+#include "ThreadPool.h"
+
+//assimp import split in two: Open sizes everything from the scene, Convert fills caller owned memory
+class MeshImporter
+{
+public:
+	MeshImporter();
+
+	void Open(const std::string& fileName);
+
+	const std::vector<std::string>& GetTexNames();
+	//offsets and counts after Open, bounds only after Convert
+	const std::vector<MeshRange>& GetMeshRanges();
+	uint64_t GetTotalVertices();
+	uint64_t GetTotalIndices();
+
+	//every mesh converted in parallel straight to its prefix sum offset and cut into meshlets
+	void Convert(ThreadPool* threadPool, Vertex* verts, uint32_t* indices);
+	//every mesh's meshlets back to back, the ranges' firstMeshlet index into it
+	const std::vector<Meshlet>& GetMeshlets();
+	//the ranges' firstMeshletVertex index into the vertices, the triangles run parallel to the full index list
+	const std::vector<uint32_t>& GetMeshletVertices();
+	const std::vector<uint32_t>& GetMeshletTriangles();
+	//after Convert: simplified levels of every mesh in parallel, read back from what Convert wrote
+	void BuildLods(ThreadPool* threadPool, const Vertex* verts, const uint32_t* indices);
+	//every mesh's levels back to back, the ranges' lods index into it
+	const std::vector<uint32_t>& GetLodIndices();
+
+	~MeshImporter();
+
+private:
+	std::string fileName;
+	Assimp::Importer importer;
+	const aiScene* scene = nullptr;
+
+	std::vector<aiMesh*> sceneMeshes;
+	std::vector<std::string> texNames;
+	std::vector<MeshRange> meshRanges;
+	uint64_t totalVertices = 0;
+	uint64_t totalIndices = 0;
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> meshletTriangles;
+	std::vector<uint32_t> lodIndices;
+
+	double importMs = 0.0;
+};
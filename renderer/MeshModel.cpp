@@ -1,6 +1,10 @@
 #include "MeshModel.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <unordered_map>
 #include <utility>
 
 MeshModel::MeshModel()
@@ -36,10 +40,50 @@ void MeshModel::SetModel(glm::mat4 newModel)
 	model = newModel;
 }
 
+uint64_t MeshModel::GetUploadValue()
+{
+	return uploadValue;
+}
+
+void MeshModel::SetUploadValue(uint64_t newUploadValue)
+{
+	uploadValue = newUploadValue;
+}
+
+std::string MeshModel::GetSourceName()
+{
+	return sourceName;
+}
+
+void MeshModel::SetSourceName(std::string newSourceName)
+{
+	sourceName = newSourceName;
+}
+
+std::shared_ptr<const std::vector<Occluder>> MeshModel::GetOccluders()
+{
+	return occluders;
+}
+
+void MeshModel::SetOccluders(std::shared_ptr<const std::vector<Occluder>> newOccluders)
+{
+	occluders = std::move(newOccluders);
+}
+
 void MeshModel::DestroyMeshModel()
 {
 	for (auto& m : meshList)
 		m.DestroyBuffers();
+
+	//the model slot stays as an empty tombstone so other ids don't shift
+	meshList.clear();
+	occluders.reset();
+}
+
+void MeshModel::DetachMeshes()
+{
+	meshList.clear();
+	occluders.reset();
 }
 
 std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene)
@@ -76,37 +120,39 @@ std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene)
 	return texList;
 }
 
-std::vector<Mesh> MeshModel::LoadNode(VkPhysicalDevice physDevice, VkDevice logicDevice, VkQueue transferQueue,
-	VkCommandPool transferPool, aiNode* node, const aiScene* scene, std::vector<size_t> matToTex)
+void MeshModel::LoadNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>* meshes)
 {
-	std::vector<Mesh> meshList;
-
 	for (size_t i = 0; i < node->mNumMeshes; ++i)
-	{
-		meshList.push_back(LoadMesh(physDevice, logicDevice, transferQueue, transferPool,
-			scene->mMeshes[node->mMeshes[i]], scene, matToTex));
-	}
+		meshes->push_back(scene->mMeshes[node->mMeshes[i]]);
 
 	for (size_t i = 0; i < node->mNumChildren; ++i)
-	{
-		auto subMeshList = LoadNode(physDevice, logicDevice, transferQueue, transferPool, node->mChildren[i], scene, matToTex);
-		meshList.insert(meshList.end(), subMeshList.begin(), subMeshList.end());
-	}
-
-	return meshList;
+		LoadNode(node->mChildren[i], scene, meshes);
 }
 
-Mesh MeshModel::LoadMesh(VkPhysicalDevice physDevice, VkDevice logicDevice, VkQueue transferQueue,
-	VkCommandPool transferPool, aiMesh* mesh, const aiScene* scene, std::vector<size_t> matToTex)
+uint32_t MeshModel::CountIndices(const aiMesh* mesh)
 {
-	std::vector<Vertex> verts;
-	std::vector<uint32_t> indices;
+	//triangulated meshes are the common case, only mixed primitive meshes need the face walk
+	if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+		return mesh->mNumFaces * 3;
 
-	verts.resize(mesh->mNumVertices);
+	uint32_t count = 0;
+	for (size_t i = 0; i < mesh->mNumFaces; ++i)
+		count += mesh->mFaces[i].mNumIndices;
+
+	return count;
+}
+
+void MeshModel::LoadMesh(const aiMesh* mesh, Vertex* verts, uint32_t* indices, MeshRange* range)
+{
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
 
 	for (size_t i = 0; i < mesh->mNumVertices; ++i)
 	{
 		verts[i].pos = { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z };
+		boundsMin = glm::min(boundsMin, verts[i].pos);
+		boundsMax = glm::max(boundsMax, verts[i].pos);
+
 		if (mesh->mTextureCoords[0])
 			verts[i].uv = { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y };
 		else
@@ -116,14 +162,296 @@ Mesh MeshModel::LoadMesh(VkPhysicalDevice physDevice, VkDevice logicDevice, VkQu
 
 	for (size_t i = 0; i < mesh->mNumFaces; ++i)
 	{
-		auto face = mesh->mFaces[i];
+		const auto& face = mesh->mFaces[i];
 		for (size_t j = 0; j < face.mNumIndices; ++j)
-			indices.push_back(face.mIndices[j]);
+			*indices++ = face.mIndices[j];
+	}
+
+	if (mesh->mNumVertices == 0)
+		boundsMin = boundsMax = glm::vec3(0.0f);
+
+	//centered on the box, radius from the farthest vertex, tighter than the box's half diagonal
+	auto center = (boundsMin + boundsMax) * 0.5f;
+	float radiusSq = 0.0f;
+	for (size_t i = 0; i < mesh->mNumVertices; ++i)
+	{
+		auto d = verts[i].pos - center;
+		radiusSq = std::max(radiusSq, glm::dot(d, d));
+	}
+
+	range->boundsMin = boundsMin;
+	range->boundsMax = boundsMax;
+	range->sphere = glm::vec4(center, std::sqrt(radiusSq));
+}
+
+void MeshModel::BuildOccluder(const Vertex* verts, const uint32_t* indices, const MeshRange& range, uint32_t gridCells,
+	Occluder* occluder)
+{
+	occluder->positions.clear();
+	occluder->indices.clear();
+
+	auto cellSize = glm::max((range.boundsMax - range.boundsMin) / static_cast<float>(gridCells), glm::vec3(1e-6f));
+
+	//the first vertex landing in a cell stands in for all of them
+	std::unordered_map<uint32_t, uint32_t> cellToVertex;
+	std::vector<uint32_t> remap(range.vertexCount);
+
+	for (uint32_t v = 0; v < range.vertexCount; ++v)
+	{
+		const auto& pos = verts[range.firstVertex + v].pos;
+		auto cell = glm::min(glm::max((pos - range.boundsMin) / cellSize, glm::vec3(0.0f)), glm::vec3(gridCells - 1.0f));
+		auto key = static_cast<uint32_t>(cell.x) + (static_cast<uint32_t>(cell.y) + static_cast<uint32_t>(cell.z) * gridCells) * gridCells;
+
+		auto found = cellToVertex.emplace(key, static_cast<uint32_t>(occluder->positions.size()));
+		if (found.second)
+			occluder->positions.push_back(pos);
+
+		remap[v] = found.first->second;
+	}
+
+	for (uint32_t i = 0; i + 2 < range.indexCount; i += 3)
+	{
+		auto i0 = remap[indices[range.firstIndex + i]];
+		auto i1 = remap[indices[range.firstIndex + i + 1]];
+		auto i2 = remap[indices[range.firstIndex + i + 2]];
+
+		if (i0 == i1 || i1 == i2 || i0 == i2)
+			continue;
+
+		occluder->indices.push_back(i0);
+		occluder->indices.push_back(i1);
+		occluder->indices.push_back(i2);
+	}
+}
+
+void MeshModel::BuildLods(const Vertex* verts, const uint32_t* indices, MeshRange* range, std::vector<uint32_t>* lodIndices)
+{
+	range->lodCount = 0;
+	if (range->indexCount < LOD_MIN_TRIANGLES * 3)
+		return;
+
+	auto lodStart = lodIndices->size();
+
+	//every level continues from the previous one, so they nest and the whole chain costs about one full simplification
+	MeshSimplifier simplifier;
+	simplifier.Init(verts + range->firstVertex, range->vertexCount, indices + range->firstIndex, range->indexCount);
+
+	size_t previousCount = range->indexCount;
+	for (uint32_t l = 0; l < MAX_MESH_LODS - 1; ++l)
+	{
+		auto target = static_cast<size_t>(previousCount * LOD_REDUCTION) / 3 * 3;
+		auto count = simplifier.Simplify(target, range->sphere.w * LOD_MAX_ERROR);
+
+		//stuck on the error limit or locked borders, another level would draw about the same
+		if (count == 0 || count > previousCount - previousCount / 8)
+			break;
+
+		auto& lod = range->lods[range->lodCount++];
+		lod.firstIndex = lodIndices->size() - lodStart;
+		lod.indexCount = static_cast<uint32_t>(count);
+		lod.error = simplifier.GetError();
+
+		const auto& simplified = simplifier.GetIndices();
+		lodIndices->insert(lodIndices->end(), simplified.begin(), simplified.end());
+		previousCount = count;
 	}
+}
+
+void MeshModel::BuildMeshlets(const Vertex* verts, uint32_t* indices, const MeshRange& range, std::vector<Meshlet>* meshlets,
+	std::vector<uint32_t>* meshletVertices, uint32_t* meshletTriangles)
+{
+	meshlets->clear();
+	meshletVertices->clear();
 
-	auto newMesh = Mesh(physDevice, logicDevice, transferQueue, transferPool, &verts, &indices, matToTex[mesh->mMaterialIndex]);
+	auto meshVerts = verts + range.firstVertex;
+	auto meshIndices = indices + range.firstIndex;
+	uint32_t triangleCount = range.indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	//vertex to triangle adjacency
+	std::vector<uint32_t> triangleOffsets(range.vertexCount + 1, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+		++triangleOffsets[meshIndices[i] + 1];
+	for (size_t i = 1; i < triangleOffsets.size(); ++i)
+		triangleOffsets[i] += triangleOffsets[i - 1];
+
+	std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+	auto fill = triangleOffsets;
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+		vertexTriangles[fill[meshIndices[i]]++] = i / 3;
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> vertexMeshlet(range.vertexCount, UINT32_MAX); //last meshlet that took the vertex
+	std::vector<uint32_t> order; //triangles in meshlet order
+	order.reserve(triangleCount);
+
+	std::vector<uint32_t> candidates;
+	uint32_t nextSeed = 0;
+
+	while (order.size() < triangleCount)
+	{
+		auto meshletIdx = static_cast<uint32_t>(meshlets->size());
+		auto firstTriangle = static_cast<uint32_t>(order.size());
+		uint32_t vertexCount = 0;
+		candidates.clear();
+
+		auto newVertices = [&](uint32_t t)
+		{
+			uint32_t count = 0;
+			for (int k = 0; k < 3; ++k)
+				count += vertexMeshlet[meshIndices[t * 3 + k]] != meshletIdx;
+			return count;
+		};
 
-	return newMesh;
+		while (order.size() - firstTriangle < MESHLET_MAX_TRIANGLES)
+		{
+			//the neighbour adding the fewest vertices keeps the meshlet compact, the next unused triangle when there is none
+			uint32_t best = UINT32_MAX;
+			uint32_t bestNew = 4;
+			size_t kept = 0;
+			for (auto t : candidates)
+			{
+				if (emitted[t])
+					continue;
+
+				candidates[kept++] = t;
+				auto n = newVertices(t);
+				if (n < bestNew)
+				{
+					best = t;
+					bestNew = n;
+				}
+			}
+			candidates.resize(kept);
+
+			if (best == UINT32_MAX)
+			{
+				while (nextSeed < triangleCount && emitted[nextSeed])
+					++nextSeed;
+				if (nextSeed == triangleCount)
+					break;
+
+				best = nextSeed;
+				bestNew = newVertices(best);
+			}
+
+			if (vertexCount + bestNew > MESHLET_MAX_VERTICES)
+				break;
+
+			emitted[best] = 1;
+			order.push_back(best);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				auto v = meshIndices[best * 3 + k];
+				if (vertexMeshlet[v] == meshletIdx)
+					continue;
+
+				vertexMeshlet[v] = meshletIdx;
+				++vertexCount;
+				for (auto i = triangleOffsets[v]; i < triangleOffsets[v + 1]; ++i)
+				{
+					if (!emitted[vertexTriangles[i]])
+						candidates.push_back(vertexTriangles[i]);
+				}
+			}
+		}
+
+		Meshlet meshlet = {};
+		meshlet.firstIndex = firstTriangle * 3;
+		meshlet.indexCount = static_cast<uint32_t>(order.size() - firstTriangle) * 3;
+		meshlets->push_back(meshlet);
+	}
+
+	//written back in meshlet order, the bounds and cones are taken from the reordered list
+	std::vector<uint32_t> reordered(triangleCount * 3);
+	for (uint32_t i = 0; i < triangleCount; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+			reordered[i * 3 + k] = meshIndices[order[i] * 3 + k];
+	}
+	std::copy(reordered.begin(), reordered.end(), meshIndices);
+
+	//what a mesh shader emits: each meshlet's vertices once, its triangles as three byte indices into them
+	auto meshTriangles = meshletTriangles + range.firstIndex / 3;
+	std::fill(vertexMeshlet.begin(), vertexMeshlet.end(), UINT32_MAX);
+	std::vector<uint8_t> localIds(range.vertexCount);
+
+	for (uint32_t mi = 0; mi < meshlets->size(); ++mi)
+	{
+		auto& m = (*meshlets)[mi];
+		m.vertexOffset = static_cast<uint32_t>(meshletVertices->size());
+
+		for (uint32_t i = m.firstIndex; i < m.firstIndex + m.indexCount; i += 3)
+		{
+			uint32_t packed = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				auto v = meshIndices[i + k];
+				if (vertexMeshlet[v] != mi)
+				{
+					vertexMeshlet[v] = mi;
+					localIds[v] = static_cast<uint8_t>(meshletVertices->size() - m.vertexOffset);
+					meshletVertices->push_back(v);
+				}
+				packed |= static_cast<uint32_t>(localIds[v]) << (8 * k);
+			}
+			meshTriangles[i / 3] = packed;
+		}
+
+		m.vertexCount = static_cast<uint32_t>(meshletVertices->size()) - m.vertexOffset;
+	}
+
+	for (auto& m : *meshlets)
+	{
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+		glm::vec3 normalSum(0.0f);
+
+		for (uint32_t i = m.firstIndex; i < m.firstIndex + m.indexCount; i += 3)
+		{
+			auto p0 = meshVerts[meshIndices[i]].pos;
+			auto p1 = meshVerts[meshIndices[i + 1]].pos;
+			auto p2 = meshVerts[meshIndices[i + 2]].pos;
+			boundsMin = glm::min(glm::min(glm::min(boundsMin, p0), p1), p2);
+			boundsMax = glm::max(glm::max(glm::max(boundsMax, p0), p1), p2);
+
+			auto normal = glm::cross(p1 - p0, p2 - p0);
+			auto length = glm::length(normal);
+			if (length > 0.0f)
+				normalSum += normal / length;
+		}
+
+		auto center = (boundsMin + boundsMax) * 0.5f;
+		float radiusSq = 0.0f;
+		for (uint32_t i = m.firstIndex; i < m.firstIndex + m.indexCount; ++i)
+		{
+			auto d = meshVerts[meshIndices[i]].pos - center;
+			radiusSq = std::max(radiusSq, glm::dot(d, d));
+		}
+		m.sphere = glm::vec4(center, std::sqrt(radiusSq));
+
+		//a cutoff above 1 never culls, used when the normals spread over a hemisphere or more
+		m.cone = glm::vec4(0.0f, 0.0f, 1.0f, 2.0f);
+		auto axisLength = glm::length(normalSum);
+		if (axisLength <= 0.0f)
+			continue;
+
+		auto axis = normalSum / axisLength;
+		float minDot = 1.0f;
+		for (uint32_t i = m.firstIndex; i < m.firstIndex + m.indexCount; i += 3)
+		{
+			auto p0 = meshVerts[meshIndices[i]].pos;
+			auto normal = glm::cross(meshVerts[meshIndices[i + 1]].pos - p0, meshVerts[meshIndices[i + 2]].pos - p0);
+			auto length = glm::length(normal);
+			if (length > 0.0f)
+				minDot = std::min(minDot, glm::dot(normal / length, axis));
+		}
+
+		if (minDot > 0.0f)
+			m.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+	}
 }
 
 MeshModel::~MeshModel()
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include "Mesh.h"
+#include "OcclusionBuffer.h"
+#include "MeshSimplifier.h"
 
 class MeshModel
 {
@@ -17,17 +20,44 @@ public:
 	glm::mat4 GetModel();
 	void SetModel(glm::mat4 newModel);
 
+	//upload timeline value after which the model's buffers and textures are usable
+	uint64_t GetUploadValue();
+	void SetUploadValue(uint64_t newUploadValue);
+
+	//file the meshes were loaded from, models placed from the same file share them
+	std::string GetSourceName();
+	void SetSourceName(std::string newSourceName);
+
+	//one per mesh, empty for meshes too small to hide anything, shared like the meshes
+	std::shared_ptr<const std::vector<Occluder>> GetOccluders();
+	void SetOccluders(std::shared_ptr<const std::vector<Occluder>> newOccluders);
+
 	void DestroyMeshModel();
+	//empties the model without freeing meshes still shared with other models
+	void DetachMeshes();
 
 	static std::vector<std::string> LoadMaterials(const aiScene* scene);
-	static std::vector<Mesh> LoadNode(VkPhysicalDevice physDevice, VkDevice logicDevice, VkQueue transferQueue,
-		VkCommandPool transferPool, aiNode* node, const aiScene* scene, std::vector<size_t> matToTex);
-	static Mesh LoadMesh(VkPhysicalDevice physDevice, VkDevice logicDevice, VkQueue transferQueue,
-	                     VkCommandPool transferPool, aiMesh* mesh, const aiScene* scene, std::vector<size_t> matToTex);
+	static void LoadNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>* meshes);
+	static uint32_t CountIndices(const aiMesh* mesh);
+	//writes mNumVertices verts and CountIndices indices, no allocation, and the bounds into range
+	static void LoadMesh(const aiMesh* mesh, Vertex* verts, uint32_t* indices, MeshRange* range);
+	//clusters the range's vertices on a gridCells^3 grid over its bounds, triangles collapsing inside a cell are dropped
+	static void BuildOccluder(const Vertex* verts, const uint32_t* indices, const MeshRange& range, uint32_t gridCells,
+		Occluder* occluder);
+	//simplifies the range into up to MAX_MESH_LODS - 1 coarser index lists appended to lodIndices,
+	//fills range's lods with offsets relative to where lodIndices started
+	static void BuildLods(const Vertex* verts, const uint32_t* indices, MeshRange* range, std::vector<uint32_t>* lodIndices);
+	//reorders the range's indices so each meshlet is a contiguous run, grown greedily over shared vertices
+	//meshletVertices get the meshlets' mesh local vertices, meshletTriangles (one per triangle of the model) the range's packed triangles
+	static void BuildMeshlets(const Vertex* verts, uint32_t* indices, const MeshRange& range, std::vector<Meshlet>* meshlets,
+		std::vector<uint32_t>* meshletVertices, uint32_t* meshletTriangles);
 
 	~MeshModel();
 
 private:
 	std::vector<Mesh> meshList;
 	glm::mat4 model;
+	uint64_t uploadValue = 0;
+	std::string sourceName;
+	std::shared_ptr<const std::vector<Occluder>> occluders;
 };
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+MeshSimplifier::MeshSimplifier()
+{
+}
+
+void MeshSimplifier::Init(const Vertex* verts, uint32_t vertexCount, const uint32_t* newIndices, uint32_t indexCount)
+{
+	positions.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+		positions[i] = verts[i].pos;
+
+	indices.assign(newIndices, newIndices + indexCount);
+	quadrics.assign(vertexCount, Quadric{});
+	locked.assign(vertexCount, 0);
+	error = 0.0f;
+
+	//an edge not shared by exactly two triangles is a border, a uv seam (split vertices) or non manifold
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		for (int e = 0; e < 3; ++e)
+		{
+			auto a = indices[t + e];
+			auto b = indices[t + (e + 1) % 3];
+			auto key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+			++edgeUses[key];
+		}
+	}
+
+	for (const auto& edge : edgeUses)
+	{
+		if (edge.second != 2)
+		{
+			locked[edge.first >> 32] = 1;
+			locked[edge.first & 0xFFFFFFFF] = 1;
+		}
+	}
+
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		auto p0 = positions[indices[t]];
+		auto normal = glm::cross(positions[indices[t + 1]] - p0, positions[indices[t + 2]] - p0);
+		auto doubleArea = glm::length(normal);
+		if (doubleArea == 0.0f)
+			continue;
+
+		normal = normal / doubleArea;
+		double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, p0);
+		double w = doubleArea * 0.5;
+
+		Quadric plane = { w * a * a, w * a * b, w * a * c, w * a * d, w * b * b, w * b * c, w * b * d,
+			w * c * c, w * c * d, w * d * d, w };
+
+		for (int k = 0; k < 3; ++k)
+			AddQuadric(&quadrics[indices[t + k]], plane);
+	}
+}
+
+size_t MeshSimplifier::Simplify(size_t targetIndexCount, float maxError)
+{
+	std::vector<Collapse> collapses;
+	std::vector<uint8_t> touched;
+	std::vector<uint32_t> remap;
+
+	while (indices.size() > targetIndexCount)
+	{
+		BuildAdjacency();
+
+		//both directions of every edge, a locked vertex can still be collapsed onto
+		collapses.clear();
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				uint32_t ends[2] = { indices[t + e], indices[t + (e + 1) % 3] };
+				for (int k = 0; k < 2; ++k)
+				{
+					auto from = ends[k];
+					auto to = ends[1 - k];
+					if (locked[from])
+						continue;
+
+					auto q = quadrics[from];
+					AddQuadric(&q, quadrics[to]);
+					collapses.push_back({ from, to, EvaluateError(q, positions[to]) });
+				}
+			}
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		//cheapest first, a vertex whose triangles changed this pass waits for the next adjacency rebuild
+		touched.assign(positions.size(), 0);
+		remap.resize(positions.size());
+		for (size_t i = 0; i < remap.size(); ++i)
+			remap[i] = static_cast<uint32_t>(i);
+
+		size_t triangleCount = indices.size() / 3;
+		size_t targetTriangles = targetIndexCount / 3;
+		bool collapsed = false;
+
+		for (const auto& c : collapses)
+		{
+			if (triangleCount <= targetTriangles || c.error > maxError)
+				break;
+
+			if (touched[c.from] || touched[c.to])
+				continue;
+
+			size_t removed = 0;
+			if (FlipsTriangles(c.from, c.to, &removed))
+				continue;
+
+			remap[c.from] = c.to;
+			AddQuadric(&quadrics[c.to], quadrics[c.from]);
+
+			for (auto i = triangleOffsets[c.from]; i < triangleOffsets[c.from + 1]; ++i)
+			{
+				auto t = vertexTriangles[i];
+				touched[indices[t * 3]] = touched[indices[t * 3 + 1]] = touched[indices[t * 3 + 2]] = 1;
+			}
+
+			triangleCount -= removed;
+			error = std::max(error, c.error);
+			collapsed = true;
+		}
+
+		if (!collapsed)
+			break;
+
+		//triangles that lost an edge are dropped, the rest keep their winding
+		size_t kept = 0;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			auto a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+
+			indices[kept++] = a;
+			indices[kept++] = b;
+			indices[kept++] = c;
+		}
+		indices.resize(kept);
+	}
+
+	return indices.size();
+}
+
+const std::vector<uint32_t>& MeshSimplifier::GetIndices()
+{
+	return indices;
+}
+
+float MeshSimplifier::GetError()
+{
+	return error;
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+}
+
+void MeshSimplifier::BuildAdjacency()
+{
+	triangleOffsets.assign(positions.size() + 1, 0);
+	for (auto idx : indices)
+		++triangleOffsets[idx + 1];
+
+	for (size_t i = 1; i < triangleOffsets.size(); ++i)
+		triangleOffsets[i] += triangleOffsets[i - 1];
+
+	vertexTriangles.resize(indices.size());
+	auto fill = triangleOffsets;
+	for (size_t i = 0; i < indices.size(); ++i)
+		vertexTriangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+}
+
+bool MeshSimplifier::FlipsTriangles(uint32_t from, uint32_t to, size_t* removedTriangles)
+{
+	*removedTriangles = 0;
+
+	for (auto i = triangleOffsets[from]; i < triangleOffsets[from + 1]; ++i)
+	{
+		auto t = vertexTriangles[i];
+		uint32_t corners[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+
+		//the triangles on the collapsed edge disappear
+		if (corners[0] == to || corners[1] == to || corners[2] == to)
+		{
+			++*removedTriangles;
+			continue;
+		}
+
+		glm::vec3 before[3], after[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			before[k] = positions[corners[k]];
+			after[k] = corners[k] == from ? positions[to] : before[k];
+		}
+
+		auto oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+		auto newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(oldNormal, newNormal) <= 0.0f)
+			return true;
+	}
+
+	return false;
+}
+
+void MeshSimplifier::AddQuadric(Quadric* q, const Quadric& other)
+{
+	q->a00 += other.a00;
+	q->a01 += other.a01;
+	q->a02 += other.a02;
+	q->a03 += other.a03;
+	q->a11 += other.a11;
+	q->a12 += other.a12;
+	q->a13 += other.a13;
+	q->a22 += other.a22;
+	q->a23 += other.a23;
+	q->a33 += other.a33;
+	q->weight += other.weight;
+}
+
+float MeshSimplifier::EvaluateError(const Quadric& q, const glm::vec3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double sum = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x +
+		q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y +
+		q.a22 * z * z + 2.0 * q.a23 * z + q.a33;
+
+	//area weighted mean of the squared plane distances, as a distance
+	if (q.weight <= 0.0)
+		return 0.0f;
+
+	return static_cast<float>(std::sqrt(std::max(sum / q.weight, 0.0)));
+}
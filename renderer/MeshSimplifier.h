@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Utils.h"
+
+//quadric error edge collapse of one mesh, every vertex collapses onto a neighbour that already exists
+//so each level indexes the full mesh's vertices and needs no vertex data of its own
+class MeshSimplifier
+{
+public:
+	MeshSimplifier();
+
+	//indices relative to verts, vertices on open edges (borders and uv seams) never move
+	void Init(const Vertex* verts, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+
+	//continues from the last call until at most targetIndexCount indices are left or the
+	//next collapse would stray further than maxError, returns how many indices are left
+	size_t Simplify(size_t targetIndexCount, float maxError);
+
+	const std::vector<uint32_t>& GetIndices();
+	//object space distance the result strays from the full mesh
+	float GetError();
+
+	~MeshSimplifier();
+
+private:
+	//symmetric 4x4 of the summed planes, area weighted, in doubles so big flat meshes don't lose precision
+	struct Quadric
+	{
+		double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+		double weight;
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float error;
+	};
+
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	std::vector<Quadric> quadrics;
+	std::vector<uint8_t> locked;
+	float error = 0.0f;
+
+	//vertex to triangle adjacency of the current indices
+	std::vector<uint32_t> triangleOffsets;
+	std::vector<uint32_t> vertexTriangles;
+
+	void BuildAdjacency();
+	bool FlipsTriangles(uint32_t from, uint32_t to, size_t* removedTriangles);
+
+	static void AddQuadric(Quadric* q, const Quadric& other);
+	static float EvaluateError(const Quadric& q, const glm::vec3& p);
+};
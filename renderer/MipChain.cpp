@@ -0,0 +1,105 @@
+#include "MipChain.h"
+
+#include <algorithm>
+#include <emmintrin.h>
+
+//rounded mean of the source texels [x0, x1] x [y0, y1], inclusive
+static void BoxTexel(const uint8_t* src, uint32_t wid, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, uint8_t* dst)
+{
+	uint32_t sum[4] = {};
+	for (auto y = y0; y <= y1; ++y)
+	{
+		for (auto x = x0; x <= x1; ++x)
+		{
+			auto texel = src + (static_cast<size_t>(y) * wid + x) * 4;
+			for (int c = 0; c < 4; ++c)
+				sum[c] += texel[c];
+		}
+	}
+
+	uint32_t count = (x1 - x0 + 1) * (y1 - y0 + 1);
+	for (int c = 0; c < 4; ++c)
+		dst[c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+}
+
+uint32_t MipChain::CountLevels(uint32_t wid, uint32_t hei)
+{
+	uint32_t levels = 1;
+	for (auto size = std::max(wid, hei); size > 1; size /= 2)
+		++levels;
+
+	return levels;
+}
+
+size_t MipChain::GetSize(uint32_t wid, uint32_t hei, uint32_t levelCount)
+{
+	size_t size = 0;
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		size += static_cast<size_t>(wid) * hei * 4;
+		wid = std::max(wid / 2, 1u);
+		hei = std::max(hei / 2, 1u);
+	}
+
+	return size;
+}
+
+void MipChain::Build(uint8_t* levels, uint32_t wid, uint32_t hei, uint32_t levelCount)
+{
+	auto src = levels;
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		auto dst = src + static_cast<size_t>(wid) * hei * 4;
+		Downsample(src, wid, hei, dst);
+
+		src = dst;
+		wid = std::max(wid / 2, 1u);
+		hei = std::max(hei / 2, 1u);
+	}
+}
+
+void MipChain::Downsample(const uint8_t* src, uint32_t wid, uint32_t hei, uint8_t* dst)
+{
+	auto dstWid = std::max(wid / 2, 1u);
+	auto dstHei = std::max(hei / 2, 1u);
+
+	//with an odd width the last column averages three, the sse loop only takes plain 2x2 boxes
+	auto plainCols = (wid & 1) ? dstWid - 1 : dstWid;
+	auto zero = _mm_setzero_si128();
+	auto round = _mm_set1_epi16(2);
+
+	for (uint32_t y = 0; y < dstHei; ++y)
+	{
+		auto y0 = std::min(2 * y, hei - 1);
+		auto y1 = y + 1 == dstHei ? hei - 1 : 2 * y + 1;
+		auto dstRow = dst + static_cast<size_t>(y) * dstWid * 4;
+		uint32_t x = 0;
+
+		if (y1 == y0 + 1)
+		{
+			auto row0 = src + static_cast<size_t>(y0) * wid * 4;
+			auto row1 = row0 + static_cast<size_t>(wid) * 4;
+
+			//4 source texels of both rows in, 2 texels out
+			for (; x + 2 <= plainCols; x += 2)
+			{
+				auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+				auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+				auto lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				auto hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				auto sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+
+				auto mean = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dstRow + x * 4), _mm_packus_epi16(mean, zero));
+			}
+		}
+
+		for (; x < dstWid; ++x)
+		{
+			auto x0 = std::min(2 * x, wid - 1);
+			auto x1 = x + 1 == dstWid ? wid - 1 : 2 * x + 1;
+			BoxTexel(src, wid, x0, x1, y0, y1, dstRow + x * 4);
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+//rgba8 mip chains built on the cpu, for devices without linear blits and for the texture cooker
+//levels are packed one after the other, level 0 first, each half the size of the last rounded down (at least 1)
+class MipChain
+{
+public:
+	//levels down to 1x1
+	static uint32_t CountLevels(uint32_t wid, uint32_t hei);
+	//bytes of the first levelCount levels
+	static size_t GetSize(uint32_t wid, uint32_t hei, uint32_t levelCount);
+
+	//level 0 has to be in place already, every further level is box filtered from the one before it
+	static void Build(uint8_t* levels, uint32_t wid, uint32_t hei, uint32_t levelCount);
+
+	//2x2 box filter into a (wid / 2) x (hei / 2) image, an odd last row or column is folded into its neighbours
+	static void Downsample(const uint8_t* src, uint32_t wid, uint32_t hei, uint8_t* dst);
+};
@@ -0,0 +1,267 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+//rows per rasterizer task, bands never share pixels so workers write without locks
+static const int BAND_ROWS = 8;
+//clip space w below this is treated as behind the camera
+static const float MIN_CLIP_W = 1e-5f;
+
+OcclusionBuffer::OcclusionBuffer()
+{
+}
+
+void OcclusionBuffer::Init(uint32_t newWidth, uint32_t newHeight)
+{
+	width = (newWidth + 3) & ~3u;
+	height = newHeight;
+	depth.assign(static_cast<size_t>(width) * height, 1.0f);
+}
+
+void OcclusionBuffer::Clear()
+{
+	occluders.clear();
+}
+
+void OcclusionBuffer::AddOccluder(const Occluder* occluder, const glm::mat4& model)
+{
+	if (!occluder->indices.empty())
+		occluders.push_back({ occluder, model });
+}
+
+void OcclusionBuffer::Rasterize(ThreadPool* threadPool, const glm::mat4& newViewProj)
+{
+	viewProj = newViewProj;
+	triangles.resize(occluders.size());
+
+	//vertices to pixels plus depth, w = 0 marks one behind the camera
+	threadPool->ParallelFor(occluders.size(), [&](size_t i)
+	{
+		const auto& inst = occluders[i];
+		auto mvp = viewProj * inst.model;
+
+		std::vector<glm::vec4> screen(inst.occluder->positions.size());
+		for (size_t v = 0; v < screen.size(); ++v)
+		{
+			auto clip = mvp * glm::vec4(inst.occluder->positions[v], 1.0f);
+			if (clip.w < MIN_CLIP_W)
+			{
+				screen[v] = glm::vec4(0.0f);
+				continue;
+			}
+
+			screen[v] = glm::vec4((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height,
+				clip.z / clip.w, 1.0f);
+		}
+
+		auto& tris = triangles[i];
+		tris.clear();
+
+		const auto& indices = inst.occluder->indices;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			Triangle tri;
+			if (SetupTriangle(screen[indices[t]], screen[indices[t + 1]], screen[indices[t + 2]], &tri))
+				tris.push_back(tri);
+		}
+	});
+
+	triangleCount = 0;
+	for (size_t i = 0; i < occluders.size(); ++i)
+		triangleCount += triangles[i].size();
+
+	auto bandCount = (height + BAND_ROWS - 1) / BAND_ROWS;
+	threadPool->ParallelFor(bandCount, [&](size_t band)
+	{
+		RasterizeBand(static_cast<int>(band) * BAND_ROWS, std::min(static_cast<int>(band + 1) * BAND_ROWS, static_cast<int>(height)));
+	});
+}
+
+bool OcclusionBuffer::IsOccluded(const glm::vec3& center, float radius) const
+{
+	float minX = static_cast<float>(width), minY = static_cast<float>(height);
+	float maxX = 0.0f, maxY = 0.0f;
+	float nearestDepth = 1.0f;
+
+	for (int c = 0; c < 8; ++c)
+	{
+		glm::vec3 corner = center + radius * glm::vec3((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f);
+		auto clip = viewProj * glm::vec4(corner, 1.0f);
+
+		//reaches behind the camera, no meaningful rect
+		if (clip.w < MIN_CLIP_W)
+			return false;
+
+		auto x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+		auto y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearestDepth = std::min(nearestDepth, clip.z / clip.w);
+	}
+
+	if (nearestDepth <= 0.0f || maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+		return false;
+
+	//widened to whole 4 pixel groups, more pixels to pass only makes the test stricter
+	int x0 = std::max(static_cast<int>(minX), 0) & ~3;
+	int x1 = std::min(static_cast<int>(maxX), static_cast<int>(width) - 1);
+	int y0 = std::max(static_cast<int>(minY), 0);
+	int y1 = std::min(static_cast<int>(maxY), static_cast<int>(height) - 1);
+
+	auto nearest = _mm_set1_ps(nearestDepth);
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float* row = depth.data() + static_cast<size_t>(y) * width;
+		for (int x = x0; x <= x1; x += 4)
+		{
+			//anything rasterized at or behind the sphere's nearest point leaves it visible
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+uint32_t OcclusionBuffer::GetWidth() const
+{
+	return width;
+}
+
+uint32_t OcclusionBuffer::GetHeight() const
+{
+	return height;
+}
+
+size_t OcclusionBuffer::GetTriangleCount() const
+{
+	return triangleCount;
+}
+
+const std::vector<float>& OcclusionBuffer::GetDepth() const
+{
+	return depth;
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+}
+
+bool OcclusionBuffer::SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, Triangle* tri) const
+{
+	//clipping isn't worth it at this resolution, triangles crossing the near plane just don't occlude
+	if (v0.w == 0.0f || v1.w == 0.0f || v2.w == 0.0f)
+		return false;
+
+	glm::vec2 p[3] = { glm::vec2(v0.x, v0.y), glm::vec2(v1.x, v1.y), glm::vec2(v2.x, v2.y) };
+
+	auto area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+	if (std::abs(area) < 1e-6f)
+		return false;
+
+	//both windings occlude, flip to a positive area
+	if (area < 0.0f)
+		std::swap(p[1], p[2]);
+
+	auto minX = std::min(std::min(p[0].x, p[1].x), p[2].x);
+	auto maxX = std::max(std::max(p[0].x, p[1].x), p[2].x);
+	auto minY = std::min(std::min(p[0].y, p[1].y), p[2].y);
+	auto maxY = std::max(std::max(p[0].y, p[1].y), p[2].y);
+
+	tri->minX = std::max(static_cast<int>(std::floor(minX)), 0);
+	tri->maxX = std::min(static_cast<int>(std::ceil(maxX)), static_cast<int>(width) - 1);
+	tri->minY = std::max(static_cast<int>(std::floor(minY)), 0);
+	tri->maxY = std::min(static_cast<int>(std::ceil(maxY)), static_cast<int>(height) - 1);
+
+	if (tri->minX > tri->maxX || tri->minY > tri->maxY)
+		return false;
+
+	for (int e = 0; e < 3; ++e)
+	{
+		//c from the same end whichever triangle owns the edge, a neighbour gets exactly the negated function
+		auto from = p[e];
+		auto to = p[(e + 1) % 3];
+		bool flipped = to.x < from.x || (to.x == from.x && to.y < from.y);
+		if (flipped)
+			std::swap(from, to);
+
+		auto a = from.y - to.y;
+		auto b = to.x - from.x;
+		auto c = -(a * from.x + b * from.y);
+		tri->a[e] = flipped ? -a : a;
+		tri->b[e] = flipped ? -b : b;
+		tri->c[e] = flipped ? -c : c;
+
+		//a pixel center right on a shared edge goes to exactly one of the two triangles
+		tri->inclusive[e] = tri->a[e] > 0.0f || (tri->a[e] == 0.0f && tri->b[e] < 0.0f);
+	}
+
+	//farthest vertex for the whole triangle, it can only hide less than the real surface
+	tri->depth = std::max(std::max(v0.z, v1.z), v2.z);
+	return tri->depth > 0.0f;
+}
+
+void OcclusionBuffer::RasterizeBand(int firstRow, int lastRow)
+{
+	for (int y = firstRow; y < lastRow; ++y)
+		std::fill(depth.begin() + static_cast<size_t>(y) * width, depth.begin() + static_cast<size_t>(y + 1) * width, 1.0f);
+
+	auto laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	auto zero = _mm_setzero_ps();
+
+	//add order, not thread timing, decides what a band sees, and min doesn't care about order anyway
+	for (const auto& tris : triangles)
+	{
+		for (const auto& tri : tris)
+		{
+			auto minY = std::max(tri.minY, firstRow);
+			auto maxY = std::min(tri.maxY, lastRow - 1);
+			if (minY > maxY)
+				continue;
+
+			auto triDepth = _mm_set1_ps(tri.depth);
+			__m128 a[3], b[3], c[3], inclusive[3];
+			for (int e = 0; e < 3; ++e)
+			{
+				a[e] = _mm_set1_ps(tri.a[e]);
+				b[e] = _mm_set1_ps(tri.b[e]);
+				c[e] = _mm_set1_ps(tri.c[e]);
+				inclusive[e] = _mm_castsi128_ps(_mm_set1_epi32(tri.inclusive[e] ? -1 : 0));
+			}
+
+			auto firstX = tri.minX & ~3;
+
+			for (int y = minY; y <= maxY; ++y)
+			{
+				auto py = _mm_set1_ps(y + 0.5f);
+				float* row = depth.data() + static_cast<size_t>(y) * width;
+
+				__m128 rowEdge[3];
+				for (int e = 0; e < 3; ++e)
+					rowEdge[e] = _mm_add_ps(_mm_mul_ps(b[e], py), c[e]);
+
+				//evaluated per group rather than stepped, so the value at a pixel doesn't depend on where the triangle starts
+				for (int x = firstX; x <= tri.maxX; x += 4)
+				{
+					auto px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+					auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+					for (int e = 0; e < 3; ++e)
+					{
+						auto edge = _mm_add_ps(_mm_mul_ps(a[e], px), rowEdge[e]);
+						inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(edge, zero), _mm_and_ps(_mm_cmpeq_ps(edge, zero), inclusive[e])));
+					}
+
+					auto old = _mm_loadu_ps(row + x);
+					auto nearer = _mm_min_ps(old, triDepth);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+//simplified stand-in for a mesh that only ever goes into the occlusion buffer, object space
+struct Occluder
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+
+//low resolution cpu depth buffer of the big occluders, bounds behind it are skipped before recording
+//no gpu involved and the result doesn't depend on thread timing, so it runs the same headless
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+
+	//width is rounded up to a multiple of 4 for the sse loops
+	void Init(uint32_t newWidth, uint32_t newHeight);
+
+	//forgets the occluders of the last frame, the pointers have to stay valid until Rasterize
+	void Clear();
+	void AddOccluder(const Occluder* occluder, const glm::mat4& model);
+
+	//transforms every occluder then rasterizes bands of rows on the workers, each triangle at its farthest depth
+	void Rasterize(ThreadPool* threadPool, const glm::mat4& newViewProj);
+
+	//true when the world space sphere is behind rasterized depth everywhere it covers on screen
+	bool IsOccluded(const glm::vec3& center, float radius) const;
+
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+	size_t GetTriangleCount() const;
+	//row major, 1 = nothing rasterized
+	const std::vector<float>& GetDepth() const;
+
+	~OcclusionBuffer();
+
+private:
+	struct OccluderInstance
+	{
+		const Occluder* occluder;
+		glm::mat4 model;
+	};
+
+	//edge functions a * x + b * y + c are > 0 inside, x and y in pixels, == 0 counts on its left and top edges
+	struct Triangle
+	{
+		float a[3];
+		float b[3];
+		float c[3];
+		bool inclusive[3];
+		float depth;
+		int minX, maxX, minY, maxY;
+	};
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<float> depth;
+	glm::mat4 viewProj = glm::mat4(1.0f);
+
+	std::vector<OccluderInstance> occluders;
+	std::vector<std::vector<Triangle>> triangles; //per occluder, kept in add order
+	size_t triangleCount = 0;
+
+	bool SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, Triangle* tri) const;
+	void RasterizeBand(int firstRow, int lastRow);
+};
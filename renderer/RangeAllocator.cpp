@@ -0,0 +1,132 @@
+#include "RangeAllocator.h"
+
+#include <stdexcept>
+
+RangeAllocator::RangeAllocator()
+{
+}
+
+RangeAllocator::RangeAllocator(uint64_t newCapacity) :
+	capacity(newCapacity),
+	freeBytes(newCapacity)
+{
+	if (capacity > 0)
+		freeRanges[0] = capacity;
+}
+
+bool RangeAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t* offset)
+{
+	if (size == 0)
+		throw std::runtime_error("zero sized range");
+
+	if (alignment == 0)
+		alignment = 1;
+
+	auto best = freeRanges.end();
+	uint64_t bestAligned = 0;
+
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		uint64_t aligned = (it->first + alignment - 1) / alignment * alignment;
+		uint64_t padding = aligned - it->first;
+
+		if (padding + size > it->second)
+			continue;
+
+		//smallest range that fits keeps the big ones intact
+		if (best == freeRanges.end() || it->second < best->second)
+		{
+			best = it;
+			bestAligned = aligned;
+
+			if (padding + size == it->second)
+				break;
+		}
+	}
+
+	if (best == freeRanges.end())
+		return false;
+
+	uint64_t rangeStart = best->first;
+	uint64_t rangeEnd = best->first + best->second;
+	freeRanges.erase(best);
+
+	//alignment padding stays free
+	if (bestAligned > rangeStart)
+		freeRanges[rangeStart] = bestAligned - rangeStart;
+
+	if (bestAligned + size < rangeEnd)
+		freeRanges[bestAligned + size] = rangeEnd - (bestAligned + size);
+
+	freeBytes -= size;
+	*offset = bestAligned;
+	return true;
+}
+
+void RangeAllocator::Free(uint64_t offset, uint64_t size)
+{
+	if (offset + size > capacity)
+		throw std::runtime_error("freed range out of bounds");
+
+	uint64_t start = offset;
+	uint64_t end = offset + size;
+
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && next->first < end)
+		throw std::runtime_error("range freed twice");
+
+	if (next != freeRanges.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second > start)
+			throw std::runtime_error("range freed twice");
+
+		if (prev->first + prev->second == start)
+		{
+			start = prev->first;
+			freeRanges.erase(prev);
+		}
+	}
+
+	if (next != freeRanges.end() && next->first == end)
+	{
+		end = next->first + next->second;
+		freeRanges.erase(next);
+	}
+
+	freeRanges[start] = end - start;
+	freeBytes += size;
+}
+
+uint64_t RangeAllocator::GetCapacity()
+{
+	return capacity;
+}
+
+uint64_t RangeAllocator::GetFreeBytes()
+{
+	return freeBytes;
+}
+
+uint64_t RangeAllocator::GetLargestFreeRange()
+{
+	uint64_t largest = 0;
+	for (const auto& r : freeRanges)
+		largest = r.second > largest ? r.second : largest;
+
+	return largest;
+}
+
+size_t RangeAllocator::GetFreeRangeCount()
+{
+	return freeRanges.size();
+}
+
+bool RangeAllocator::IsEmpty()
+{
+	return freeBytes == capacity;
+}
+
+RangeAllocator::~RangeAllocator()
+{
+}
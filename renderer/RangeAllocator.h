@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <iterator>
+
+//best fit free list over [0, capacity), neighbouring free ranges are merged on free
+class RangeAllocator
+{
+public:
+	RangeAllocator();
+	RangeAllocator(uint64_t newCapacity);
+
+	//false if no free range can hold size at the wanted alignment
+	bool Allocate(uint64_t size, uint64_t alignment, uint64_t* offset);
+	void Free(uint64_t offset, uint64_t size);
+
+	uint64_t GetCapacity();
+	uint64_t GetFreeBytes();
+	uint64_t GetLargestFreeRange();
+	size_t GetFreeRangeCount();
+	bool IsEmpty();
+
+	~RangeAllocator();
+
+private:
+	uint64_t capacity = 0;
+	uint64_t freeBytes = 0;
+
+	std::map<uint64_t, uint64_t> freeRanges; //offset -> size
+};
@@ -1,5 +1,28 @@
-C:\VulkanSDK\1.3.204.1\Bin\glslangValidator.exe -V shader.vert
-C:\VulkanSDK\1.3.204.1\Bin\glslangValidator.exe -V shader.frag
-C:\VulkanSDK\1.3.204.1\Bin\glslangValidator.exe -o blit_vert.spv -V blit.vert
-C:\VulkanSDK\1.3.204.1\Bin\glslangValidator.exe -o blit_frag.spv -V blit.frag
-pause
\ No newline at end of file
+cd /d "%~dp0"
+set SDK_BIN=C:\VulkanSDK\1.3.236.0\Bin
+
+%SDK_BIN%\glslangValidator.exe -V shader.vert || goto failed
+%SDK_BIN%\glslangValidator.exe -V shader.frag || goto failed
+%SDK_BIN%\glslangValidator.exe -o blit_vert.spv -V blit.vert || goto failed
+%SDK_BIN%\glslangValidator.exe -o blit_frag.spv -V blit.frag || goto failed
+%SDK_BIN%\glslangValidator.exe -o cull_comp.spv -V cull.comp || goto failed
+%SDK_BIN%\glslangValidator.exe -o hiz_comp.spv -V hiz.comp || goto failed
+%SDK_BIN%\glslangValidator.exe --target-env vulkan1.2 -o meshlet_task.spv -V meshlet.task || goto failed
+%SDK_BIN%\glslangValidator.exe --target-env vulkan1.2 -o meshlet_mesh.spv -V meshlet.mesh || goto failed
+
+%SDK_BIN%\spirv-val.exe vert.spv || goto failed
+%SDK_BIN%\spirv-val.exe frag.spv || goto failed
+%SDK_BIN%\spirv-val.exe blit_vert.spv || goto failed
+%SDK_BIN%\spirv-val.exe blit_frag.spv || goto failed
+%SDK_BIN%\spirv-val.exe cull_comp.spv || goto failed
+%SDK_BIN%\spirv-val.exe hiz_comp.spv || goto failed
+%SDK_BIN%\spirv-val.exe --target-env vulkan1.2 meshlet_task.spv || goto failed
+%SDK_BIN%\spirv-val.exe --target-env vulkan1.2 meshlet_mesh.spv || goto failed
+
+rem the prebuild step passes nopause, double clicking still waits
+if "%1"=="" pause
+exit /b 0
+
+:failed
+if "%1"=="" pause
+exit /b 1
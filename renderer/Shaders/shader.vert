@@ -10,17 +10,29 @@ layout(set = 0, binding = 0) uniform UboVP
 	mat4 view;
 } uboVP;
 
-layout(push_constant) uniform PushModel
+struct ObjectData
 {
 	mat4 model;
-} pushModel;
+	vec4 params;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer
+{
+	ObjectData objects[];
+} objectBuffer;
+
+//object id of every instance, an instanced draw covers firstInstance..firstInstance + instanceCount - 1
+layout(std430, set = 0, binding = 2) readonly buffer InstanceBuffer
+{
+	uint objectIds[];
+} instanceBuffer;
 
 layout(location = 0) out vec3 fragCol;
 layout(location = 1) out vec2 fragUV;
 
 void main()
 {
-	gl_Position = uboVP.projection * uboVP.view * pushModel.model * vec4(pos, 1.0);
+	gl_Position = uboVP.projection * uboVP.view * objectBuffer.objects[instanceBuffer.objectIds[gl_InstanceIndex]].model * vec4(pos, 1.0);
 	fragCol = col;
 	fragUV = uv;
 }
\ No newline at end of file
@@ -0,0 +1,504 @@
+#include "TextureEncoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "stb_image.h"
+#include "MeshCache.h"
+#include "MipChain.h"
+#include "TextureFile.h"
+
+//bc7 4 bit index interpolation weights, out of 64
+static const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+//the 4x4 block at block coordinates bx, by, clamped at the right and bottom edge
+static void FetchBlock(const uint8_t* rgba, uint32_t wid, uint32_t hei, uint32_t bx, uint32_t by, uint8_t* texels)
+{
+	for (uint32_t y = 0; y < 4; ++y)
+	{
+		auto sy = std::min(by * 4 + y, hei - 1);
+		for (uint32_t x = 0; x < 4; ++x)
+		{
+			auto sx = std::min(bx * 4 + x, wid - 1);
+			memcpy(texels + (y * 4 + x) * 4, rgba + (static_cast<size_t>(sy) * wid + sx) * 4, 4);
+		}
+	}
+}
+
+//ends of the principal axis through the block's first channels, clamped to 0..255
+static void FindEndpoints(const uint8_t* texels, int channels, float* lo, float* hi)
+{
+	float mean[4] = {};
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < channels; ++c)
+			mean[c] += texels[i * 4 + c] / 16.0f;
+
+	float cov[4][4] = {};
+	float axis[4] = {};
+	for (int i = 0; i < 16; ++i)
+	{
+		float d[4];
+		for (int c = 0; c < channels; ++c)
+			d[c] = texels[i * 4 + c] - mean[c];
+
+		for (int a = 0; a < channels; ++a)
+		{
+			axis[a] = std::max(axis[a], std::abs(d[a]));
+			for (int b = 0; b < channels; ++b)
+				cov[a][b] += d[a] * d[b];
+		}
+	}
+
+	//power iteration from the per channel extents converges in a few steps for 16 points
+	for (int iter = 0; iter < 8; ++iter)
+	{
+		float next[4] = {};
+		float largest = 0.0f;
+		for (int a = 0; a < channels; ++a)
+		{
+			for (int b = 0; b < channels; ++b)
+				next[a] += cov[a][b] * axis[b];
+			largest = std::max(largest, std::abs(next[a]));
+		}
+
+		if (largest == 0.0f)
+			break;
+
+		for (int a = 0; a < channels; ++a)
+			axis[a] = next[a] / largest;
+	}
+
+	float axisLengthSq = 0.0f;
+	for (int c = 0; c < channels; ++c)
+		axisLengthSq += axis[c] * axis[c];
+
+	float minT = 0.0f, maxT = 0.0f;
+	if (axisLengthSq > 0.0f)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (texels[i * 4 + c] - mean[c]) * axis[c];
+			t /= axisLengthSq;
+
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+	}
+
+	for (int c = 0; c < channels; ++c)
+	{
+		lo[c] = std::min(std::max(mean[c] + minT * axis[c], 0.0f), 255.0f);
+		hi[c] = std::min(std::max(mean[c] + maxT * axis[c], 0.0f), 255.0f);
+	}
+}
+
+static uint16_t Pack565(const float* rgb)
+{
+	auto r = static_cast<uint16_t>(rgb[0] * 31.0f / 255.0f + 0.5f);
+	auto g = static_cast<uint16_t>(rgb[1] * 63.0f / 255.0f + 0.5f);
+	auto b = static_cast<uint16_t>(rgb[2] * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static void Unpack565(uint16_t color, int* rgb)
+{
+	int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = r << 3 | r >> 2;
+	rgb[1] = g << 2 | g >> 4;
+	rgb[2] = b << 3 | b >> 2;
+}
+
+//appends bits to a 128 bit block, least significant first
+static void WriteBits(uint8_t* block, uint32_t* bitPos, uint32_t value, uint32_t bitCount)
+{
+	for (uint32_t b = 0; b < bitCount; ++b, ++*bitPos)
+	{
+		if (value >> b & 1)
+			block[*bitPos / 8] |= static_cast<uint8_t>(1 << (*bitPos % 8));
+	}
+}
+
+static const char* FormatName(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK: return "bc1";
+	case VK_FORMAT_BC5_UNORM_BLOCK: return "bc5";
+	case VK_FORMAT_BC7_UNORM_BLOCK: return "bc7";
+	default: return "?";
+	}
+}
+
+//file names of the images stb can decode, not recursive
+static std::vector<std::string> ListImages(const std::string& dir)
+{
+	std::vector<std::string> names;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("failed to list textures: " + dir);
+
+	do
+	{
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			names.push_back(findData.cFileName);
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+#else
+	DIR* dirHandle = opendir(dir.c_str());
+	if (!dirHandle)
+		throw std::runtime_error("failed to list textures: " + dir);
+
+	while (auto entry = readdir(dirHandle))
+	{
+		if (entry->d_type != DT_DIR)
+			names.push_back(entry->d_name);
+	}
+	closedir(dirHandle);
+#endif
+
+	std::vector<std::string> images;
+	for (const auto& name : names)
+	{
+		auto dot = name.find_last_of('.');
+		if (dot == std::string::npos)
+			continue;
+
+		auto extension = name.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+		if (extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "tga" || extension == "bmp")
+			images.push_back(name);
+	}
+
+	//listing order differs between file systems, the report shouldn't
+	std::sort(images.begin(), images.end());
+	return images;
+}
+
+void TextureEncoder::EncodeBC1Block(const uint8_t* texels, uint8_t* block)
+{
+	float lo[4], hi[4];
+	FindEndpoints(texels, 3, lo, hi);
+
+	//c0 > c1 selects the four color mode, equal endpoints leave every index on c0
+	auto c0 = Pack565(hi);
+	auto c1 = Pack565(lo);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	int palette[4][3];
+	Unpack565(c0, palette[0]);
+	Unpack565(c1, palette[1]);
+	for (int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+	}
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0, bestDist = INT32_MAX;
+			for (int p = 0; p < 4; ++p)
+			{
+				int dist = 0;
+				for (int c = 0; c < 3; ++c)
+				{
+					int d = texels[i * 4 + c] - palette[p][c];
+					dist += d * d;
+				}
+
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					best = p;
+				}
+			}
+
+			indices |= static_cast<uint32_t>(best) << (2 * i);
+		}
+	}
+
+	memcpy(block, &c0, sizeof(c0));
+	memcpy(block + 2, &c1, sizeof(c1));
+	memcpy(block + 4, &indices, sizeof(indices));
+}
+
+void TextureEncoder::EncodeBC4Block(const uint8_t* texels, int channel, uint8_t* block)
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		lo = std::min(lo, static_cast<int>(texels[i * 4 + channel]));
+		hi = std::max(hi, static_cast<int>(texels[i * 4 + channel]));
+	}
+
+	//a0 > a1 selects the eight value mode: codes 0 and 1 are the ends, 2..7 the six steps from a0 to a1
+	block[0] = static_cast<uint8_t>(hi);
+	block[1] = static_cast<uint8_t>(lo);
+
+	uint64_t indices = 0;
+	if (hi > lo)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			int step = ((hi - texels[i * 4 + channel]) * 7 + (hi - lo) / 2) / (hi - lo);
+			uint64_t code = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+			indices |= code << (3 * i);
+		}
+	}
+
+	for (int b = 0; b < 6; ++b)
+		block[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+void TextureEncoder::EncodeBC5Block(const uint8_t* texels, uint8_t* block)
+{
+	EncodeBC4Block(texels, 0, block);
+	EncodeBC4Block(texels, 1, block + 8);
+}
+
+void TextureEncoder::EncodeBC7Block(const uint8_t* texels, uint8_t* block)
+{
+	float ends[2][4];
+	FindEndpoints(texels, 4, ends[0], ends[1]);
+
+	//7 bits per channel plus a shared lowest bit per endpoint, whichever p bit loses less
+	uint32_t quantized[2][4], pBits[2];
+	int endpoints[2][4];
+	for (int e = 0; e < 2; ++e)
+	{
+		float bestError = -1.0f;
+		for (uint32_t p = 0; p < 2; ++p)
+		{
+			uint32_t q[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				float v = std::max((ends[e][c] - p) * 0.5f + 0.5f, 0.0f);
+				q[c] = std::min(static_cast<uint32_t>(v), 127u);
+				float d = ends[e][c] - static_cast<float>(q[c] << 1 | p);
+				error += d * d;
+			}
+
+			if (bestError < 0.0f || error < bestError)
+			{
+				bestError = error;
+				pBits[e] = p;
+				memcpy(quantized[e], q, sizeof(q));
+			}
+		}
+
+		for (int c = 0; c < 4; ++c)
+			endpoints[e][c] = static_cast<int>(quantized[e][c] << 1 | pBits[e]);
+	}
+
+	uint32_t indices[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		int bestDist = INT32_MAX;
+		for (uint32_t w = 0; w < 16; ++w)
+		{
+			int dist = 0;
+			for (int c = 0; c < 4; ++c)
+			{
+				int value = ((64 - BC7_WEIGHTS[w]) * endpoints[0][c] + BC7_WEIGHTS[w] * endpoints[1][c] + 32) >> 6;
+				int d = texels[i * 4 + c] - value;
+				dist += d * d;
+			}
+
+			if (dist < bestDist)
+			{
+				bestDist = dist;
+				indices[i] = w;
+			}
+		}
+	}
+
+	//the first index is stored without its top bit, swapping the endpoints clears it
+	if (indices[0] & 8)
+	{
+		for (int c = 0; c < 4; ++c)
+			std::swap(quantized[0][c], quantized[1][c]);
+		std::swap(pBits[0], pBits[1]);
+		for (auto& idx : indices)
+			idx = 15 - idx;
+	}
+
+	memset(block, 0, 16);
+	uint32_t bitPos = 0;
+	WriteBits(block, &bitPos, 1 << 6, 7); //mode 6
+	for (int c = 0; c < 4; ++c)
+	{
+		WriteBits(block, &bitPos, quantized[0][c], 7);
+		WriteBits(block, &bitPos, quantized[1][c], 7);
+	}
+	WriteBits(block, &bitPos, pBits[0], 1);
+	WriteBits(block, &bitPos, pBits[1], 1);
+
+	WriteBits(block, &bitPos, indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+		WriteBits(block, &bitPos, indices[i], 4);
+}
+
+std::vector<uint8_t> TextureEncoder::EncodeLevel(const uint8_t* rgba, uint32_t wid, uint32_t hei, VkFormat format)
+{
+	std::vector<uint8_t> blocks(GetImageLevelSize(format, wid, hei));
+	auto blockSize = GetImageLevelSize(format, 4, 4);
+	auto blocksWide = (wid + 3) / 4;
+	auto blocksHigh = (hei + 3) / 4;
+
+	uint8_t texels[64];
+	for (uint32_t by = 0; by < blocksHigh; ++by)
+	{
+		for (uint32_t bx = 0; bx < blocksWide; ++bx)
+		{
+			FetchBlock(rgba, wid, hei, bx, by, texels);
+			auto block = blocks.data() + (static_cast<size_t>(by) * blocksWide + bx) * blockSize;
+
+			switch (format)
+			{
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+				EncodeBC1Block(texels, block);
+				break;
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+				EncodeBC5Block(texels, block);
+				break;
+			case VK_FORMAT_BC7_UNORM_BLOCK:
+				EncodeBC7Block(texels, block);
+				break;
+			default:
+				throw std::runtime_error("texture encoder can't write this format");
+			}
+		}
+	}
+
+	return blocks;
+}
+
+VkFormat TextureEncoder::ChooseFormat(const std::string& fileName, const uint8_t* rgba, uint32_t wid, uint32_t hei)
+{
+	auto lowerName = fileName;
+	std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+	//tangent space normals only need x and y, the shader can rebuild z
+	if (lowerName.find("normal") != std::string::npos || lowerName.find("_nrm") != std::string::npos ||
+		lowerName.find("_n.") != std::string::npos)
+	{
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	}
+
+	for (size_t i = 0; i < static_cast<size_t>(wid) * hei; ++i)
+	{
+		if (rgba[i * 4 + 3] != 255)
+			return VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+
+	return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+}
+
+void TextureEncoder::CookDirectory(ThreadPool* threadPool, const std::string& dir)
+{
+	auto cookStart = std::chrono::high_resolution_clock::now();
+	auto sources = ListImages(dir);
+
+	struct CookResult
+	{
+		bool skipped;
+		VkFormat format;
+		uint32_t levelCount;
+		size_t rgbaBytes; //the whole chain as uploaded uncompressed
+		size_t cookedBytes;
+	};
+	std::vector<CookResult> results(sources.size());
+
+	threadPool->ParallelFor(sources.size(), [&](size_t i)
+	{
+		auto sourceName = dir + "/" + sources[i];
+		auto cookedName = dir + "/" + TextureFile::GetCookedName(sources[i]);
+		auto sourceHash = MeshCache::HashFile(sourceName);
+
+		TextureFile existing;
+		if (existing.Open(cookedName) && existing.GetSourceHash() == sourceHash)
+		{
+			results[i] = { true, existing.GetFormat(), existing.GetLevelCount(), 0, 0 };
+			return;
+		}
+
+		int wid, hei, channels;
+		stbi_uc* img = stbi_load(sourceName.c_str(), &wid, &hei, &channels, STBI_rgb_alpha);
+		if (!img)
+			throw std::runtime_error("failed to load texture: " + sourceName);
+
+		//the same box filtered chain the renderer builds when it can't blit
+		auto levelCount = MipChain::CountLevels(wid, hei);
+		std::vector<uint8_t> chain(MipChain::GetSize(wid, hei, levelCount));
+		memcpy(chain.data(), img, static_cast<size_t>(wid) * hei * 4);
+		stbi_image_free(img);
+		MipChain::Build(chain.data(), wid, hei, levelCount);
+
+		auto format = ChooseFormat(sources[i], chain.data(), wid, hei);
+
+		std::vector<std::vector<uint8_t>> levels(levelCount);
+		size_t offset = 0, cookedBytes = 0;
+		uint32_t levelWid = wid, levelHei = hei;
+		for (uint32_t l = 0; l < levelCount; ++l)
+		{
+			levels[l] = EncodeLevel(chain.data() + offset, levelWid, levelHei, format);
+			cookedBytes += levels[l].size();
+
+			offset += static_cast<size_t>(levelWid) * levelHei * 4;
+			levelWid = std::max(levelWid / 2, 1u);
+			levelHei = std::max(levelHei / 2, 1u);
+		}
+
+		TextureFile::WriteKtx2(cookedName, format, wid, hei, levels, sourceHash);
+		results[i] = { false, format, levelCount, chain.size(), cookedBytes };
+	});
+
+	size_t cookedCount = 0, rgbaBytes = 0, cookedBytes = 0;
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		const auto& r = results[i];
+		if (r.skipped)
+		{
+			std::cout << "  " << sources[i] << ": up to date (" << FormatName(r.format) << ")" << std::endl;
+			continue;
+		}
+
+		std::cout << "  " << sources[i] << ": " << FormatName(r.format) << ", " << r.levelCount << " levels, "
+			<< r.rgbaBytes / 1024 << " KB -> " << r.cookedBytes / 1024 << " KB" << std::endl;
+
+		++cookedCount;
+		rgbaBytes += r.rgbaBytes;
+		cookedBytes += r.cookedBytes;
+	}
+
+	auto cookMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cookStart).count();
+	std::cout << "cooked " << cookedCount << " of " << sources.size() << " textures in " << dir << " in " << cookMs << " ms on "
+		<< threadPool->GetThreadCount() + 1 << " threads: " << rgbaBytes / (1024 * 1024) << " MB as rgba8 -> "
+		<< cookedBytes / (1024 * 1024) << " MB";
+	if (cookedBytes > 0)
+		std::cout << " (" << static_cast<double>(rgbaBytes) / cookedBytes << "x smaller)";
+	std::cout << std::endl;
+}
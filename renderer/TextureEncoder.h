@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "ThreadPool.h"
+
+//offline block compression of rgba8 textures into the ktx2 files TextureFile loads
+//endpoints come from the principal axis of each block's colors, no exhaustive search, so it is quick rather than best quality
+class TextureEncoder
+{
+public:
+	//texels are the 16 rgba8 texels of a 4x4 block row by row
+	static void EncodeBC1Block(const uint8_t* texels, uint8_t* block);
+	//one channel of the texels, 8 bytes
+	static void EncodeBC4Block(const uint8_t* texels, int channel, uint8_t* block);
+	//red and green, 16 bytes
+	static void EncodeBC5Block(const uint8_t* texels, uint8_t* block);
+	//mode 6 only (one subset, rgba endpoints, 4 bit indices), 16 bytes
+	static void EncodeBC7Block(const uint8_t* texels, uint8_t* block);
+
+	//whole level, blocks past the right or bottom edge repeat the last column or row
+	static std::vector<uint8_t> EncodeLevel(const uint8_t* rgba, uint32_t wid, uint32_t hei, VkFormat format);
+
+	//normal maps (by name) go to bc5, base colors to bc1 or bc7 when they aren't opaque
+	static VkFormat ChooseFormat(const std::string& fileName, const uint8_t* rgba, uint32_t wid, uint32_t hei);
+
+	//every image in dir gets a ktx2 with its full mip chain next to it, one source per worker
+	//sources whose hash matches the one in their existing ktx2 are skipped
+	static void CookDirectory(ThreadPool* threadPool, const std::string& dir);
+};
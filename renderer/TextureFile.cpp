@@ -0,0 +1,450 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const char SOURCE_HASH_KEY[] = "rendererSourceHash";
+
+//khronos data format descriptor values of the block compressed color models
+static const uint32_t KHR_DF_MODEL_BC1A = 128;
+static const uint32_t KHR_DF_MODEL_BC3 = 130;
+static const uint32_t KHR_DF_MODEL_BC5 = 132;
+static const uint32_t KHR_DF_MODEL_BC7 = 134;
+static const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+static const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+static const uint32_t KHR_DF_TRANSFER_SRGB = 2;
+
+struct DdsPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t bitMasks[4];
+};
+
+struct DdsHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DdsPixelFormat pixelFormat;
+	uint32_t caps[4];
+	uint32_t reserved2;
+};
+
+struct DdsHeaderDx10
+{
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+static const uint32_t DDS_MAGIC = 0x20534444; //"DDS "
+static const uint32_t DDS_FOURCC = 0x4;
+static const uint32_t DDS_CAPS2_CUBEMAP = 0x200;
+static const uint32_t DDS_CAPS2_VOLUME = 0x200000;
+static const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+static uint32_t FourCC(char a, char b, char c, char d)
+{
+	return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+}
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool IsBlockFormat(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static VkFormat DxgiToVkFormat(uint32_t dxgiFormat)
+{
+	switch (dxgiFormat)
+	{
+	case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+	case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+	case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+	case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+	case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+	default: return VK_FORMAT_UNDEFINED;
+	}
+}
+
+//basic descriptor block, one sample per 64 bit half of the block
+static std::vector<uint32_t> BuildDfd(VkFormat format)
+{
+	uint32_t model, bytesPerBlock;
+	std::vector<uint32_t> channels; //one per 64 bits
+	bool srgb = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+		format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC1A;
+		bytesPerBlock = 8;
+		channels = { 0 }; //color
+		break;
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC1A;
+		bytesPerBlock = 8;
+		channels = { 1 }; //color with punch through alpha
+		break;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC3;
+		bytesPerBlock = 16;
+		channels = { 15, 0 }; //alpha then color
+		break;
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		model = KHR_DF_MODEL_BC5;
+		bytesPerBlock = 16;
+		channels = { 0, 1 }; //red then green
+		break;
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC7;
+		bytesPerBlock = 16;
+		channels = { 0 };
+		break;
+	default:
+		throw std::runtime_error("no data format descriptor for texture format");
+	}
+
+	uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(channels.size());
+	std::vector<uint32_t> dfd =
+	{
+		4 + blockSize, //total size
+		0, //vendor khronos, descriptor type basic
+		2 | blockSize << 16, //version 1.3
+		model | KHR_DF_PRIMARIES_BT709 << 8 | (srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16,
+		3 | 3 << 8, //4x4x1x1 texel blocks
+		bytesPerBlock,
+		0
+	};
+
+	uint32_t sampleBits = bytesPerBlock * 8 / static_cast<uint32_t>(channels.size());
+	for (size_t i = 0; i < channels.size(); ++i)
+	{
+		dfd.push_back(static_cast<uint32_t>(i) * sampleBits | (sampleBits - 1) << 16 | channels[i] << 24);
+		dfd.push_back(0); //sample position
+		dfd.push_back(0); //lower
+		dfd.push_back(0xFFFFFFFF); //upper
+	}
+
+	return dfd;
+}
+
+TextureFile::TextureFile()
+{
+}
+
+std::string TextureFile::GetCookedName(const std::string& sourceName)
+{
+	return sourceName.substr(0, sourceName.find_last_of('.')) + ".ktx2";
+}
+
+void TextureFile::WriteKtx2(const std::string& fileName, VkFormat format, uint32_t wid, uint32_t hei,
+	const std::vector<std::vector<uint8_t>>& levels, uint64_t sourceHash)
+{
+	auto dfd = BuildDfd(format);
+
+	//one key/value pair: length, key and value both null terminated, padded to 4
+	char hashText[17];
+	snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(sourceHash));
+	std::vector<char> kvd(sizeof(uint32_t));
+	kvd.insert(kvd.end(), SOURCE_HASH_KEY, SOURCE_HASH_KEY + sizeof(SOURCE_HASH_KEY));
+	kvd.insert(kvd.end(), hashText, hashText + sizeof(hashText));
+	uint32_t kvLength = static_cast<uint32_t>(kvd.size() - sizeof(uint32_t));
+	memcpy(kvd.data(), &kvLength, sizeof(kvLength));
+	kvd.resize(AlignUp(kvd.size(), 4), 0);
+
+	Ktx2Header header = {};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(header.identifier));
+	header.vkFormat = format;
+	header.typeSize = 1;
+	header.pixelWidth = wid;
+	header.pixelHeight = hei;
+	header.faceCount = 1;
+	header.levelCount = static_cast<uint32_t>(levels.size());
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + sizeof(Ktx2Level) * levels.size());
+	header.dfdByteLength = static_cast<uint32_t>(sizeof(uint32_t) * dfd.size());
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+	//the smallest level comes first in the file, block aligned
+	std::vector<Ktx2Level> levelIndex(levels.size());
+	uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+	for (size_t l = levels.size(); l-- > 0;)
+	{
+		offset = AlignUp(offset, 16);
+		levelIndex[l].byteOffset = offset;
+		levelIndex[l].byteLength = levels[l].size();
+		levelIndex[l].uncompressedByteLength = levels[l].size();
+		offset += levels[l].size();
+	}
+
+	//written next to the final name and swapped in like the cooked meshes
+	auto tmpName = fileName + ".tmp";
+	std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		throw std::runtime_error("failed to write texture: " + fileName);
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(levelIndex.data()), sizeof(Ktx2Level) * levelIndex.size());
+	out.write(reinterpret_cast<const char*>(dfd.data()), sizeof(uint32_t) * dfd.size());
+	out.write(kvd.data(), kvd.size());
+
+	const char zeros[16] = {};
+	for (size_t l = levels.size(); l-- > 0;)
+	{
+		uint64_t pos = static_cast<uint64_t>(out.tellp());
+		out.write(zeros, static_cast<std::streamsize>(levelIndex[l].byteOffset - pos));
+		out.write(reinterpret_cast<const char*>(levels[l].data()), levels[l].size());
+	}
+
+	out.close();
+	if (out.fail())
+		throw std::runtime_error("failed to write texture: " + fileName);
+
+	std::remove(fileName.c_str());
+	if (std::rename(tmpName.c_str(), fileName.c_str()) != 0)
+		throw std::runtime_error("failed to replace texture: " + fileName);
+}
+
+bool TextureFile::Open(const std::string& fileName)
+{
+	format = VK_FORMAT_UNDEFINED;
+	levelOffsets.clear();
+	sourceHash = 0;
+
+	auto dot = fileName.find_last_of('.');
+	auto extension = dot == std::string::npos ? std::string() : fileName.substr(dot);
+	if (extension != ".ktx2" && extension != ".dds")
+		return false;
+
+	if (!file.Open(fileName))
+		return false;
+
+	if (!(extension == ".ktx2" ? OpenKtx2() : OpenDds()) || !CheckLevels())
+	{
+		file.Close();
+		return false;
+	}
+
+	return true;
+}
+
+VkFormat TextureFile::GetFormat()
+{
+	return format;
+}
+
+uint32_t TextureFile::GetWidth()
+{
+	return width;
+}
+
+uint32_t TextureFile::GetHeight()
+{
+	return height;
+}
+
+uint32_t TextureFile::GetLevelCount()
+{
+	return static_cast<uint32_t>(levelOffsets.size());
+}
+
+const uint8_t* TextureFile::GetLevelData(uint32_t level)
+{
+	if (level >= levelOffsets.size())
+		throw std::runtime_error("oor texture level access");
+
+	return reinterpret_cast<const uint8_t*>(file.GetData() + levelOffsets[level]);
+}
+
+VkDeviceSize TextureFile::GetLevelSize(uint32_t level)
+{
+	return GetImageLevelSize(format, std::max(width >> level, 1u), std::max(height >> level, 1u));
+}
+
+uint64_t TextureFile::GetSourceHash()
+{
+	return sourceHash;
+}
+
+TextureFile::~TextureFile()
+{
+}
+
+bool TextureFile::OpenKtx2()
+{
+	auto data = file.GetData();
+	auto size = file.GetSize();
+
+	Ktx2Header header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+		!IsBlockFormat(static_cast<VkFormat>(header.vkFormat)) || header.supercompressionScheme != 0 ||
+		header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+	{
+		return false;
+	}
+
+	format = static_cast<VkFormat>(header.vkFormat);
+	width = header.pixelWidth;
+	height = header.pixelHeight;
+
+	//0 levels asks the loader to generate them, block formats can't be blitted so only the top one is used
+	auto levelCount = std::max(header.levelCount, 1u);
+	if (sizeof(header) + sizeof(Ktx2Level) * levelCount > size)
+		return false;
+
+	for (uint32_t l = 0; l < levelCount; ++l)
+	{
+		Ktx2Level level;
+		memcpy(&level, data + sizeof(header) + sizeof(Ktx2Level) * l, sizeof(level));
+		if (level.byteLength < GetImageLevelSize(format, std::max(width >> l, 1u), std::max(height >> l, 1u)))
+			return false;
+
+		levelOffsets.push_back(level.byteOffset);
+	}
+
+	//only our own key is looked for, the rest of the key/value data is skipped
+	if (static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength > size)
+		return false;
+
+	uint32_t kvOffset = 0;
+	while (kvOffset + sizeof(uint32_t) <= header.kvdByteLength)
+	{
+		uint32_t kvLength;
+		memcpy(&kvLength, data + header.kvdByteOffset + kvOffset, sizeof(kvLength));
+		auto kv = data + header.kvdByteOffset + kvOffset + sizeof(uint32_t);
+		if (kvLength > header.kvdByteLength - kvOffset - sizeof(uint32_t))
+			return false;
+
+		std::string keyValue(kv, kvLength);
+		if (keyValue.compare(0, sizeof(SOURCE_HASH_KEY), SOURCE_HASH_KEY, sizeof(SOURCE_HASH_KEY)) == 0)
+			sourceHash = strtoull(keyValue.c_str() + sizeof(SOURCE_HASH_KEY), nullptr, 16);
+
+		kvOffset += static_cast<uint32_t>(AlignUp(sizeof(uint32_t) + kvLength, 4));
+	}
+
+	return true;
+}
+
+bool TextureFile::OpenDds()
+{
+	auto data = file.GetData();
+	auto size = file.GetSize();
+
+	uint32_t magic;
+	DdsHeader header;
+	if (size < sizeof(magic) + sizeof(header))
+		return false;
+	memcpy(&magic, data, sizeof(magic));
+	memcpy(&header, data + sizeof(magic), sizeof(header));
+
+	if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || !(header.pixelFormat.flags & DDS_FOURCC) ||
+		(header.caps[1] & (DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME)) || header.width == 0 || header.height == 0)
+	{
+		return false;
+	}
+
+	uint64_t offset = sizeof(magic) + sizeof(header);
+	auto fourCC = header.pixelFormat.fourCC;
+
+	if (fourCC == FourCC('D', 'X', '1', '0'))
+	{
+		DdsHeaderDx10 dx10;
+		if (offset + sizeof(dx10) > size)
+			return false;
+		memcpy(&dx10, data + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+
+		if (dx10.resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10.arraySize != 1)
+			return false;
+
+		format = DxgiToVkFormat(dx10.dxgiFormat);
+	}
+	else if (fourCC == FourCC('D', 'X', 'T', '1'))
+	{
+		format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	}
+	else if (fourCC == FourCC('D', 'X', 'T', '5'))
+	{
+		format = VK_FORMAT_BC3_UNORM_BLOCK;
+	}
+	else if (fourCC == FourCC('A', 'T', 'I', '2') || fourCC == FourCC('B', 'C', '5', 'U'))
+	{
+		format = VK_FORMAT_BC5_UNORM_BLOCK;
+	}
+
+	if (format == VK_FORMAT_UNDEFINED)
+		return false;
+
+	width = header.width;
+	height = header.height;
+
+	//largest level first, packed
+	auto levelCount = std::max(header.mipMapCount, 1u);
+	for (uint32_t l = 0; l < levelCount; ++l)
+	{
+		levelOffsets.push_back(offset);
+		offset += GetImageLevelSize(format, std::max(width >> l, 1u), std::max(height >> l, 1u));
+	}
+
+	return true;
+}
+
+bool TextureFile::CheckLevels()
+{
+	//more levels than down to 1x1 or any level running past the end means a damaged file
+	if (levelOffsets.empty() || levelOffsets.size() > 32 || (std::max(width, height) >> (levelOffsets.size() - 1)) == 0)
+		return false;
+
+	for (uint32_t l = 0; l < levelOffsets.size(); ++l)
+	{
+		if (levelOffsets[l] + GetLevelSize(l) > file.GetSize())
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "MappedFile.h"
+
+//start of a ktx2 file, the level index (one Ktx2Level per level) follows right after it
+struct Ktx2Header
+{
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+struct Ktx2Level
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+//block compressed 2d texture with its mip chain, read from a ktx2 or dds container
+//only plain (not supercompressed) bc1/bc3/bc5/bc7 single layer textures are accepted
+class TextureFile
+{
+public:
+	TextureFile();
+
+	//where the cooker puts the compressed copy of a source image, next to it with a .ktx2 extension
+	static std::string GetCookedName(const std::string& sourceName);
+	//levels level 0 first, the source hash goes into the key/value data so the cooker can skip unchanged sources
+	static void WriteKtx2(const std::string& fileName, VkFormat format, uint32_t wid, uint32_t hei,
+		const std::vector<std::vector<uint8_t>>& levels, uint64_t sourceHash);
+
+	//false if missing, damaged or in a format this doesn't load, picks the container by extension
+	bool Open(const std::string& fileName);
+
+	VkFormat GetFormat();
+	uint32_t GetWidth();
+	uint32_t GetHeight();
+	uint32_t GetLevelCount();
+	//tightly packed blocks of one level
+	const uint8_t* GetLevelData(uint32_t level);
+	VkDeviceSize GetLevelSize(uint32_t level);
+	//0 when the file wasn't written by WriteKtx2
+	uint64_t GetSourceHash();
+
+	~TextureFile();
+
+private:
+	MappedFile file;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint64_t> levelOffsets;
+	uint64_t sourceHash = 0;
+
+	bool OpenKtx2();
+	bool OpenDds();
+	bool CheckLevels();
+};
@@ -0,0 +1,166 @@
+#include "TextureRegistry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <vector>
+
+TextureRegistry::TextureRegistry()
+{
+}
+
+std::string TextureRegistry::Canonicalize(const std::string& fileName)
+{
+	std::vector<std::string> parts;
+	size_t start = 0;
+	while (start <= fileName.size())
+	{
+		auto end = fileName.find_first_of("/\\", start);
+		if (end == std::string::npos)
+			end = fileName.size();
+
+		auto part = fileName.substr(start, end - start);
+		if (part == ".." && !parts.empty() && parts.back() != "..")
+			parts.pop_back();
+		else if (!part.empty() && part != ".")
+			parts.push_back(part);
+
+		start = end + 1;
+	}
+
+	std::string canonical;
+	for (const auto& part : parts)
+		canonical += (canonical.empty() ? "" : "/") + part;
+
+#ifdef _WIN32
+	std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#endif
+
+	return canonical;
+}
+
+bool TextureRegistry::Acquire(const std::string& canonicalName, size_t* texId)
+{
+	auto found = byName.find(canonicalName);
+	if (found == byName.end())
+		return false;
+
+	auto& entry = entries[found->second];
+	++entry.refCount;
+	++entry.hits;
+	++nameHits;
+	bytesSaved += entry.bytes;
+
+	*texId = found->second;
+	return true;
+}
+
+bool TextureRegistry::AcquireByHash(const std::string& canonicalName, uint64_t contentHash, size_t* texId)
+{
+	auto found = byHash.find(contentHash);
+	if (contentHash == 0 || found == byHash.end())
+		return false;
+
+	auto& entry = entries[found->second];
+	++entry.refCount;
+	++entry.hits;
+	++hashHits;
+	bytesSaved += entry.bytes;
+
+	byName[canonicalName] = found->second;
+
+	*texId = found->second;
+	return true;
+}
+
+void TextureRegistry::Add(const std::string& canonicalName, uint64_t contentHash, size_t texId, VkDeviceSize bytes)
+{
+	entries[texId] = { 1, contentHash, bytes, 0 };
+	byName[canonicalName] = texId;
+	if (contentHash != 0)
+		byHash[contentHash] = texId;
+}
+
+void TextureRegistry::SetBytes(size_t texId, VkDeviceSize bytes)
+{
+	auto found = entries.find(texId);
+	if (found == entries.end())
+		return;
+
+	bytesSaved += (bytes - found->second.bytes) * found->second.hits;
+	found->second.bytes = bytes;
+}
+
+void TextureRegistry::SetContentHash(size_t texId, uint64_t contentHash)
+{
+	auto found = entries.find(texId);
+	if (found == entries.end() || contentHash == 0)
+		return;
+
+	found->second.contentHash = contentHash;
+	byHash[contentHash] = texId;
+}
+
+bool TextureRegistry::FindByHash(uint64_t contentHash, size_t* texId)
+{
+	auto found = byHash.find(contentHash);
+	if (contentHash == 0 || found == byHash.end())
+		return false;
+
+	*texId = found->second;
+	return true;
+}
+
+void TextureRegistry::Alias(size_t texId, size_t targetId)
+{
+	auto& target = entries[targetId];
+	++target.refCount;
+	++target.hits;
+	++hashHits;
+	bytesSaved += target.bytes;
+
+	aliases[texId] = targetId;
+}
+
+bool TextureRegistry::GetAlias(size_t texId, size_t* targetId)
+{
+	auto found = aliases.find(texId);
+	if (found == aliases.end())
+		return false;
+
+	*targetId = found->second;
+	return true;
+}
+
+bool TextureRegistry::Release(size_t texId)
+{
+	auto found = entries.find(texId);
+	if (found == entries.end() || --found->second.refCount > 0)
+		return false;
+
+	//every name that resolved to it, copies under other names included
+	for (auto name = byName.begin(); name != byName.end();)
+	{
+		if (name->second == texId)
+			name = byName.erase(name);
+		else
+			++name;
+	}
+
+	if (found->second.contentHash != 0)
+		byHash.erase(found->second.contentHash);
+	entries.erase(found);
+	aliases.erase(texId);
+
+	return true;
+}
+
+void TextureRegistry::PrintStats()
+{
+	std::cout << "texture registry: " << entries.size() << " textures, " << nameHits << " reused by path, "
+		<< hashHits << " by content, " << bytesSaved / (1024 * 1024) << " MB not loaded again" << std::endl;
+}
+
+TextureRegistry::~TextureRegistry()
+{
+}
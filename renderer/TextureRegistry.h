@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Utils.h"
+
+//which texture id holds which file, so a texture referenced by several materials or models is loaded once
+//files are matched by canonical path first, then (when known) by content hash, ids are refcounted by their users
+//a streamed texture is only hashed on its worker, when it turns out to be a copy it becomes an alias of the texture loaded first
+class TextureRegistry
+{
+public:
+	TextureRegistry();
+
+	//forward slashes, no "." or "dir/.." parts, lower case where the file system ignores case
+	static std::string Canonicalize(const std::string& fileName);
+
+	//true and *texId on a hit, which also takes a reference and counts towards the bytes saved
+	bool Acquire(const std::string& canonicalName, size_t* texId);
+	//the same by content, a hit also makes canonicalName resolve to the id from now on
+	bool AcquireByHash(const std::string& canonicalName, uint64_t contentHash, size_t* texId);
+	//a newly loaded texture with one reference, contentHash 0 when the file couldn't be hashed
+	void Add(const std::string& canonicalName, uint64_t contentHash, size_t texId, VkDeviceSize bytes);
+	//for textures added before their size was known, hits they already had count towards the bytes saved from now on
+	void SetBytes(size_t texId, VkDeviceSize bytes);
+	//the same for the content hash, later loads of that content resolve to texId
+	void SetContentHash(size_t texId, uint64_t contentHash);
+
+	//a texture with that content, no reference taken
+	bool FindByHash(uint64_t contentHash, size_t* texId);
+	//texId keeps its names and users but samples targetId's image from now on, holding one reference to it
+	void Alias(size_t texId, size_t targetId);
+	//true and *targetId when texId is an alias, read before Release since that forgets it
+	bool GetAlias(size_t texId, size_t* targetId);
+
+	//true when that was the last reference, the id is forgotten and the caller frees the texture
+	bool Release(size_t texId);
+
+	void PrintStats();
+
+	~TextureRegistry();
+
+private:
+	struct Entry
+	{
+		size_t refCount;
+		uint64_t contentHash;
+		VkDeviceSize bytes;
+		size_t hits;
+	};
+	std::map<size_t, Entry> entries; //by texture id
+	std::map<std::string, size_t> byName;
+	std::map<uint64_t, size_t> byHash;
+	std::map<size_t, size_t> aliases; //texture id, the id whose image it samples
+
+	size_t nameHits = 0;
+	size_t hashHits = 0;
+	VkDeviceSize bytesSaved = 0;
+};
@@ -0,0 +1,197 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		auto hwThreads = std::thread::hardware_concurrency();
+		threadCount = hwThreads > 1 ? hwThreads - 1 : 1;
+	}
+
+	for (size_t i = 0; i < threadCount; ++i)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if (count == 0)
+		return;
+
+	struct ForState
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		std::mutex doneMutex;
+		std::condition_variable doneCv;
+		std::exception_ptr error;
+		std::mutex errorMutex;
+	};
+	auto state = std::make_shared<ForState>();
+
+	//every participant pulls indices until none are left, uneven items balance themselves
+	auto drain = [state, count, &func]()
+	{
+		size_t ran = 0;
+		for (size_t i = state->next++; i < count; i = state->next++)
+		{
+			try
+			{
+				func(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(state->errorMutex);
+				if (!state->error)
+					state->error = std::current_exception();
+			}
+			++ran;
+		}
+
+		if (ran > 0 && (state->done += ran) == count)
+		{
+			std::lock_guard<std::mutex> lock(state->doneMutex);
+			state->doneCv.notify_all();
+		}
+	};
+
+	size_t helpers = workers.size() < count - 1 ? workers.size() : count - 1;
+	for (size_t i = 0; i < helpers; ++i)
+		Enqueue(drain);
+
+	drain();
+
+	{
+		std::unique_lock<std::mutex> lock(state->doneMutex);
+		state->doneCv.wait(lock, [&state, count]() { return state->done == count; });
+	}
+
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func, const std::function<void(size_t)>& onDone)
+{
+	if (count == 0)
+		return;
+
+	struct ForState
+	{
+		std::atomic<size_t> next{ 0 };
+		std::mutex doneMutex;
+		std::condition_variable doneCv;
+		std::queue<std::pair<size_t, bool>> finished; //item, func returned normally
+		std::exception_ptr error;
+	};
+	auto state = std::make_shared<ForState>();
+
+	auto drain = [state, count, &func]()
+	{
+		for (size_t i = state->next++; i < count; i = state->next++)
+		{
+			std::exception_ptr error;
+			try
+			{
+				func(i);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(state->doneMutex);
+			if (error && !state->error)
+				state->error = error;
+			state->finished.push({ i, !error });
+			state->doneCv.notify_all();
+		}
+	};
+
+	size_t helpers = workers.size() < count ? workers.size() : count;
+	for (size_t i = 0; i < helpers; ++i)
+		Enqueue(drain);
+
+	//the workers still hold func, so even a throwing onDone waits for every item
+	std::exception_ptr doneError;
+	for (size_t handled = 0; handled < count; ++handled)
+	{
+		std::pair<size_t, bool> item;
+		{
+			std::unique_lock<std::mutex> lock(state->doneMutex);
+			state->doneCv.wait(lock, [&state]() { return !state->finished.empty(); });
+			item = state->finished.front();
+			state->finished.pop();
+		}
+
+		if (!item.second || doneError)
+			continue;
+
+		try
+		{
+			onDone(item.first);
+		}
+		catch (...)
+		{
+			doneError = std::current_exception();
+		}
+	}
+
+	if (state->error)
+		std::rethrow_exception(state->error);
+	if (doneError)
+		std::rethrow_exception(doneError);
+}
+
+void ThreadPool::Run(std::function<void()> task)
+{
+	Enqueue(std::move(task));
+}
+
+size_t ThreadPool::GetThreadCount()
+{
+	return workers.size();
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(taskMutex);
+		stopping = true;
+	}
+	taskCv.notify_all();
+
+	for (auto& w : workers)
+		w.join();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(taskMutex);
+			taskCv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+			if (stopping && tasks.empty())
+				return;
+
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(taskMutex);
+		tasks.push(std::move(task));
+	}
+	taskCv.notify_one();
+}
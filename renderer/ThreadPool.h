@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//fixed set of worker threads, started once and shared by every cpu heavy loader
+class ThreadPool
+{
+public:
+	//0 = one worker per hardware thread besides the caller
+	ThreadPool(size_t threadCount);
+
+	//runs func(0..count-1) across the workers and the calling thread, returns once all are done
+	//the first exception thrown by func is rethrown here
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+	//func only runs on the workers, onDone(i) on the calling thread as soon as func(i) returned, in the order they finish
+	//items whose func threw get no onDone, the first exception of either is rethrown once everything is done
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func, const std::function<void(size_t)>& onDone);
+	//queues task for a worker and returns right away, task must not throw
+	void Run(std::function<void()> task);
+
+	size_t GetThreadCount();
+
+	~ThreadPool();
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+
+	std::mutex taskMutex;
+	std::condition_variable taskCv;
+	bool stopping = false;
+
+	void WorkerLoop();
+	void Enqueue(std::function<void()> task);
+};
@@ -0,0 +1,70 @@
+#include "UniformRing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+UniformRing::UniformRing()
+{
+}
+
+void UniformRing::Init(VkPhysicalDevice physDevice, VkDevice newLogicDevice, MemoryAllocator* newAllocator,
+	VkDeviceSize newFrameSize, uint32_t newFrameCount)
+{
+	logicDevice = newLogicDevice;
+	allocator = newAllocator;
+
+	//the same slices may be bound as uniform or storage buffers, honour both offset alignments
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physDevice, &props);
+	alignment = std::max(props.limits.minUniformBufferOffsetAlignment, props.limits.minStorageBufferOffsetAlignment);
+
+	frameSize = (newFrameSize + alignment - 1) / alignment * alignment;
+
+	CreateBuffer(logicDevice, allocator, frameSize * newFrameCount,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&buffer, &bufferMemory);
+
+	if (!bufferMemory.mapped)
+		throw std::runtime_error("uniform ring memory isn't mapped");
+}
+
+void UniformRing::BeginFrame(uint32_t frameIdx)
+{
+	frameStart = frameSize * frameIdx;
+	head = 0;
+}
+
+uint32_t UniformRing::Allocate(VkDeviceSize size, void** mapped)
+{
+	auto offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > frameSize)
+		throw std::runtime_error("uniform ring frame slice is full");
+
+	head = offset + size;
+
+	*mapped = static_cast<char*>(bufferMemory.mapped) + frameStart + offset;
+	return static_cast<uint32_t>(frameStart + offset);
+}
+
+VkBuffer UniformRing::GetBuffer()
+{
+	return buffer;
+}
+
+VkDeviceSize UniformRing::GetFrameUsed()
+{
+	return head;
+}
+
+void UniformRing::Destroy()
+{
+	if (buffer != VK_NULL_HANDLE)
+		DestroyBuffer(logicDevice, allocator, buffer, bufferMemory);
+
+	buffer = VK_NULL_HANDLE;
+}
+
+UniformRing::~UniformRing()
+{
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+
+#include "Utils.h"
+
+//one persistently mapped buffer split into a slice per frame in flight, per frame data is bump allocated
+//and bound with dynamic offsets, so nothing is mapped and no descriptor set is written per frame
+class UniformRing
+{
+public:
+	UniformRing();
+
+	void Init(VkPhysicalDevice physDevice, VkDevice newLogicDevice, MemoryAllocator* newAllocator,
+		VkDeviceSize newFrameSize, uint32_t newFrameCount);
+
+	//only once the fence of frameIdx has been waited on, its slice is overwritten from the start
+	void BeginFrame(uint32_t frameIdx);
+
+	//returns the dynamic offset of size bytes in the current slice, *mapped is where to write them
+	uint32_t Allocate(VkDeviceSize size, void** mapped);
+
+	template<typename T>
+	uint32_t Push(const T& data)
+	{
+		void* mapped;
+		auto offset = Allocate(sizeof(T), &mapped);
+		memcpy(mapped, &data, sizeof(T));
+		return offset;
+	}
+
+	VkBuffer GetBuffer();
+	VkDeviceSize GetFrameUsed();
+
+	void Destroy();
+
+	~UniformRing();
+
+private:
+	VkDevice logicDevice;
+	MemoryAllocator* allocator;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation bufferMemory;
+
+	VkDeviceSize alignment = 0;
+	VkDeviceSize frameSize = 0;
+	VkDeviceSize frameStart = 0;
+	VkDeviceSize head = 0;
+};
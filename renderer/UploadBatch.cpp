@@ -0,0 +1,345 @@
+#include "UploadBatch.h"
+
+#include <stdexcept>
+
+UploadBatch::UploadBatch(VkDevice newLogicDevice, MemoryAllocator* newAllocator, UploadQueues newQueues) :
+	logicDevice(newLogicDevice),
+	allocator(newAllocator),
+	queues(newQueues),
+	ownershipTransfer(newQueues.transferFamily != newQueues.graphicsFamily),
+	//host visible blocks are persistently mapped, cached when possible so cooking can read staged data back cheaply
+	stagingProps(newAllocator->PreferProps(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+{
+	BeginCmdBuffers();
+}
+
+void* UploadBatch::CreateStagingBuffer(VkDeviceSize bufferSize, VkBuffer* stagingBuffer)
+{
+	//don't let a big load pin unbounded host memory
+	if (stagingBytes + bufferSize > MAX_STAGING_BYTES && !stagingBuffers.empty())
+		Wait();
+
+	return AppendStagingBuffer(bufferSize, stagingBuffer);
+}
+
+void* UploadBatch::AppendStagingBuffer(VkDeviceSize bufferSize, VkBuffer* stagingBuffer)
+{
+	MemoryAllocation stagingBufferMemory;
+	CreateBuffer(logicDevice, allocator, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingProps,
+		stagingBuffer, &stagingBufferMemory);
+
+	stagingBuffers.push_back(*stagingBuffer);
+	stagingBufferMemories.push_back(stagingBufferMemory);
+	stagingBytes += bufferSize;
+
+	return stagingBufferMemory.mapped;
+}
+
+bool UploadBatch::IsStagingCached()
+{
+	return (stagingProps & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+}
+
+void UploadBatch::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
+{
+	if (submitted)
+		throw std::runtime_error("upload batch recorded after submit");
+
+	RecordCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, bufferSize, srcOffset, dstOffset);
+
+	//only the written range changes owner, the rest of a shared buffer keeps being drawn from
+	if (ownershipTransfer)
+	{
+		VkBufferMemoryBarrier release = {};
+		release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		release.srcQueueFamilyIndex = queues.transferFamily;
+		release.dstQueueFamilyIndex = queues.graphicsFamily;
+		release.buffer = dstBuffer;
+		release.offset = dstOffset;
+		release.size = bufferSize;
+
+		bufferReleases.push_back(release);
+	}
+
+	OnRecorded();
+}
+
+void UploadBatch::CopyImgBuffer(VkBuffer srcBuffer, VkImage dstImg, VkFormat format, uint32_t wid, uint32_t hei, uint32_t baseMipLevel, uint32_t mipLevels)
+{
+	if (submitted)
+		throw std::runtime_error("upload batch recorded after submit");
+
+	RecordCopyImgBuffer(cmdBuffer, srcBuffer, dstImg, format, wid, hei, baseMipLevel, mipLevels);
+	OnRecorded();
+}
+
+void UploadBatch::TransitionImageLayout(VkImage img, VkImageLayout srcLayout, VkImageLayout dstLayout, uint32_t baseMipLevel, uint32_t mipLevels)
+{
+	if (submitted)
+		throw std::runtime_error("upload batch recorded after submit");
+
+	//the transfer queue can't reach the fragment stage, the transition rides on the ownership transfer instead
+	if (ownershipTransfer && dstLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		VkImageMemoryBarrier release = {};
+		release.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		release.oldLayout = srcLayout;
+		release.newLayout = dstLayout;
+		release.srcQueueFamilyIndex = queues.transferFamily;
+		release.dstQueueFamilyIndex = queues.graphicsFamily;
+		release.image = img;
+		release.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		release.subresourceRange.baseMipLevel = baseMipLevel;
+		release.subresourceRange.levelCount = mipLevels;
+		release.subresourceRange.baseArrayLayer = 0;
+		release.subresourceRange.layerCount = 1;
+
+		imageReleases.push_back(release);
+	}
+	else
+	{
+		RecordImageLayoutTransition(cmdBuffer, img, srcLayout, dstLayout, baseMipLevel, mipLevels);
+	}
+
+	OnRecorded();
+}
+
+void UploadBatch::GenerateMips(VkImage img, uint32_t wid, uint32_t hei, uint32_t mipLevels)
+{
+	if (submitted)
+		throw std::runtime_error("upload batch recorded after submit");
+
+	if (!ownershipTransfer)
+	{
+		RecordMipBlits(cmdBuffer, img, wid, hei, mipLevels);
+		OnRecorded();
+		return;
+	}
+
+	//the image changes owner still in transfer dst, the graphics queue blits right after acquiring it
+	VkImageMemoryBarrier release = {};
+	release.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	release.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	release.srcQueueFamilyIndex = queues.transferFamily;
+	release.dstQueueFamilyIndex = queues.graphicsFamily;
+	release.image = img;
+	release.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	release.subresourceRange.baseMipLevel = 0;
+	release.subresourceRange.levelCount = mipLevels;
+	release.subresourceRange.baseArrayLayer = 0;
+	release.subresourceRange.layerCount = 1;
+
+	imageReleases.push_back(release);
+	mipJobs.push_back({ img, wid, hei, mipLevels });
+
+	OnRecorded();
+}
+
+uint64_t UploadBatch::Submit()
+{
+	if (submitted || recordedCount == 0)
+		return timelineValue;
+
+	RecordOwnershipTransfers();
+	vkEndCommandBuffer(cmdBuffer);
+
+	//values on one timeline have to rise in signal order, with two queues each signals its own
+	VkSemaphore transferSemaphore = ownershipTransfer ? queues.transferTimeline : queues.timeline;
+	uint64_t transferValue = ownershipTransfer ? ++(*queues.transferTimelineValue) : ++(*queues.timelineValue);
+
+	VkTimelineSemaphoreSubmitInfo transferTimelineInfo = {};
+	transferTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	transferTimelineInfo.signalSemaphoreValueCount = 1;
+	transferTimelineInfo.pSignalSemaphoreValues = &transferValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &transferTimelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cmdBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &transferSemaphore;
+
+	if (VK_SUCCESS != vkQueueSubmit(queues.transferQueue, 1, &submitInfo, VK_NULL_HANDLE))
+		throw std::runtime_error("failed to submit upload batch");
+
+	if (!ownershipTransfer)
+	{
+		timelineValue = transferValue;
+	}
+	else
+	{
+		vkEndCommandBuffer(acquireCmdBuffer);
+
+		uint64_t acquireValue = ++(*queues.timelineValue);
+
+		VkTimelineSemaphoreSubmitInfo acquireTimelineInfo = {};
+		acquireTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		acquireTimelineInfo.waitSemaphoreValueCount = 1;
+		acquireTimelineInfo.pWaitSemaphoreValues = &transferValue;
+		acquireTimelineInfo.signalSemaphoreValueCount = 1;
+		acquireTimelineInfo.pSignalSemaphoreValues = &acquireValue;
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+		VkSubmitInfo acquireInfo = {};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireInfo.pNext = &acquireTimelineInfo;
+		acquireInfo.waitSemaphoreCount = 1;
+		acquireInfo.pWaitSemaphores = &queues.transferTimeline;
+		acquireInfo.pWaitDstStageMask = &waitStage;
+		acquireInfo.commandBufferCount = 1;
+		acquireInfo.pCommandBuffers = &acquireCmdBuffer;
+		acquireInfo.signalSemaphoreCount = 1;
+		acquireInfo.pSignalSemaphores = &queues.timeline;
+
+		if (VK_SUCCESS != vkQueueSubmit(queues.graphicsQueue, 1, &acquireInfo, VK_NULL_HANDLE))
+			throw std::runtime_error("failed to submit upload acquire");
+
+		timelineValue = acquireValue;
+	}
+
+	submitted = true;
+	++submitCount;
+
+	return timelineValue;
+}
+
+void UploadBatch::Wait()
+{
+	Flush();
+	ReleaseStagingBuffers();
+}
+
+bool UploadBatch::IsComplete()
+{
+	uint64_t reachedValue;
+	vkGetSemaphoreCounterValue(logicDevice, queues.timeline, &reachedValue);
+
+	return reachedValue >= timelineValue;
+}
+
+uint64_t UploadBatch::GetTimelineValue()
+{
+	return timelineValue;
+}
+
+size_t UploadBatch::GetSubmitCount()
+{
+	return submitCount;
+}
+
+UploadBatch::~UploadBatch()
+{
+	//never free anything the gpu may still be reading
+	if (submitted && !IsComplete())
+		Wait();
+
+	ReleaseStagingBuffers();
+
+	vkFreeCommandBuffers(logicDevice, queues.transferCmdPool, 1, &cmdBuffer);
+	if (ownershipTransfer)
+		vkFreeCommandBuffers(logicDevice, queues.graphicsCmdPool, 1, &acquireCmdBuffer);
+}
+
+void UploadBatch::OnRecorded()
+{
+	++recordedCount;
+
+	if (!BATCH_UPLOADS)
+		Flush();
+}
+
+void UploadBatch::Flush()
+{
+	Submit();
+
+	if (!submitted)
+		return;
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &queues.timeline;
+	waitInfo.pValues = &timelineValue;
+
+	vkWaitSemaphores(logicDevice, &waitInfo, DRAW_TIMEOUT);
+
+	//fresh cmd buffers so the batch can keep recording, staging stays alive for copies still to come
+	vkFreeCommandBuffers(logicDevice, queues.transferCmdPool, 1, &cmdBuffer);
+	if (ownershipTransfer)
+		vkFreeCommandBuffers(logicDevice, queues.graphicsCmdPool, 1, &acquireCmdBuffer);
+
+	BeginCmdBuffers();
+	submitted = false;
+}
+
+void UploadBatch::BeginCmdBuffers()
+{
+	cmdBuffer = BeginCmdBuffer(logicDevice, queues.transferCmdPool);
+	if (ownershipTransfer)
+		acquireCmdBuffer = BeginCmdBuffer(logicDevice, queues.graphicsCmdPool);
+
+	recordedCount = 0;
+}
+
+void UploadBatch::RecordOwnershipTransfers()
+{
+	if (bufferReleases.empty() && imageReleases.empty())
+		return;
+
+	//release on the transfer queue
+	for (auto& b : bufferReleases)
+	{
+		b.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		b.dstAccessMask = 0;
+	}
+	for (auto& i : imageReleases)
+	{
+		i.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		i.dstAccessMask = 0;
+	}
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr,
+		static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+		static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+
+	//matching acquire on the graphics queue, chained to the timeline wait at the transfer stage
+	//buffers are read by the draws, by the gpu driven cull, which runs in compute, and by the mesh shaders
+	for (auto& b : bufferReleases)
+	{
+		b.srcAccessMask = 0;
+		b.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	}
+	for (auto& i : imageReleases)
+	{
+		i.srcAccessMask = 0;
+		i.dstAccessMask = i.newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ?
+			VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	vkCmdPipelineBarrier(acquireCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, queues.readStages | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+		static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+
+	for (const auto& job : mipJobs)
+		RecordMipBlits(acquireCmdBuffer, job.img, job.wid, job.hei, job.mipLevels);
+
+	bufferReleases.clear();
+	imageReleases.clear();
+	mipJobs.clear();
+}
+
+void UploadBatch::ReleaseStagingBuffers()
+{
+	for (size_t i = 0; i < stagingBuffers.size(); ++i)
+		DestroyBuffer(logicDevice, allocator, stagingBuffers[i], stagingBufferMemories[i]);
+
+	stagingBuffers.clear();
+	stagingBufferMemories.clear();
+	stagingBytes = 0;
+}
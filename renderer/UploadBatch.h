@@ -0,0 +1,98 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include "Utils.h"
+
+struct UploadQueues
+{
+	VkQueue graphicsQueue;
+	VkCommandPool graphicsCmdPool;
+	uint32_t graphicsFamily;
+
+	//same as graphics when there's no dedicated transfer family
+	VkQueue transferQueue;
+	VkCommandPool transferCmdPool;
+	uint32_t transferFamily;
+
+	VkSemaphore timeline;
+	uint64_t* timelineValue; //last value handed out
+
+	//hands a batch from the transfer queue to the acquire, so the upload timeline is only signalled from the graphics queue
+	VkSemaphore transferTimeline;
+	uint64_t* transferTimelineValue;
+
+	//every stage that reads uploaded data, the task and mesh stages only when the device enabled them
+	VkPipelineStageFlags readStages;
+};
+
+//records all copies/transitions of a load into one cmd buffer, submitted at once and signalling the upload timeline
+class UploadBatch
+{
+public:
+	UploadBatch(VkDevice newLogicDevice, MemoryAllocator* newAllocator, UploadQueues newQueues);
+
+	//mapped staging memory, valid until Wait (a new staging request may flush earlier ones, so copy from it first)
+	void* CreateStagingBuffer(VkDeviceSize bufferSize, VkBuffer* stagingBuffer);
+	//the same without the flush, for data staged in parts before any copy from the earlier parts is recorded
+	void* AppendStagingBuffer(VkDeviceSize bufferSize, VkBuffer* stagingBuffer);
+	//false when the device has no host cached memory to stage in, reading staged data back is slow then
+	bool IsStagingCached();
+
+	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize, VkDeviceSize srcOffset, VkDeviceSize dstOffset);
+	//the buffer holds mipLevels packed levels starting at baseMipLevel, wid and hei are level 0's
+	void CopyImgBuffer(VkBuffer srcBuffer, VkImage dstImg, VkFormat format, uint32_t wid, uint32_t hei, uint32_t baseMipLevel, uint32_t mipLevels);
+	void TransitionImageLayout(VkImage img, VkImageLayout srcLayout, VkImageLayout dstLayout, uint32_t baseMipLevel, uint32_t mipLevels);
+	//level 0 copied and all levels in transfer dst, leaves every level shader readable
+	//blits need a graphics queue, behind a dedicated transfer queue they run after the ownership acquire
+	void GenerateMips(VkImage img, uint32_t wid, uint32_t hei, uint32_t mipLevels);
+
+	//doesn't block, the returned timeline value is reached once everything is usable on the graphics queue
+	uint64_t Submit();
+	void Wait();
+	bool IsComplete();
+
+	uint64_t GetTimelineValue();
+	size_t GetSubmitCount();
+
+	~UploadBatch();
+
+private:
+	VkDevice logicDevice;
+	MemoryAllocator* allocator;
+	UploadQueues queues;
+	bool ownershipTransfer;
+	VkMemoryPropertyFlags stagingProps;
+
+	VkCommandBuffer cmdBuffer;
+	VkCommandBuffer acquireCmdBuffer = VK_NULL_HANDLE;
+
+	std::vector<VkBufferMemoryBarrier> bufferReleases;
+	std::vector<VkImageMemoryBarrier> imageReleases;
+
+	struct MipJob
+	{
+		VkImage img;
+		uint32_t wid;
+		uint32_t hei;
+		uint32_t mipLevels;
+	};
+	std::vector<MipJob> mipJobs; //blitted in the acquire cmd buffer
+
+	size_t recordedCount = 0;
+	size_t submitCount = 0;
+	bool submitted = false;
+	uint64_t timelineValue = 0;
+
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<MemoryAllocation> stagingBufferMemories;
+	VkDeviceSize stagingBytes = 0;
+
+	void OnRecorded();
+	void Flush();
+	void BeginCmdBuffers();
+	void RecordOwnershipTransfers();
+	void ReleaseStagingBuffers();
+};
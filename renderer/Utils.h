@@ -4,11 +4,106 @@
 #include <fstream>
 #include "glm/glm.hpp"
 #include <GLFW/glfw3.h>
+#include "MemoryAllocator.h"
+
 const int MAX_QUEUED_DRAWS = 2;
 const int MAX_MESHES = 200;
 const int MAX_TEXTURES = 200;
 const uint64_t DRAW_TIMEOUT = std::numeric_limits<uint64_t>::max();
 
+//false = submit and wait after every copy/transition, the old per-resource path (for load time comparison)
+const bool BATCH_UPLOADS = true;
+const VkDeviceSize MAX_STAGING_BYTES = 256 * 1024 * 1024;
+
+//uploads go through a transfer-only queue family when the gpu has one
+const bool USE_TRANSFER_QUEUE = true;
+
+//sub-allocator block size, resources of half a block or more get a dedicated allocation
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize DEDICATED_ALLOC_SIZE = MEMORY_BLOCK_SIZE / 2;
+const VkDeviceSize MIN_ALLOC_SIZE = 256;
+
+//shared geometry buffers, in elements
+const uint32_t GEOMETRY_POOL_VERTICES = 4 * 1024 * 1024;
+//indices leave room for the lod levels (less than the full mesh again) and, when mesh shading, meshlet vertices and triangles
+const uint32_t GEOMETRY_POOL_INDICES = 24 * 1024 * 1024;
+
+//bump whenever Vertex or the cooked layout changes, older .cooked files get rebuilt
+const uint32_t MESH_CACHE_VERSION = 9;
+
+//loader worker threads, 0 = one per hardware thread besides the main one
+const size_t WORKER_THREADS = 0;
+
+//per frame in flight slice of the uniform ring, everything written for one frame has to fit
+const VkDeviceSize UNIFORM_RING_FRAME_SIZE = 4 * 1024 * 1024;
+
+//entries in the per-frame object buffer, reserved in full from the ring every frame
+const uint32_t MAX_OBJECTS = 16384;
+//object ids of every drawn mesh instance, reserved per frame like the object buffer
+const uint32_t MAX_INSTANCES = 65536;
+
+//threads recording the scene into secondary cmd buffers, 1 = inline on the main thread, 0 = whole worker pool
+const size_t RECORD_THREADS = 0;
+//below this many draws per slice a worker costs more than it saves
+const size_t MIN_RECORD_SLICE_DRAWS = 256;
+
+//cull on the gpu and draw with indirect count commands when the device supports them
+const bool GPU_DRIVEN = true;
+//two phase hi-z occlusion test in the gpu cull, false = frustum only
+const bool OCCLUSION_CULLING = true;
+
+//cpu occlusion for the non gpu driven path: big meshes are simplified into occluders at load
+//and rasterized into a small depth buffer every frame, height follows the swapchain aspect
+const bool CPU_OCCLUSION_CULLING = true;
+const uint32_t OCCLUSION_BUFFER_WIDTH = 256;
+const uint32_t OCCLUDER_GRID_CELLS = 16;
+//meshes with a bounding sphere smaller than this part of the model's biggest get no occluder
+const float OCCLUDER_MIN_RADIUS_RATIO = 0.25f;
+
+//simplified levels cooked per mesh, level 0 is the full mesh, each next one aims for LOD_REDUCTION of its triangles
+const uint32_t MAX_MESH_LODS = 4;
+const float LOD_REDUCTION = 0.5f;
+//no level strays further from the full mesh than this part of its bounding radius
+const float LOD_MAX_ERROR = 0.05f;
+//smaller meshes only have the full level
+const uint32_t LOD_MIN_TRIANGLES = 64;
+//draws use the coarsest level whose error projects to at most this many pixels, going coarser
+//again needs the error LOD_HYSTERESIS below that so draws near the switch distance don't flicker
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_HYSTERESIS = 0.25f;
+
+//full meshes are cut into meshlets at cook time, draws at level 0 skip the ones facing away or outside the frustum
+const bool CLUSTER_CULLING = true;
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+//meshlets of every mesh on the gpu draw list, more than this and it draws whole meshes
+const uint32_t MAX_GPU_MESHLETS = 262144;
+//gpu driven full level meshlet draws go through task and mesh shaders when the device has VK_EXT_mesh_shader
+const bool MESH_SHADING = true;
+
+//textures get their full mip chain, blitted on the graphics queue when the format can be linearly blitted
+//false = only the top level, the old path (for bandwidth comparison)
+const bool GENERATE_MIPS = true;
+//false = always box filter on the cpu like the texture cooker does, even when the gpu could blit
+const bool GPU_MIPS = true;
+//a block compressed .ktx2 (or .dds) next to a texture's source is loaded instead of it when the device samples bc formats
+//cook them with --cook-textures, the source still loads when there is none
+const bool BC_TEXTURES = true;
+//textures are shared by canonical path, with this also by file content, so copies under another name load once too
+const bool DEDUP_TEXTURE_CONTENT = true;
+//material textures decode on the workers while the scene draws with the fallback texture, each one is swapped in once uploaded
+//false = CreateMeshModel decodes and uploads them before returning, the old path (for time to first frame comparison)
+const bool STREAM_TEXTURES = true;
+//levels no larger than this go up first in one small upload, the larger ones follow within the per frame budget
+const uint32_t STREAM_TAIL_SIZE = 64;
+const VkDeviceSize STREAM_BYTES_PER_FRAME = 32 * 1024 * 1024;
+
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 1000.0f;
+
+//print per-frame record and culling counters every this many frames, 0 = never
+const uint32_t STATS_PRINT_FRAMES = 600;
+
 const std::vector<const char*> wantedDeviceExtensions =
 {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -21,10 +116,58 @@ struct Vertex
 	glm::vec2 uv;
 };
 
+//one simplified level of a mesh, indices into the model's lod index array, relative to the mesh's first vertex
+struct MeshLod
+{
+	uint64_t firstIndex;
+	uint32_t indexCount;
+	float error; //object space distance to the full mesh
+};
+
+//a contiguous run of its mesh's full index list, at most MESHLET_MAX_VERTICES / MESHLET_MAX_TRIANGLES, std430 compatible
+struct Meshlet
+{
+	uint32_t firstIndex; //relative to the mesh's first index
+	uint32_t indexCount;
+	//into its mesh's meshlet vertices, the mesh local vertices the triangles use, for the mesh shader
+	uint32_t vertexOffset;
+	uint32_t vertexCount;
+	glm::vec4 sphere; //local space
+	//xyz average normal, w cutoff: every triangle faces away from a camera at c when
+	//dot(sphere.xyz - c, cone.xyz) >= cone.w * length(sphere.xyz - c) + sphere.w
+	glm::vec4 cone;
+};
+
+//where one mesh sits inside a model's packed vertex/index arrays, in elements
+struct MeshRange
+{
+	uint64_t firstVertex;
+	uint64_t firstIndex;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t materialIdx;
+	uint32_t lodCount; //simplified levels, the full mesh isn't one of them
+
+	//local space, filled while converting
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec4 sphere; //xyz center, w radius
+
+	MeshLod lods[MAX_MESH_LODS - 1]; //coarser with every level
+
+	//into the model's meshlet array, they cover the full index list in order
+	uint64_t firstMeshlet;
+	uint32_t meshletCount;
+	//into the model's meshlet vertices, its meshlet triangles start at firstIndex / 3 (one packed uint32 per triangle)
+	uint32_t meshletVertexCount;
+	uint64_t firstMeshletVertex;
+};
+
 struct QueueFamilyIndices
 {
 	int graphicsFamily = -1;
 	int presentationFamily = -1;
+	int transferFamily = -1; //dedicated, without graphics
 
 	bool IsValid()
 	{
@@ -80,8 +223,8 @@ static uint32_t FindMemoryTypeIndex(VkPhysicalDevice physDevice, uint32_t allowe
 	throw std::runtime_error("failed to allocate memory for vb");
 }
 
-static void CreateBuffer(VkPhysicalDevice physDevice, VkDevice logicDevice, VkDeviceSize bufferSize,
-	VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProps, VkBuffer* buffer, VkDeviceMemory* bufferMemory)
+static void CreateBuffer(VkDevice logicDevice, MemoryAllocator* allocator, VkDeviceSize bufferSize,
+	VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProps, VkBuffer* buffer, MemoryAllocation* bufferMemory)
 {
 	VkBufferCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -95,15 +238,15 @@ static void CreateBuffer(VkPhysicalDevice physDevice, VkDevice logicDevice, VkDe
 	VkMemoryRequirements memReq;
 	vkGetBufferMemoryRequirements(logicDevice, *buffer, &memReq);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memReq.size;
-	allocInfo.memoryTypeIndex = FindMemoryTypeIndex(physDevice, memReq.memoryTypeBits, bufferProps);
+	*bufferMemory = allocator->Allocate(memReq, bufferProps, true);
 
-	if (vkAllocateMemory(logicDevice, &allocInfo, nullptr, bufferMemory) != VK_SUCCESS)
-		throw std::runtime_error("failed to alloc buffer");
+	vkBindBufferMemory(logicDevice, *buffer, bufferMemory->memory, bufferMemory->offset);
+}
 
-	vkBindBufferMemory(logicDevice, *buffer, *bufferMemory, 0);
+static void DestroyBuffer(VkDevice logicDevice, MemoryAllocator* allocator, VkBuffer buffer, const MemoryAllocation& bufferMemory)
+{
+	vkDestroyBuffer(logicDevice, buffer, nullptr);
+	allocator->Free(bufferMemory);
 }
 
 static VkCommandBuffer BeginCmdBuffer(VkDevice logicDevice, VkCommandPool cmdPool)
@@ -127,103 +270,188 @@ static VkCommandBuffer BeginCmdBuffer(VkDevice logicDevice, VkCommandPool cmdPoo
 	return cmdBuffer;
 }
 
-static void EndAndSubmitCmdBuffer(VkDevice logicDevice, VkCommandPool cmdPool, VkQueue queue, VkCommandBuffer cmdBuffer)
+static void RecordCopyBuffer(VkCommandBuffer cmdBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize,
+	VkDeviceSize srcOffset, VkDeviceSize dstOffset)
 {
-	vkEndCommandBuffer(cmdBuffer);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &cmdBuffer;
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = srcOffset;
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = bufferSize;
 
-	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-
-	vkQueueWaitIdle(queue);
-	vkFreeCommandBuffers(logicDevice, cmdPool, 1, &cmdBuffer);
+	vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 }
 
-static void CopyBuffer(VkDevice logicDevice, VkQueue transferQ, VkCommandPool transferCmdPool,
-	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
+//bytes of one wid x hei level, block compressed formats round up to whole 4x4 blocks
+static VkDeviceSize GetImageLevelSize(VkFormat format, uint32_t wid, uint32_t hei)
 {
-	auto transferCmdBuffer = BeginCmdBuffer(logicDevice, transferCmdPool);
-	{
-		VkBufferCopy copyRegion = {};
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
-		copyRegion.size = bufferSize;
+	VkDeviceSize blocks = static_cast<VkDeviceSize>((wid + 3) / 4) * ((hei + 3) / 4);
 
-		vkCmdCopyBuffer(transferCmdBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		return blocks * 8;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return blocks * 16;
+	default:
+		return static_cast<VkDeviceSize>(wid) * hei * 4;
 	}
-	EndAndSubmitCmdBuffer(logicDevice, transferCmdPool, transferQ, transferCmdBuffer);
 }
 
-static void CopyImgBuffer(VkDevice logicDevice, VkQueue transferQ, VkCommandPool transferCmdPool,
-	VkBuffer srcBuffer, VkImage dstImg, uint32_t wid, uint32_t hei)
+//levels packed one after the other in the buffer, level 0 first, like MipChain lays them out
+static void RecordCopyImgBuffer(VkCommandBuffer cmdBuffer, VkBuffer srcBuffer, VkImage dstImg, VkFormat format,
+	uint32_t wid, uint32_t hei, uint32_t baseMipLevel, uint32_t mipLevels)
 {
-	auto transferCmdBuffer = BeginCmdBuffer(logicDevice, transferCmdPool);
+	std::vector<VkBufferImageCopy> imgRegions(mipLevels);
+	VkDeviceSize bufferOffset = 0;
+
+	//wid and hei are level 0's, the buffer starts at baseMipLevel
+	wid = std::max(wid >> baseMipLevel, 1u);
+	hei = std::max(hei >> baseMipLevel, 1u);
+
+	for (uint32_t level = baseMipLevel; level < baseMipLevel + mipLevels; ++level)
 	{
-		VkBufferImageCopy imgRegion = {};
-		imgRegion.bufferOffset = 0;
+		auto& imgRegion = imgRegions[level - baseMipLevel];
+		imgRegion = {};
+		imgRegion.bufferOffset = bufferOffset;
 		imgRegion.bufferRowLength = 0;
 		imgRegion.bufferImageHeight = 0;
 		imgRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imgRegion.imageSubresource.mipLevel = 0;
+		imgRegion.imageSubresource.mipLevel = level;
 		imgRegion.imageSubresource.baseArrayLayer = 0;
 		imgRegion.imageSubresource.layerCount = 1;
 		imgRegion.imageOffset = { 0, 0, 0 };
 		imgRegion.imageExtent = { wid, hei, 1 };
 
-		vkCmdCopyBufferToImage(transferCmdBuffer, srcBuffer, dstImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imgRegion);
+		bufferOffset += GetImageLevelSize(format, wid, hei);
+		wid = std::max(wid / 2, 1u);
+		hei = std::max(hei / 2, 1u);
 	}
-	EndAndSubmitCmdBuffer(logicDevice, transferCmdPool, transferQ, transferCmdBuffer);
+
+	vkCmdCopyBufferToImage(cmdBuffer, srcBuffer, dstImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, imgRegions.data());
 }
 
-static void TransitionImageLayout(VkDevice logicDevice, VkQueue queue, VkCommandPool cmdPool, VkImage img,
-	VkImageLayout srcLayout, VkImageLayout dstLayout)
+static void RecordImageLayoutTransition(VkCommandBuffer cmdBuffer, VkImage img, VkImageLayout srcLayout, VkImageLayout dstLayout,
+	uint32_t baseMipLevel, uint32_t mipLevels)
 {
-	auto cmdBuffer = BeginCmdBuffer(logicDevice, cmdPool);
+	VkImageMemoryBarrier imgMemBarrier = {};
+	imgMemBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imgMemBarrier.oldLayout = srcLayout;
+	imgMemBarrier.newLayout = dstLayout;
+	imgMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imgMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imgMemBarrier.image = img;
+	imgMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imgMemBarrier.subresourceRange.baseMipLevel = baseMipLevel;
+	imgMemBarrier.subresourceRange.levelCount = mipLevels;
+	imgMemBarrier.subresourceRange.baseArrayLayer = 0;
+	imgMemBarrier.subresourceRange.layerCount = 1;
+
+	VkPipelineStageFlags srcStage, dstStage;
+
+	if (srcLayout == VK_IMAGE_LAYOUT_UNDEFINED && dstLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
 	{
-		VkImageMemoryBarrier imgMemBarrier = {};
-		imgMemBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imgMemBarrier.oldLayout = srcLayout;
-		imgMemBarrier.newLayout = dstLayout;
-		imgMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imgMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imgMemBarrier.image = img;
-		imgMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imgMemBarrier.subresourceRange.baseMipLevel = 0;
-		imgMemBarrier.subresourceRange.levelCount = 1;
-		imgMemBarrier.subresourceRange.baseArrayLayer = 0;
-		imgMemBarrier.subresourceRange.layerCount = 1;
-
-		VkPipelineStageFlags srcStage, dstStage;
-
-		if (srcLayout == VK_IMAGE_LAYOUT_UNDEFINED && dstLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-		{
-			imgMemBarrier.srcAccessMask = 0;
-			imgMemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imgMemBarrier.srcAccessMask = 0;
+		imgMemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 
-			srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		}
-		else if (srcLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && dstLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-		{
-			imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imgMemBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	else if (srcLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && dstLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imgMemBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-			srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		}
+		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+	else
+	{
+		throw std::runtime_error("unsupported layout transition");
+	}
+
+	vkCmdPipelineBarrier
+	(
+		cmdBuffer,
+		srcStage, dstStage, //pipeline
+		0, //dependency
+		0, nullptr, //global memory
+		0, nullptr, //buffer memory
+		1, &imgMemBarrier //img
+	);
+}
 
-		vkCmdPipelineBarrier
-		(
-			cmdBuffer,
-			srcStage, dstStage, //pipeline
-			0, //dependency
-			0, nullptr, //global memory
-			0, nullptr, //buffer memory
-			1, &imgMemBarrier //img
-		);
+//level 0 written and every level in transfer dst, each level is linearly blitted from the one before it
+//and moved on to shader read as soon as nothing reads it anymore, needs a graphics queue
+static void RecordMipBlits(VkCommandBuffer cmdBuffer, VkImage img, uint32_t wid, uint32_t hei, uint32_t mipLevels)
+{
+	VkImageMemoryBarrier imgMemBarrier = {};
+	imgMemBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imgMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imgMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imgMemBarrier.image = img;
+	imgMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imgMemBarrier.subresourceRange.levelCount = 1;
+	imgMemBarrier.subresourceRange.baseArrayLayer = 0;
+	imgMemBarrier.subresourceRange.layerCount = 1;
+
+	auto srcWid = static_cast<int32_t>(wid);
+	auto srcHei = static_cast<int32_t>(hei);
+
+	for (uint32_t level = 1; level < mipLevels; ++level)
+	{
+		imgMemBarrier.subresourceRange.baseMipLevel = level - 1;
+		imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imgMemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &imgMemBarrier);
+
+		auto dstWid = std::max(srcWid / 2, 1);
+		auto dstHei = std::max(srcHei / 2, 1);
+
+		VkImageBlit blit = {};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { srcWid, srcHei, 1 };
+		blit.dstSubresource = blit.srcSubresource;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { dstWid, dstHei, 1 };
+
+		vkCmdBlitImage(cmdBuffer, img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imgMemBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &imgMemBarrier);
+
+		srcWid = dstWid;
+		srcHei = dstHei;
 	}
-	EndAndSubmitCmdBuffer(logicDevice, cmdPool, queue, cmdBuffer);
+
+	//the last level was only ever written
+	imgMemBarrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	imgMemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imgMemBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imgMemBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imgMemBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &imgMemBarrier);
 }
\ No newline at end of file
@@ -3,7 +3,8 @@
 #include <iostream>
 #include <string>
 
-VulkanRenderer::VulkanRenderer()
+VulkanRenderer::VulkanRenderer() :
+	threadPool(WORKER_THREADS)
 {
 }
 
@@ -17,6 +18,10 @@ int VulkanRenderer::Init(GLFWwindow* window)
 		CreateSurface();
 		GetPhysicalDevice();
 		CreateLogicalDevice();
+		memoryAllocator.Init(mainDevice.physicalDevice, mainDevice.logicalDevice);
+		geometryPool.Init(mainDevice.logicalDevice, &memoryAllocator, GEOMETRY_POOL_VERTICES, GEOMETRY_POOL_INDICES);
+		uniformRing.Init(mainDevice.physicalDevice, mainDevice.logicalDevice, &memoryAllocator,
+			UNIFORM_RING_FRAME_SIZE, MAX_QUEUED_DRAWS);
 		CreateSwapchain();
 
 		CreateColorBuffers();
@@ -24,7 +29,21 @@ int VulkanRenderer::Init(GLFWwindow* window)
 
 		CreateRenderPass();
 		CreateDescriptorSetLayouts();
-		CreatePushConstantRange();
+		if (gpuDriven)
+		{
+			std::vector<VkImageView> depthViews;
+			for (const auto& depthBuffer : depthBuffers)
+				depthViews.push_back(depthBuffer.imgView);
+
+			hiZPyramid.Init(mainDevice.logicalDevice, &memoryAllocator, swapchainImgExtent, depthViews);
+			gpuDrawList.Init(mainDevice.physicalDevice, mainDevice.logicalDevice, &memoryAllocator, descriptorSetLayout,
+				&uniformRing, &hiZPyramid, MAX_INSTANCES, &geometryPool, meshShading);
+		}
+		else if (CPU_OCCLUSION_CULLING)
+		{
+			occlusionBuffer.Init(OCCLUSION_BUFFER_WIDTH,
+				std::max(OCCLUSION_BUFFER_WIDTH * swapchainImgExtent.height / swapchainImgExtent.width, 1u));
+		}
 		CreateGraphicsPipeline();
 		CreateBlitPipeline();
 
@@ -33,13 +52,17 @@ int VulkanRenderer::Init(GLFWwindow* window)
 		CreateCommandPool();
 
 		CreateCommandBuffers();
-		CreateUniformBuffers();
+		CreateRecordCommandBuffers();
 		CreateDescriptorPools();
 		CreateDescriptorSets();
 		CreateInputDescriptorSets();
 		CreateSyncObjects();
 
-		CreateTexture("plain.jpg");
+		//the fallback texture is needed by everything, wait for it right away
+		UploadBatch uploadBatch(mainDevice.logicalDevice, &memoryAllocator, GetUploadQueues());
+		//registered like any other texture but never released, so it keeps id 0
+		CreateTextures({ "plain.jpg" }, &uploadBatch, false);
+		uploadBatch.Wait();
 
 		InitScene();
 	}
@@ -55,7 +78,7 @@ int VulkanRenderer::Init(GLFWwindow* window)
 void VulkanRenderer::InitScene()
 {
 	uboViewProjection.projection = glm::perspective(glm::radians(60.0f),
-		static_cast<float>(swapchainImgExtent.width) / static_cast<float>(swapchainImgExtent.height), 0.1f, 1000.0f);
+		static_cast<float>(swapchainImgExtent.width) / static_cast<float>(swapchainImgExtent.height), NEAR_PLANE, FAR_PLANE);
 
 	uboViewProjection.view = glm::lookAt
 	(
@@ -72,6 +95,9 @@ void VulkanRenderer::Draw()
 	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[frameIdx], VK_TRUE, DRAW_TIMEOUT);
 	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[frameIdx]);
 
+	CollectFinishedUploads();
+	UpdateTextureStreams();
+
 	uint32_t imgIdx;
 	if (VK_SUCCESS != vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, DRAW_TIMEOUT,
 		semsImgAvailable[frameIdx], VK_NULL_HANDLE, &imgIdx))
@@ -79,14 +105,26 @@ void VulkanRenderer::Draw()
 		throw std::runtime_error("failed to acquire img");
 	}
 
+	//the fence above freed this frame's slice of the ring, offsets must be known before recording
+	UpdateUniformBuffers();
 	RecordCommands(imgIdx);
-	UpdateUniformBuffers(imgIdx);
+
+	//the binary img semaphore ignores its value, the timeline one makes this frame's uploads visible
+	//the gpu driven cull runs first in the frame and reads uploaded data too, so compute waits as well
+	std::array<VkSemaphore, 2> waitSems = { semsImgAvailable[frameIdx], uploadTimeline };
+	std::array<uint64_t, 2> waitValues = { 0, frameUploadValue };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, GetUploadReadStages() };
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &semsImgAvailable[frameIdx];
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSems.size());
+	submitInfo.pWaitSemaphores = waitSems.data();
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[imgIdx];
@@ -109,6 +147,16 @@ void VulkanRenderer::Draw()
 		throw std::runtime_error("failed to present img");
 	}
 
+	++frameCount;
+	if (STATS_PRINT_FRAMES > 0 && frameCount % STATS_PRINT_FRAMES == 0)
+	{
+		std::cout << "frame " << frameCount << ": " << recordStats.visible << " visible, " << recordStats.culled << " culled ("
+			<< recordStats.occluded << " occluded), "
+			<< recordStats.draws << " draws for " << recordStats.instances << " instances, " << recordStats.bindsSaved
+			<< " binds saved, " << recordStats.disoccluded << " disoccluded, " << recordStats.triangles << " triangles, "
+			<< recordStats.clustersCulled << " clusters culled" << std::endl;
+	}
+
 	frameIdx = ++frameIdx % MAX_QUEUED_DRAWS;
 }
 
@@ -116,8 +164,26 @@ void VulkanRenderer::Cleanup()
 {
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
 
-	for (size_t i = 0; i < models.size(); ++i)
-		models[i].DestroyMeshModel();
+	//decodes still running write into their streams and read renderer state
+	{
+		std::unique_lock<std::mutex> lock(streamMutex);
+		streamCv.wait(lock, [this]() { return decodingStreams == 0; });
+	}
+	textureStreams.clear();
+	RecycleTextureSets(true);
+
+	pendingUploads.clear();
+
+	//models only hold copies of the shared meshes, free each pool range once
+	for (auto& g : sharedGeometry)
+	{
+		for (auto& m : g.second.meshes)
+			m.DestroyBuffers();
+	}
+	sharedGeometry.clear();
+	models.clear();
+
+	geometryPool.Destroy();
 
 	vkDestroyDescriptorPool(mainDevice.logicalDevice, inputDescriptorPool, nullptr);
 
@@ -130,33 +196,35 @@ void VulkanRenderer::Cleanup()
 
 	for (size_t i = 0; i < texImages.size(); ++i)
 	{
+		//released slots nothing was loaded into again
+		if (texImages[i] == VK_NULL_HANDLE)
+			continue;
+
 		vkDestroyImageView(mainDevice.logicalDevice, texImgViews[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, texImages[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, texImgMemories[i], nullptr);
+		memoryAllocator.Free(texImgMemories[i]);
 	}
 
 	for (size_t i = 0; i < depthBuffers.size(); ++i)
 	{
 		vkDestroyImageView(mainDevice.logicalDevice, depthBuffers[i].imgView, nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, depthBuffers[i].img, nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, depthBuffers[i].memory, nullptr);
+		memoryAllocator.Free(depthBuffers[i].memory);
 	}
 
 	for (size_t i = 0; i < colorBuffers.size(); ++i)
 	{
 		vkDestroyImageView(mainDevice.logicalDevice, colorBuffers[i].imgView, nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, colorBuffers[i].img, nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, colorBuffers[i].memory, nullptr);
+		memoryAllocator.Free(colorBuffers[i].memory);
 	}
 
 	vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
 
-	for (const auto& ub : vpUniformBuffers)
-		vkDestroyBuffer(mainDevice.logicalDevice, ub, nullptr);
-
-	for (const auto& ubm : vpUniformBufferMemories)
-		vkFreeMemory(mainDevice.logicalDevice, ubm, nullptr);
+	gpuDrawList.Destroy();
+	hiZPyramid.Destroy();
+	uniformRing.Destroy();
 
 	for (size_t i = 0; i < MAX_QUEUED_DRAWS; ++i)
 	{
@@ -164,6 +232,11 @@ void VulkanRenderer::Cleanup()
 		vkDestroySemaphore(mainDevice.logicalDevice, semsImgAvailable[i], nullptr);
 		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], nullptr);
 	}
+	vkDestroySemaphore(mainDevice.logicalDevice, uploadTimeline, nullptr);
+	vkDestroySemaphore(mainDevice.logicalDevice, uploadTransferTimeline, nullptr);
+	for (auto pool : recordCommandPools)
+		vkDestroyCommandPool(mainDevice.logicalDevice, pool, nullptr);
+	vkDestroyCommandPool(mainDevice.logicalDevice, transferCommandPool, nullptr);
 	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
 	for (const auto fb : swapchainFramebuffers)
 		vkDestroyFramebuffer(mainDevice.logicalDevice, fb, nullptr);
@@ -172,12 +245,20 @@ void VulkanRenderer::Cleanup()
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, blitLayout, nullptr);
 	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
+	if (meshShading)
+	{
+		vkDestroyPipeline(mainDevice.logicalDevice, meshPipeline, nullptr);
+		vkDestroyPipelineLayout(mainDevice.logicalDevice, meshPipelineLayout, nullptr);
+	}
 
 	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, nullptr);
+	if (gpuDriven)
+		vkDestroyRenderPass(mainDevice.logicalDevice, earlyRenderPass, nullptr);
 	for (const auto image : swapchainImages)
 		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, nullptr);
 	vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
 	vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+	memoryAllocator.Destroy();
 	vkDestroyDevice(mainDevice.logicalDevice, nullptr);
 	vkDestroyInstance(vkInstance, nullptr);
 }
@@ -284,6 +365,8 @@ void VulkanRenderer::CreateLogicalDevice()
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+	if (USE_TRANSFER_QUEUE && indices.transferFamily >= 0)
+		queueFamilyIndices.insert(indices.transferFamily);
 
 	for (int familyIndex : queueFamilyIndices)
 	{
@@ -301,19 +384,85 @@ void VulkanRenderer::CreateLogicalDevice()
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(wantedDeviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = wantedDeviceExtensions.data();
+	auto deviceExtensions = wantedDeviceExtensions;
+
+	//indirect count draws are optional, without them the cpu culls and records every draw
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(mainDevice.physicalDevice, &supportedFeatures);
+
+	VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+	supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedFeatures12;
+	vkGetPhysicalDeviceFeatures2(mainDevice.physicalDevice, &supportedFeatures2);
+
+	gpuDriven = GPU_DRIVEN && supportedFeatures.drawIndirectFirstInstance && supportedFeatures12.drawIndirectCount;
+	bcTextures = BC_TEXTURES && supportedFeatures.textureCompressionBC;
+
+	//task and mesh shaders need the gpu cull to feed them
+	meshShading = false;
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshFeatures = {};
+	meshFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+	uint32_t extCount = 0;
+	vkEnumerateDeviceExtensionProperties(mainDevice.physicalDevice, nullptr, &extCount, nullptr);
+	std::vector<VkExtensionProperties> deviceExtList(extCount);
+	vkEnumerateDeviceExtensionProperties(mainDevice.physicalDevice, nullptr, &extCount, deviceExtList.data());
+
+	bool hasMeshExtension = false;
+	for (const auto& devExt : deviceExtList)
+		hasMeshExtension = hasMeshExtension || 0 == strcmp(devExt.extensionName, VK_EXT_MESH_SHADER_EXTENSION_NAME);
+
+	if (MESH_SHADING && gpuDriven && hasMeshExtension)
+	{
+		supportedFeatures12.pNext = &meshFeatures;
+		vkGetPhysicalDeviceFeatures2(mainDevice.physicalDevice, &supportedFeatures2);
+		supportedFeatures12.pNext = nullptr;
+
+		meshShading = meshFeatures.taskShader && meshFeatures.meshShader;
+	}
+
+	if (meshShading)
+	{
+		//only what the pipeline uses, the rest of the struct stays off
+		meshFeatures = {};
+		meshFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+		meshFeatures.taskShader = VK_TRUE;
+		meshFeatures.meshShader = VK_TRUE;
+		deviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	}
+	std::cout << "geometry path: " << (meshShading ? "task + mesh shaders" : gpuDriven ? "vertex, gpu driven" : "vertex, cpu culled") << std::endl;
+
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.drawIndirectFirstInstance = gpuDriven;
+	deviceFeatures.textureCompressionBC = bcTextures;
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
+	VkPhysicalDeviceVulkan12Features features12 = {};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.drawIndirectCount = gpuDriven;
+	deviceCreateInfo.pNext = &features12;
+	if (meshShading)
+		features12.pNext = &meshFeatures;
+
 	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, nullptr, &mainDevice.logicalDevice);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to create a logical device");
 
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);
+
+	if (USE_TRANSFER_QUEUE && indices.transferFamily >= 0)
+		vkGetDeviceQueue(mainDevice.logicalDevice, indices.transferFamily, 0, &transferQueue);
+	else
+		transferQueue = graphicsQueue;
 }
 
 void VulkanRenderer::CreateSurface()
@@ -386,7 +535,7 @@ void VulkanRenderer::CreateSwapchain()
 	{
 		SwapchainImage newImage = {};
 		newImage.image = image;
-		newImage.imageView = CreateImageView(image, swapchainImgFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		newImage.imageView = CreateImageView(image, swapchainImgFormat, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
 
 		swapchainImages.push_back(newImage);
 	}
@@ -504,8 +653,8 @@ void VulkanRenderer::CreateGraphicsPipeline()
 	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	layoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
 	layoutCreateInfo.pSetLayouts = setLayouts.data();
-	layoutCreateInfo.pushConstantRangeCount = 1;
-	layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	layoutCreateInfo.pushConstantRangeCount = 0;
+	layoutCreateInfo.pPushConstantRanges = nullptr;
 
 	auto result = vkCreatePipelineLayout(mainDevice.logicalDevice, &layoutCreateInfo, nullptr, &pipelineLayout);
 	if (result != VK_SUCCESS)
@@ -539,6 +688,53 @@ void VulkanRenderer::CreateGraphicsPipeline()
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to create graphics pipeline");
 
+	//task and mesh shaders in place of the vertex stage, same fragment shader, raster state and subpass
+	if (meshShading)
+	{
+		auto taskModule = CreateShaderModule(ReadFile("Shaders/meshlet_task.spv"));
+		auto meshModule = CreateShaderModule(ReadFile("Shaders/meshlet_mesh.spv"));
+
+		VkPipelineShaderStageCreateInfo taskCreateInfo = vertCreateInfo;
+		taskCreateInfo.stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+		taskCreateInfo.module = taskModule;
+
+		VkPipelineShaderStageCreateInfo meshCreateInfo = vertCreateInfo;
+		meshCreateInfo.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+		meshCreateInfo.module = meshModule;
+
+		VkPipelineShaderStageCreateInfo meshShaderStages[] = { taskCreateInfo, meshCreateInfo, fragCreateInfo };
+
+		//the bucket's first command slot
+		VkPushConstantRange pushRange = {};
+		pushRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+		pushRange.offset = 0;
+		pushRange.size = sizeof(uint32_t);
+
+		std::array<VkDescriptorSetLayout, 3> meshSetLayouts = { descriptorSetLayout, samplerSetLayout, gpuDrawList.GetMeshSetLayout() };
+
+		VkPipelineLayoutCreateInfo meshLayoutCreateInfo = layoutCreateInfo;
+		meshLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(meshSetLayouts.size());
+		meshLayoutCreateInfo.pSetLayouts = meshSetLayouts.data();
+		meshLayoutCreateInfo.pushConstantRangeCount = 1;
+		meshLayoutCreateInfo.pPushConstantRanges = &pushRange;
+
+		if (VK_SUCCESS != vkCreatePipelineLayout(mainDevice.logicalDevice, &meshLayoutCreateInfo, nullptr, &meshPipelineLayout))
+			throw std::runtime_error("failed to create mesh pipeline layout");
+
+		VkGraphicsPipelineCreateInfo meshPipeCreateInfo = pipeCreateInfo;
+		meshPipeCreateInfo.stageCount = 3;
+		meshPipeCreateInfo.pStages = meshShaderStages;
+		meshPipeCreateInfo.pVertexInputState = nullptr;
+		meshPipeCreateInfo.pInputAssemblyState = nullptr;
+		meshPipeCreateInfo.layout = meshPipelineLayout;
+
+		if (VK_SUCCESS != vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &meshPipeCreateInfo, nullptr, &meshPipeline))
+			throw std::runtime_error("failed to create mesh pipeline");
+
+		vkDestroyShaderModule(mainDevice.logicalDevice, meshModule, nullptr);
+		vkDestroyShaderModule(mainDevice.logicalDevice, taskModule, nullptr);
+	}
+
 	vkDestroyShaderModule(mainDevice.logicalDevice, fragModule, nullptr);
 	vkDestroyShaderModule(mainDevice.logicalDevice, vertModule, nullptr);
 
@@ -699,8 +895,8 @@ void VulkanRenderer::CreateColorBuffers()
 		colorBuffers[i].img = CreateImage(swapchainImgExtent.width, swapchainImgExtent.height,
 			colorBufferFormat, &colorBuffers[i].memory, VK_IMAGE_TILING_OPTIMAL,
 			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		colorBuffers[i].imgView = CreateImageView(colorBuffers[i].img, colorBufferFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1);
+		colorBuffers[i].imgView = CreateImageView(colorBuffers[i].img, colorBufferFormat, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
 	}
 }
 
@@ -708,17 +904,18 @@ void VulkanRenderer::CreateDepthBuffers()
 {
 	depthBuffers.resize(swapchainImages.size());
 
+	//the gpu driven path builds the hi-z pyramid from it
 	depthBufferFormat = ChooseSupportedFormat(
 		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (gpuDriven ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0));
 
 	for (size_t i = 0; i < depthBuffers.size(); ++i)
 	{
 		depthBuffers[i].img = CreateImage(swapchainImgExtent.width, swapchainImgExtent.height,
 			depthBufferFormat, &depthBuffers[i].memory, VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		depthBuffers[i].imgView = CreateImageView(depthBuffers[i].img, depthBufferFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | (gpuDriven ? VK_IMAGE_USAGE_SAMPLED_BIT : 0),
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1);
+		depthBuffers[i].imgView = CreateImageView(depthBuffers[i].img, depthBufferFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
 	}
 }
 
@@ -762,6 +959,13 @@ void VulkanRenderer::CreateCommandPool()
 	auto result = vkCreateCommandPool(mainDevice.logicalDevice, &createInfo, nullptr, &graphicsCommandPool);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to create graphics command pool");
+
+	//upload batches are recorded from here, the acquire half of ownership transfers from the graphics pool
+	createInfo.queueFamilyIndex = USE_TRANSFER_QUEUE && indices.transferFamily >= 0 ? indices.transferFamily : indices.graphicsFamily;
+
+	result = vkCreateCommandPool(mainDevice.logicalDevice, &createInfo, nullptr, &transferCommandPool);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to create transfer command pool");
 }
 
 void VulkanRenderer::CreateCommandBuffers()
@@ -779,6 +983,36 @@ void VulkanRenderer::CreateCommandBuffers()
 		throw std::runtime_error("failed to allocate primary cmd buffers");
 }
 
+void VulkanRenderer::CreateRecordCommandBuffers()
+{
+	//a pool per slice and frame in flight, so workers never share one and a reset never hits a pending buffer
+	recordSlots = threadPool.GetThreadCount() + 1;
+	recordThreads = RECORD_THREADS == 0 ? recordSlots : std::min(RECORD_THREADS, recordSlots);
+
+	recordCommandPools.resize(recordSlots * MAX_QUEUED_DRAWS);
+	recordCommandBuffers.resize(recordSlots * MAX_QUEUED_DRAWS);
+
+	VkCommandPoolCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	createInfo.queueFamilyIndex = GetQueueFamilyIndices(mainDevice.physicalDevice).graphicsFamily;
+
+	for (size_t i = 0; i < recordCommandPools.size(); ++i)
+	{
+		if (VK_SUCCESS != vkCreateCommandPool(mainDevice.logicalDevice, &createInfo, nullptr, &recordCommandPools[i]))
+			throw std::runtime_error("failed to create record command pool");
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = recordCommandPools[i];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (VK_SUCCESS != vkAllocateCommandBuffers(mainDevice.logicalDevice, &allocInfo, &recordCommandBuffers[i]))
+			throw std::runtime_error("failed to allocate secondary cmd buffers");
+	}
+}
+
 void VulkanRenderer::CreateSyncObjects()
 {
 	semsImgAvailable.resize(MAX_QUEUED_DRAWS);
@@ -801,10 +1035,33 @@ void VulkanRenderer::CreateSyncObjects()
 			throw std::runtime_error("failed to create a sync object");
 		}
 	}
+
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+	createInfo.pNext = &timelineInfo;
+
+	if (vkCreateSemaphore(mainDevice.logicalDevice, &createInfo, nullptr, &uploadTimeline) != VK_SUCCESS ||
+		vkCreateSemaphore(mainDevice.logicalDevice, &createInfo, nullptr, &uploadTransferTimeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upload timeline");
+	}
 }
 
 void VulkanRenderer::CreateTexSampler()
 {
+	//blitting needs linear filtering of the texture format, otherwise the chain is built on the cpu
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProps);
+
+	VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	blitMips = GENERATE_MIPS && GPU_MIPS && (formatProps.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+	std::cout << "texture mips: " << (!GENERATE_MIPS ? "off" : blitMips ? "gpu blits" : "cpu box filter")
+		<< ", block compressed: " << (bcTextures ? "when cooked" : "off") << std::endl;
+
 	VkSamplerCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	createInfo.magFilter = VK_FILTER_LINEAR;
@@ -817,7 +1074,8 @@ void VulkanRenderer::CreateTexSampler()
 	createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	createInfo.mipLodBias = 0.0f;
 	createInfo.minLod = 0.0f;
-	createInfo.maxLod = 0.0f;
+	//every view covers its whole chain, the sampler never clamps below it
+	createInfo.maxLod = GENERATE_MIPS ? VK_LOD_CLAMP_NONE : 0.0f;
 	createInfo.anisotropyEnable = VK_TRUE;
 	createInfo.maxAnisotropy = 16.0f;
 
@@ -825,33 +1083,21 @@ void VulkanRenderer::CreateTexSampler()
 		throw std::runtime_error("failed to create tex sampler");
 }
 
-void VulkanRenderer::CreateUniformBuffers()
-{
-	//one buffer per sc image
-	VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
-
-	vpUniformBuffers.resize(swapchainImages.size());
-	vpUniformBufferMemories.resize(swapchainImages.size());
-
-	for (size_t i = 0; i < swapchainImages.size(); ++i)
-	{
-		CreateBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&vpUniformBuffers[i], &vpUniformBufferMemories[i]);
-	}
-}
-
 void VulkanRenderer::CreateDescriptorPools()
 {
 	VkDescriptorPoolSize vpPoolSize = {};
-	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	vpPoolSize.descriptorCount = static_cast<uint32_t>(vpUniformBuffers.size());
+	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	vpPoolSize.descriptorCount = 1;
 
-	std::vector<VkDescriptorPoolSize> poolSizes = { vpPoolSize };
+	VkDescriptorPoolSize objectPoolSize = {};
+	objectPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectPoolSize.descriptorCount = 2;
+
+	std::vector<VkDescriptorPoolSize> poolSizes = { vpPoolSize, objectPoolSize };
 
 	VkDescriptorPoolCreateInfo vpCreateInfo = {};
 	vpCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	vpCreateInfo.maxSets = static_cast<uint32_t>(swapchainImages.size());
+	vpCreateInfo.maxSets = 1;
 	vpCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	vpCreateInfo.pPoolSizes = poolSizes.data();
 
@@ -861,11 +1107,12 @@ void VulkanRenderer::CreateDescriptorPools()
 	//sampler
 	VkDescriptorPoolSize samplerPoolSize = {};
 	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerPoolSize.descriptorCount = MAX_TEXTURES;
+	//room for the sets streamed textures moved off while frames in flight may still use them
+	samplerPoolSize.descriptorCount = MAX_TEXTURES * 3;
 
 	VkDescriptorPoolCreateInfo samplerCreateInfo = {};
 	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	samplerCreateInfo.maxSets = MAX_TEXTURES;
+	samplerCreateInfo.maxSets = MAX_TEXTURES * 3;
 	samplerCreateInfo.poolSizeCount = 1;
 	samplerCreateInfo.pPoolSizes = &samplerPoolSize;
 
@@ -894,39 +1141,57 @@ void VulkanRenderer::CreateDescriptorPools()
 
 void VulkanRenderer::CreateDescriptorSets()
 {
-	descriptorSets.resize(swapchainImages.size());
-	std::vector<VkDescriptorSetLayout> layouts(swapchainImages.size(), descriptorSetLayout);
-
+	//a single set for every frame, the ring slice is picked by the dynamic offset at bind time
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(swapchainImages.size());
-	allocInfo.pSetLayouts = layouts.data();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &descriptorSetLayout;
 
-	if (VK_SUCCESS != vkAllocateDescriptorSets(mainDevice.logicalDevice, &allocInfo, descriptorSets.data()))
+	if (VK_SUCCESS != vkAllocateDescriptorSets(mainDevice.logicalDevice, &allocInfo, &frameDescriptorSet))
 		throw std::runtime_error("failed to alloc for descriptors");
 
-	for (size_t i = 0; i < swapchainImages.size(); ++i)
-	{
-		VkDescriptorBufferInfo vpBufferInfo = {};
-		vpBufferInfo.buffer = vpUniformBuffers[i];
-		vpBufferInfo.offset = 0;
-		vpBufferInfo.range = sizeof(UboViewProjection);
-
-		VkWriteDescriptorSet vpSetWrite = {};
-		vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		vpSetWrite.dstSet = descriptorSets[i];
-		vpSetWrite.dstBinding = 0;
-		vpSetWrite.dstArrayElement = 0;
-		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		vpSetWrite.descriptorCount = 1;
-		vpSetWrite.pBufferInfo = &vpBufferInfo;
-
-		std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite };
-
-		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()),
-			setWrites.data(), 0, nullptr);
-	}
+	VkDescriptorBufferInfo vpBufferInfo = {};
+	vpBufferInfo.buffer = uniformRing.GetBuffer();
+	vpBufferInfo.offset = 0;
+	vpBufferInfo.range = sizeof(UboViewProjection);
+
+	VkWriteDescriptorSet vpSetWrite = {};
+	vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	vpSetWrite.dstSet = frameDescriptorSet;
+	vpSetWrite.dstBinding = 0;
+	vpSetWrite.dstArrayElement = 0;
+	vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	vpSetWrite.descriptorCount = 1;
+	vpSetWrite.pBufferInfo = &vpBufferInfo;
+
+	VkDescriptorBufferInfo objectBufferInfo = {};
+	objectBufferInfo.buffer = uniformRing.GetBuffer();
+	objectBufferInfo.offset = 0;
+	objectBufferInfo.range = sizeof(ObjectData) * MAX_OBJECTS;
+
+	VkWriteDescriptorSet objectSetWrite = {};
+	objectSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	objectSetWrite.dstSet = frameDescriptorSet;
+	objectSetWrite.dstBinding = 1;
+	objectSetWrite.dstArrayElement = 0;
+	objectSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectSetWrite.descriptorCount = 1;
+	objectSetWrite.pBufferInfo = &objectBufferInfo;
+
+	VkDescriptorBufferInfo instanceBufferInfo = {};
+	instanceBufferInfo.buffer = uniformRing.GetBuffer();
+	instanceBufferInfo.offset = 0;
+	instanceBufferInfo.range = sizeof(uint32_t) * MAX_INSTANCES;
+
+	VkWriteDescriptorSet instanceSetWrite = objectSetWrite;
+	instanceSetWrite.dstBinding = 2;
+	instanceSetWrite.pBufferInfo = &instanceBufferInfo;
+
+	std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite, objectSetWrite, instanceSetWrite };
+
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()),
+		setWrites.data(), 0, nullptr);
 }
 
 void VulkanRenderer::CreateInputDescriptorSets()
@@ -983,12 +1248,75 @@ void VulkanRenderer::CreateInputDescriptorSets()
 	}
 }
 
-void VulkanRenderer::UpdateUniformBuffers(uint32_t imgIdx)
+void VulkanRenderer::UpdateUniformBuffers()
+{
+	uniformRing.BeginFrame(frameIdx);
+	frameDynamicOffsets[0] = uniformRing.Push(uboViewProjection);
+
+	if (models.size() > MAX_OBJECTS)
+		throw std::runtime_error("more models than object buffer entries");
+
+	//the whole range is reserved since the descriptor covers MAX_OBJECTS, only live entries are written
+	void* mapped;
+	frameDynamicOffsets[1] = uniformRing.Allocate(sizeof(ObjectData) * MAX_OBJECTS, &mapped);
+	auto objects = static_cast<ObjectData*>(mapped);
+
+	//object id = model idx, every mesh of a model shares the entry
+	objectDepths.resize(models.size());
+	objectModels.resize(models.size());
+	for (size_t i = 0; i < models.size(); ++i)
+	{
+		objectModels[i] = models[i].GetModel();
+		objects[i].model = objectModels[i];
+		objects[i].params = glm::vec4(0.0f);
+
+		objectDepths[i] = -(uboViewProjection.view * objectModels[i][3]).z;
+	}
+
+	//filled by RecordCommands once the draw list is sorted and batched
+	frameDynamicOffsets[2] = uniformRing.Allocate(sizeof(uint32_t) * MAX_INSTANCES, &mapped);
+	instanceStream = static_cast<uint32_t*>(mapped);
+}
+
+UploadQueues VulkanRenderer::GetUploadQueues()
+{
+	auto indices = GetQueueFamilyIndices(mainDevice.physicalDevice);
+
+	UploadQueues queues = {};
+	queues.graphicsQueue = graphicsQueue;
+	queues.graphicsCmdPool = graphicsCommandPool;
+	queues.graphicsFamily = indices.graphicsFamily;
+	queues.transferQueue = transferQueue;
+	queues.transferCmdPool = transferCommandPool;
+	queues.transferFamily = USE_TRANSFER_QUEUE && indices.transferFamily >= 0 ? indices.transferFamily : indices.graphicsFamily;
+	queues.timeline = uploadTimeline;
+	queues.timelineValue = &uploadTimelineValue;
+	queues.transferTimeline = uploadTransferTimeline;
+	queues.transferTimelineValue = &uploadTransferTimelineValue;
+	queues.readStages = GetUploadReadStages();
+
+	return queues;
+}
+
+VkPipelineStageFlags VulkanRenderer::GetUploadReadStages()
+{
+	VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	//the mesh shaders fetch pool geometry themselves
+	if (meshShading)
+		stages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+
+	return stages;
+}
+
+void VulkanRenderer::CollectFinishedUploads()
 {
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemories[imgIdx], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemories[imgIdx]);
+	vkGetSemaphoreCounterValue(mainDevice.logicalDevice, uploadTimeline, &completedUploadValue);
+
+	//frees staging and cmd buffers of every batch the gpu is done with
+	pendingUploads.erase(std::remove_if(pendingUploads.begin(), pendingUploads.end(),
+		[this](const std::unique_ptr<UploadBatch>& b) { return b->GetTimelineValue() <= completedUploadValue; }),
+		pendingUploads.end());
 }
 
 void VulkanRenderer::RecordCommands(uint32_t imgIdx)
@@ -1015,34 +1343,152 @@ void VulkanRenderer::RecordCommands(uint32_t imgIdx)
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to start recording cmd buffer");
 
-	rpBeginInfo.framebuffer = swapchainFramebuffers[imgIdx];
-	vkCmdBeginRenderPass(commandBuffers[imgIdx], &rpBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	auto rebuilt = drawList.IsDirty();
+	if (rebuilt)
+		drawList.Build(models);
+
+	auto viewProj = uboViewProjection.projection * uboViewProjection.view;
+	auto cameraPos = glm::vec3(glm::inverse(uboViewProjection.view)[3]);
+	//projected size in pixels of one unit at distance 1, the y scale is flipped for vulkan
+	auto pixelsPerUnit = std::abs(uboViewProjection.projection[1][1]) * 0.5f * static_cast<float>(swapchainImgExtent.height);
+	size_t batchCount = 0;
+	size_t slices = 1;
+
+	if (gpuDriven)
+	{
+		//the draw inputs are shared by all frames in flight, the other ones have to finish before they change
+		if (rebuilt || gpuDrawList.NeedsUpdate(completedUploadValue))
+		{
+			for (uint32_t i = 0; i < MAX_QUEUED_DRAWS; ++i)
+			{
+				if (i != frameIdx)
+					vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[i], VK_TRUE, DRAW_TIMEOUT);
+			}
+
+			gpuUploadValue = gpuDrawList.Update(&drawList, completedUploadValue);
+		}
+
+		frameUploadValue = gpuUploadValue;
+
+		//counts are from the last frame that used this slice, its fence was waited on in Draw
+		//they count commands, with meshlet runs several can come from one draw
+		recordStats = {};
+		recordStats.visible = std::min(gpuDrawList.GetVisibleCount(frameIdx), gpuDrawList.GetDrawCount());
+		recordStats.culled = gpuDrawList.GetDrawCount() - recordStats.visible;
+		recordStats.disoccluded = gpuDrawList.GetLateCount(frameIdx);
+		recordStats.draws = gpuDrawList.GetBucketCount() * CULL_PHASE_COUNT;
+		recordStats.instances = recordStats.visible;
+
+		//early phase: whatever last frame's pyramid doesn't hide, into the color and depth of this frame
+		gpuDrawList.RecordCull(commandBuffers[imgIdx], frameIdx, CULL_PHASE_EARLY, frameDescriptorSet,
+			frameDynamicOffsets.data(), static_cast<uint32_t>(frameDynamicOffsets.size()), viewProj,
+			OCCLUSION_CULLING && hiZValid ? &hiZViewProj : nullptr, cameraPos, pixelsPerUnit);
+
+		rpBeginInfo.renderPass = earlyRenderPass;
+		rpBeginInfo.framebuffer = swapchainFramebuffers[imgIdx];
+		vkCmdBeginRenderPass(commandBuffers[imgIdx], &rpBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		{
+			RecordGpuDraws(commandBuffers[imgIdx], CULL_PHASE_EARLY);
+			vkCmdNextSubpass(commandBuffers[imgIdx], VK_SUBPASS_CONTENTS_INLINE);
+		}
+		vkCmdEndRenderPass(commandBuffers[imgIdx]);
+
+		//late phase: what the early one rejected, against the pyramid of the depth just drawn
+		hiZPyramid.RecordBuild(commandBuffers[imgIdx], imgIdx);
+		hiZViewProj = viewProj;
+		hiZValid = true;
+
+		gpuDrawList.RecordCull(commandBuffers[imgIdx], frameIdx, CULL_PHASE_LATE, frameDescriptorSet,
+			frameDynamicOffsets.data(), static_cast<uint32_t>(frameDynamicOffsets.size()), viewProj,
+			OCCLUSION_CULLING ? &hiZViewProj : nullptr, cameraPos, pixelsPerUnit);
+
+		rpBeginInfo.renderPass = renderPass;
+	}
+	else
 	{
-		vkCmdBindPipeline(commandBuffers[imgIdx], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		//culled draws are skipped by batching, sorting them along is cheaper than compacting first
+		drawList.Cull(viewProj, objectModels);
+
+		if (CPU_OCCLUSION_CULLING)
+		{
+			RasterizeOccluders(viewProj);
+			drawList.CullOccluded(occlusionBuffer);
+		}
+
+		drawList.SelectLods(cameraPos, pixelsPerUnit);
+		DrawList::ExtractFrustumPlanes(viewProj, framePlanes.data());
+		frameCameraPos = cameraPos;
+
+		//depths move every frame, the radix sort is cheap enough to redo each time
+		drawList.Sort(objectDepths);
+		frameUploadValue = drawList.BuildBatches(completedUploadValue, instanceStream, MAX_INSTANCES);
+
+		batchCount = drawList.GetBatchCount();
+		slices = std::min(recordThreads, std::max<size_t>(batchCount / MIN_RECORD_SLICE_DRAWS, 1));
+	}
 
-		for (size_t j = 0; j < models.size(); ++j)
+	rpBeginInfo.framebuffer = swapchainFramebuffers[imgIdx];
+	vkCmdBeginRenderPass(commandBuffers[imgIdx], &rpBeginInfo,
+		slices > 1 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+	{
+		if (gpuDriven)
+		{
+			RecordGpuDraws(commandBuffers[imgIdx], CULL_PHASE_LATE);
+		}
+		else if (slices > 1)
 		{
-			auto mm = models[j];
-			auto modelMtx = mm.GetModel();
+			//each slice gets its own pool and secondary buffer, workers only read renderer state
+			std::vector<RecordStats> sliceStats(slices);
+
+			threadPool.ParallelFor(slices, [&](size_t s)
+			{
+				auto slot = frameIdx * recordSlots + s;
+				vkResetCommandPool(mainDevice.logicalDevice, recordCommandPools[slot], 0);
+
+				VkCommandBufferInheritanceInfo inheritanceInfo = {};
+				inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+				inheritanceInfo.renderPass = renderPass;
+				inheritanceInfo.subpass = 0;
+				inheritanceInfo.framebuffer = swapchainFramebuffers[imgIdx];
 
-			vkCmdPushConstants(commandBuffers[imgIdx], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
-				0, sizeof(Model), &modelMtx);
+				VkCommandBufferBeginInfo secondaryBeginInfo = {};
+				secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-				for (size_t k = 0; k < mm.GetMeshCount(); ++k)
-				{
-					auto curMesh = mm.GetMesh(k);
+				if (VK_SUCCESS != vkBeginCommandBuffer(recordCommandBuffers[slot], &secondaryBeginInfo))
+					throw std::runtime_error("failed to start recording secondary cmd buffer");
 
-					VkBuffer vertBuffers[] = { curMesh->GetVertexBuffer() };
-					VkDeviceSize offsets[] = { 0 };
-					vkCmdBindVertexBuffers(commandBuffers[imgIdx], 0, 1, vertBuffers, offsets);
-					vkCmdBindIndexBuffer(commandBuffers[imgIdx], curMesh->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+				RecordDraws(recordCommandBuffers[slot], batchCount * s / slices, batchCount * (s + 1) / slices, &sliceStats[s]);
 
-					std::array<VkDescriptorSet, 2> dsGroup = { descriptorSets[imgIdx], samplerDescriptorSets[curMesh->GetTexId()] };
-					vkCmdBindDescriptorSets(commandBuffers[imgIdx], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-						0, static_cast<uint32_t>(dsGroup.size()), dsGroup.data(), 0, nullptr);
+				if (VK_SUCCESS != vkEndCommandBuffer(recordCommandBuffers[slot]))
+					throw std::runtime_error("failed to end recording secondary cmd buffer");
+			});
 
-					vkCmdDrawIndexed(commandBuffers[imgIdx], curMesh->GetIndexCount(), 1, 0, 0, 0);
-				}
+			vkCmdExecuteCommands(commandBuffers[imgIdx], static_cast<uint32_t>(slices), &recordCommandBuffers[frameIdx * recordSlots]);
+
+			recordStats = {};
+			recordStats.visible = drawList.GetVisibleCount();
+			recordStats.culled = drawList.GetCulledCount();
+			recordStats.occluded = drawList.GetOccludedCount();
+			for (const auto& st : sliceStats)
+			{
+				recordStats.draws += st.draws;
+				recordStats.instances += st.instances;
+				recordStats.setBinds += st.setBinds;
+				recordStats.bufferBinds += st.bufferBinds;
+				recordStats.bindsSaved += st.bindsSaved;
+				recordStats.triangles += st.triangles;
+				recordStats.clustersCulled += st.clustersCulled;
+			}
+		}
+		else
+		{
+			recordStats = {};
+			recordStats.visible = drawList.GetVisibleCount();
+			recordStats.culled = drawList.GetCulledCount();
+			recordStats.occluded = drawList.GetOccludedCount();
+			RecordDraws(commandBuffers[imgIdx], 0, batchCount, &recordStats);
 		}
 
 		vkCmdNextSubpass(commandBuffers[imgIdx], VK_SUBPASS_CONTENTS_INLINE);
@@ -1059,6 +1505,129 @@ void VulkanRenderer::RecordCommands(uint32_t imgIdx)
 		throw std::runtime_error("failed to end recording cmd buffer");
 }
 
+void VulkanRenderer::RecordGpuDraws(VkCommandBuffer cmdBuffer, CullPhase phase)
+{
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+	VkBuffer vertBuffers[] = { geometryPool.GetVertexBuffer() };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, vertBuffers, offsets);
+	vkCmdBindIndexBuffer(cmdBuffer, geometryPool.GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+		0, 1, &frameDescriptorSet,
+		static_cast<uint32_t>(frameDynamicOffsets.size()), frameDynamicOffsets.data());
+
+	gpuDrawList.RecordDraws(cmdBuffer, frameIdx, phase, pipelineLayout, samplerDescriptorSets);
+
+	//set 0 is rebound, the push constant range makes the mesh layout incompatible with the vertex one
+	if (meshShading)
+	{
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout,
+			0, 1, &frameDescriptorSet,
+			static_cast<uint32_t>(frameDynamicOffsets.size()), frameDynamicOffsets.data());
+
+		gpuDrawList.RecordMeshDraws(cmdBuffer, frameIdx, phase, meshPipelineLayout, samplerDescriptorSets);
+	}
+}
+
+void VulkanRenderer::RasterizeOccluders(const glm::mat4& viewProj)
+{
+	occlusionBuffer.Clear();
+
+	//a model that isn't drawn yet mustn't hide what's behind it
+	for (size_t i = 0; i < models.size(); ++i)
+	{
+		auto occluders = models[i].GetOccluders();
+		if (!occluders || models[i].GetUploadValue() > completedUploadValue)
+			continue;
+
+		for (const auto& occluder : *occluders)
+			occlusionBuffer.AddOccluder(&occluder, objectModels[i]);
+	}
+
+	occlusionBuffer.Rasterize(&threadPool, viewProj);
+}
+
+void VulkanRenderer::RecordDraws(VkCommandBuffer cmdBuffer, size_t firstBatch, size_t lastBatch, RecordStats* stats)
+{
+	if (firstBatch == lastBatch)
+		return;
+
+	//secondary buffers inherit no state, every slice binds for itself
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+	//set 0 and the pool buffers are the same for the whole frame
+	VkBuffer vertBuffers[] = { geometryPool.GetVertexBuffer() };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, vertBuffers, offsets);
+	vkCmdBindIndexBuffer(cmdBuffer, geometryPool.GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+		0, 1, &frameDescriptorSet,
+		static_cast<uint32_t>(frameDynamicOffsets.size()), frameDynamicOffsets.data());
+
+	stats->bufferBinds += 2;
+	++stats->setBinds;
+
+	auto batchDraws = drawList.GetBatchDraws().data();
+	auto batchFirstInstances = drawList.GetBatchFirstInstances().data();
+	auto batchInstanceCounts = drawList.GetBatchInstanceCounts().data();
+	auto lodIndexCounts = drawList.GetLodIndexCounts().data();
+	auto lodFirstIndices = drawList.GetLodFirstIndices().data();
+	auto lods = drawList.GetLods().data();
+	auto vertexOffsets = drawList.GetVertexOffsets().data();
+	auto texIds = drawList.GetTexIds().data();
+	auto objectIds = drawList.GetObjectIds().data();
+	auto meshletCounts = drawList.GetMeshletCounts().data();
+	std::vector<DrawList::IndexRun> runs;
+
+	uint32_t boundTexId = UINT32_MAX;
+
+	for (size_t b = firstBatch; b < lastBatch; ++b)
+	{
+		auto d = batchDraws[b];
+
+		//batches are sorted by texture, so this only fires when the texture actually changes
+		if (texIds[d] != boundTexId)
+		{
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+				1, 1, &samplerDescriptorSets[texIds[d]], 0, nullptr);
+
+			++stats->setBinds;
+			boundTexId = texIds[d];
+		}
+
+		//a lone full level draw only draws its meshlets that can be seen, instances would each need their own
+		auto l = d * MAX_MESH_LODS + lods[d];
+		if (CLUSTER_CULLING && batchInstanceCounts[b] == 1 && lods[d] == 0 && meshletCounts[d] > 0)
+		{
+			stats->clustersCulled += drawList.CullClusters(d, objectModels[objectIds[d]], framePlanes.data(), frameCameraPos, &runs);
+		}
+		else
+		{
+			runs.clear();
+			runs.push_back({ lodFirstIndices[l], lodIndexCounts[l] });
+		}
+
+		//gl_InstanceIndex starts at firstInstance and looks the object up in the instance stream
+		for (const auto& run : runs)
+		{
+			vkCmdDrawIndexed(cmdBuffer, run.indexCount, batchInstanceCounts[b], run.firstIndex, vertexOffsets[d], batchFirstInstances[b]);
+			++stats->draws;
+			stats->triangles += static_cast<size_t>(run.indexCount / 3) * batchInstanceCounts[b];
+		}
+		stats->instances += batchInstanceCounts[b];
+	}
+
+	stats->bindsSaved = stats->instances * 4 - stats->setBinds - stats->bufferBinds;
+}
+
+VulkanRenderer::RecordStats VulkanRenderer::GetRecordStats()
+{
+	return recordStats;
+}
 void VulkanRenderer::CreateRenderPass()
 {
 	std::array<VkSubpassDescription, 2> subpasses = {};
@@ -1080,11 +1649,7 @@ void VulkanRenderer::CreateRenderPass()
 		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-		//depthAttachment.format = depthBufferFormat;
-	depthAttachment.format = ChooseSupportedFormat(
-		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	depthAttachment.format = depthBufferFormat;
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -1136,7 +1701,7 @@ void VulkanRenderer::CreateRenderPass()
 		subpasses[1].pInputAttachments = inputRefs.data();
 	
 
-	std::array<VkSubpassDependency, 3> spDependencies = {};
+	std::array<VkSubpassDependency, 4> spDependencies = {};
 
 	//ext -> col/dep
 	spDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -1147,10 +1712,21 @@ void VulkanRenderer::CreateRenderPass()
 	spDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	spDependencies[0].dependencyFlags = 0;
 
+	//the gpu driven main pass continues the color and depth of the early pass, after the hi-z build read the depth
+	if (gpuDriven)
+	{
+		spDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		spDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		spDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		spDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	}
+
 	//col/dep -> shader read
 	spDependencies[1].srcSubpass = 0;
-	spDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	spDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	spDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	spDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	spDependencies[1].dstSubpass = 1;
 	spDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 	spDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
@@ -1165,8 +1741,26 @@ void VulkanRenderer::CreateRenderPass()
 	spDependencies[2].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 	spDependencies[2].dependencyFlags = 0;
 
+	//dep -> hi-z build, only the early pass keeps its depth but compatible passes need the same dependencies
+	spDependencies[3].srcSubpass = 1;
+	spDependencies[3].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	spDependencies[3].srcAccessMask = 0;
+	spDependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+	spDependencies[3].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	spDependencies[3].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	spDependencies[3].dependencyFlags = 0;
+
 	std::array<VkAttachmentDescription, 3> passAttachments = { blitAttachment, colorAttachment, depthAttachment };
 
+	if (gpuDriven)
+	{
+		passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		passAttachments[1].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		passAttachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		passAttachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		passAttachments[2].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
 	VkRenderPassCreateInfo rpCreateInfo = {};
 	rpCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	rpCreateInfo.attachmentCount = static_cast<uint32_t>(passAttachments.size());
@@ -1180,18 +1774,53 @@ void VulkanRenderer::CreateRenderPass()
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to create render pass");
 
+	if (!gpuDriven)
+		return;
+
+	//same layout as renderPass so pipelines and framebuffers are shared, clears and keeps color and depth
+	//for it, subpass 1 is stepped through without drawing and the swapchain image is left alone
+	passAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	passAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	passAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	passAttachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	passAttachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	passAttachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	passAttachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	passAttachments[2].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	result = vkCreateRenderPass(mainDevice.logicalDevice, &rpCreateInfo, nullptr, &earlyRenderPass);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to create early render pass");
 }
 
 void VulkanRenderer::CreateDescriptorSetLayouts()
 {
 	VkDescriptorSetLayoutBinding vpBinding = {};
 	vpBinding.binding = 0; //shader bind idx
-	vpBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	vpBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	vpBinding.descriptorCount = 1;
 	vpBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	vpBinding.pImmutableSamplers = nullptr;
 
-	std::vector<VkDescriptorSetLayoutBinding> bindings = { vpBinding };
+	VkDescriptorSetLayoutBinding objectBinding = {};
+	objectBinding.binding = 1;
+	objectBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectBinding.descriptorCount = 1;
+	objectBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT; //read and written by the cull pass too
+	objectBinding.pImmutableSamplers = nullptr;
+
+	if (meshShading)
+	{
+		vpBinding.stageFlags |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+		objectBinding.stageFlags |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	}
+
+	VkDescriptorSetLayoutBinding instanceBinding = objectBinding;
+	instanceBinding.binding = 2;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings = { vpBinding, objectBinding, instanceBinding };
 
 	VkDescriptorSetLayoutCreateInfo vpDslCreateInfo = {};
 	vpDslCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1243,13 +1872,6 @@ void VulkanRenderer::CreateDescriptorSetLayouts()
 		throw std::runtime_error("failed to create input dsl");
 }
 
-void VulkanRenderer::CreatePushConstantRange()
-{
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(Model);
-}
-
 void VulkanRenderer::GetPhysicalDevice()
 {
 	uint32_t devCount = 0;
@@ -1289,7 +1911,7 @@ QueueFamilyIndices VulkanRenderer::GetQueueFamilyIndices(VkPhysicalDevice device
 		VkBool32 presentationSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
 
-		if (qf.queueCount > 0)
+		if (qf.queueCount > 0 && !indices.IsValid())
 		{
 			if (qf.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 				indices.graphicsFamily = i;
@@ -1298,12 +1920,24 @@ QueueFamilyIndices VulkanRenderer::GetQueueFamilyIndices(VkPhysicalDevice device
 				indices.presentationFamily = i;
 		}
 
-		if (indices.IsValid())
-			break;
-
 		++i;
 	}
 
+	//a copy engine only family first, async compute families take transfers too but aren't the dma queue
+	for (int dmaOnly = 1; dmaOnly >= 0 && indices.transferFamily < 0; --dmaOnly)
+	{
+		for (uint32_t f = 0; f < qFamilyCount; ++f)
+		{
+			auto flags = queueFamilyList[f].queueFlags;
+			if (queueFamilyList[f].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) &&
+				(!dmaOnly || !(flags & VK_QUEUE_COMPUTE_BIT)))
+			{
+				indices.transferFamily = static_cast<int>(f);
+				break;
+			}
+		}
+	}
+
 	return indices;
 }
 
@@ -1365,6 +1999,14 @@ bool VulkanRenderer::CheckDeviceSuitable(VkPhysicalDevice device)
 	VkPhysicalDeviceFeatures features;
 	vkGetPhysicalDeviceFeatures(device, &features);
 
+	VkPhysicalDeviceVulkan12Features features12 = {};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features2 = {};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features2);
+
 	auto qIndices = GetQueueFamilyIndices(device);
 	auto hasExtSupport = CheckDeviceExtensionSupport(device);
 	auto isSwapchainValid = false;
@@ -1376,7 +2018,7 @@ bool VulkanRenderer::CheckDeviceSuitable(VkPhysicalDevice device)
 	}
 
 	return qIndices.IsValid() && hasExtSupport && isSwapchainValid &&
-		features.samplerAnisotropy;
+		features.samplerAnisotropy && features12.timelineSemaphore;
 }
 
 VkSurfaceFormatKHR VulkanRenderer::ChooseSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats)
@@ -1454,8 +2096,8 @@ VkFormat VulkanRenderer::ChooseSupportedFormat(const std::vector<VkFormat>& form
 	throw std::runtime_error("failed to find a matching format");
 }
 
-VkImage VulkanRenderer::CreateImage(uint32_t wid, uint32_t hei, VkFormat format, VkDeviceMemory* imgMemory, VkImageTiling tiling,
-	VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags)
+VkImage VulkanRenderer::CreateImage(uint32_t wid, uint32_t hei, VkFormat format, MemoryAllocation* imgMemory, VkImageTiling tiling,
+	VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, uint32_t mipLevels)
 {
 	VkImageCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1463,7 +2105,7 @@ VkImage VulkanRenderer::CreateImage(uint32_t wid, uint32_t hei, VkFormat format,
 	createInfo.extent.width = wid;
 	createInfo.extent.height = hei;
 	createInfo.extent.depth = 1;
-	createInfo.mipLevels = 1;
+	createInfo.mipLevels = mipLevels;
 	createInfo.arrayLayers = 1;
 	createInfo.format = format;
 	createInfo.tiling = tiling;
@@ -1480,20 +2122,14 @@ VkImage VulkanRenderer::CreateImage(uint32_t wid, uint32_t hei, VkFormat format,
 	VkMemoryRequirements memReq;
 	vkGetImageMemoryRequirements(mainDevice.logicalDevice, resultImg, &memReq);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memReq.size;
-	allocInfo.memoryTypeIndex = FindMemoryTypeIndex(mainDevice.physicalDevice, memReq.memoryTypeBits, propFlags);
+	*imgMemory = memoryAllocator.Allocate(memReq, propFlags, tiling == VK_IMAGE_TILING_LINEAR);
 
-	if (VK_SUCCESS != vkAllocateMemory(mainDevice.logicalDevice, &allocInfo, nullptr, imgMemory))
-		throw std::runtime_error("failed to allocate memory for img");
-
-	vkBindImageMemory(mainDevice.logicalDevice, resultImg, *imgMemory, 0);
+	vkBindImageMemory(mainDevice.logicalDevice, resultImg, imgMemory->memory, imgMemory->offset);
 
 	return resultImg;
 }
 
-VkImageView VulkanRenderer::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView VulkanRenderer::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1506,8 +2142,8 @@ VkImageView VulkanRenderer::CreateImageView(VkImage image, VkFormat format, VkIm
 	createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
 	createInfo.subresourceRange.aspectMask = aspectFlags;
-	createInfo.subresourceRange.baseMipLevel = 0;
-	createInfo.subresourceRange.levelCount = 1;
+	createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	createInfo.subresourceRange.levelCount = mipLevels;
 	createInfo.subresourceRange.baseArrayLayer = 0;
 	createInfo.subresourceRange.layerCount = 1;
 
@@ -1534,67 +2170,597 @@ VkShaderModule VulkanRenderer::CreateShaderModule(const std::vector<char>& shade
 	return shaderModule;
 }
 
-size_t VulkanRenderer::CreateTextureImage(std::string fileName)
+VulkanRenderer::DecodedTexture VulkanRenderer::DecodeTexture(std::string fileName, bool cpuMips)
 {
+	DecodedTexture decoded;
+
+	//a cooked or otherwise block compressed copy carries its own mips, nothing is decoded or filtered
+	TextureFile compressed;
+	if (bcTextures && (compressed.Open("Textures/" + TextureFile::GetCookedName(fileName)) ||
+		compressed.Open("Textures/" + fileName.substr(0, fileName.find_last_of('.')) + ".dds")))
+	{
+		decoded.format = compressed.GetFormat();
+		decoded.wid = compressed.GetWidth();
+		decoded.hei = compressed.GetHeight();
+		decoded.mipLevels = compressed.GetLevelCount();
+		decoded.stagedLevels = decoded.mipLevels;
+
+		//levels packed level 0 first whatever order the container keeps them in
+		for (uint32_t level = 0; level < decoded.mipLevels; ++level)
+		{
+			auto levelData = compressed.GetLevelData(level);
+			decoded.data.insert(decoded.data.end(), levelData, levelData + compressed.GetLevelSize(level));
+		}
+
+		return decoded;
+	}
+
 	int wid, hei;
 	VkDeviceSize imgSize;
 	const auto imgData = LoadImage(fileName, &wid, &hei, &imgSize);
 
-	VkBuffer imgStagingBuffer;
-	VkDeviceMemory imgStagingBufferMemory;
-	CreateBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, imgSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imgStagingBuffer, &imgStagingBufferMemory);
+	//the blit path stages only the top level, the cpu path the whole chain
+	decoded.format = VK_FORMAT_R8G8B8A8_UNORM;
+	decoded.wid = wid;
+	decoded.hei = hei;
+	decoded.mipLevels = GENERATE_MIPS ? MipChain::CountLevels(wid, hei) : 1;
+	decoded.stagedLevels = blitMips && !cpuMips ? 1 : decoded.mipLevels;
 
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, imgStagingBufferMemory, 0, imgSize, 0, &data);
-	memcpy(data, imgData, imgSize);
-	vkUnmapMemory(mainDevice.logicalDevice, imgStagingBufferMemory);
+	decoded.data.resize(MipChain::GetSize(wid, hei, decoded.stagedLevels));
+	memcpy(decoded.data.data(), imgData, imgSize);
 
 	stbi_image_free(imgData);
 
-	VkDeviceMemory texImageMemory;
-	VkImage texImage = CreateImage(wid, hei, VK_FORMAT_R8G8B8A8_UNORM, &texImageMemory,
-		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	MipChain::Build(decoded.data.data(), wid, hei, decoded.stagedLevels);
+
+	return decoded;
+}
+
+VkImage VulkanRenderer::CreateTextureImage(const DecodedTexture& decoded, UploadBatch* uploadBatch, MemoryAllocation* texImageMemory)
+{
+	VkBuffer imgStagingBuffer;
+	auto data = uploadBatch->CreateStagingBuffer(decoded.data.size(), &imgStagingBuffer);
+	memcpy(data, decoded.data.data(), decoded.data.size());
 
-	TransitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, texImage,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyImgBuffer(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, imgStagingBuffer, texImage, wid, hei);
-	TransitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, texImage,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	bool gpuMips = decoded.stagedLevels < decoded.mipLevels;
 
-	texImages.push_back(texImage);
-	texImgMemories.push_back(texImageMemory);
+	VkImage texImage = CreateImage(decoded.wid, decoded.hei, decoded.format, texImageMemory,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | (gpuMips ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, decoded.mipLevels);
+
+	uploadBatch->TransitionImageLayout(texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, decoded.mipLevels);
+	uploadBatch->CopyImgBuffer(imgStagingBuffer, texImage, decoded.format, decoded.wid, decoded.hei, 0, decoded.stagedLevels);
+	if (gpuMips)
+		uploadBatch->GenerateMips(texImage, decoded.wid, decoded.hei, decoded.mipLevels);
+	else
+		uploadBatch->TransitionImageLayout(texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, decoded.mipLevels);
 
-	vkDestroyBuffer(mainDevice.logicalDevice, imgStagingBuffer, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice, imgStagingBufferMemory, nullptr);
+	textureBytes += decoded.GetGpuBytes();
+	rgbaTextureBytes += MipChain::GetSize(decoded.wid, decoded.hei, decoded.mipLevels);
 
-	return texImages.size() - 1;
+	return texImage;
 }
 
-size_t VulkanRenderer::CreateTexture(std::string fileName)
+size_t VulkanRenderer::CreateTexture(const DecodedTexture& decoded, UploadBatch* uploadBatch)
 {
-	auto imgIdx = CreateTextureImage(fileName);
-	auto imgView = CreateImageView(texImages[imgIdx], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-	texImgViews.push_back(imgView);
+	MemoryAllocation texImageMemory;
+	auto texImage = CreateTextureImage(decoded, uploadBatch, &texImageMemory);
+	auto imgView = CreateImageView(texImage, decoded.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, decoded.mipLevels);
 
-	return CreateTextureDescriptor(imgView);
+	auto texId = CreateTextureSlot(imgView);
+	texImages[texId] = texImage;
+	texImgMemories[texId] = texImageMemory;
+	texImgViews[texId] = imgView;
+
+	return texId;
 }
 
-size_t VulkanRenderer::CreateTextureDescriptor(VkImageView texImgView)
+size_t VulkanRenderer::CreateTextureSlot(VkImageView texImgView)
 {
-	VkDescriptorSet descrSet;
+	//released ids go first, the id is the draw list's texture bucket so they have to stay below MAX_TEXTURES
+	if (!freeTexIds.empty())
+	{
+		auto texId = freeTexIds.back();
+		freeTexIds.pop_back();
 
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = samplerDescriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = &samplerSetLayout;
+		WriteTextureDescriptor(samplerDescriptorSets[texId], texImgView);
+		return texId;
+	}
 
-	if (VK_SUCCESS != vkAllocateDescriptorSets(mainDevice.logicalDevice, &allocInfo, &descrSet))
-		throw std::runtime_error("failed to alloc tex descriptor set");
+	//the sampler pool, the count slices and the sort key's texture bits are all sized by it
+	if (texImages.size() >= MAX_TEXTURES)
+		throw std::runtime_error("too many textures, MAX_TEXTURES is " + std::to_string(MAX_TEXTURES));
 
+	texImages.push_back(VK_NULL_HANDLE);
+	texImgMemories.push_back(MemoryAllocation());
+	texImgViews.push_back(VK_NULL_HANDLE);
+
+	return CreateTextureDescriptor(texImgView);
+}
+
+//0 for a source shipped only as its cooked copy, that one is matched by name alone
+static uint64_t HashTextureFile(const std::string& fileName)
+{
+	try
+	{
+		return MeshCache::HashFile("Textures/" + fileName);
+	}
+	catch (const std::runtime_error&)
+	{
+		return 0;
+	}
+}
+
+std::vector<size_t> VulkanRenderer::CreateTextures(const std::vector<std::string>& fileNames, UploadBatch* uploadBatch, bool streamed)
+{
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+
+	//a file not in the registry yet, with every material waiting for it by name or (once hashed) by content
+	//streamed files are hashed on their worker instead, copies among them are merged once uploaded
+	struct TextureLoad
+	{
+		std::string fileName;
+		uint64_t contentHash;
+		std::vector<std::pair<std::string, size_t>> users; //canonical name, index into fileNames
+	};
+	std::vector<TextureLoad> loads;
+	std::map<std::string, size_t> loadByName;
+
+	//empty names keep the fallback texture
+	std::vector<size_t> texIds(fileNames.size(), 0);
+	for (size_t i = 0; i < fileNames.size(); ++i)
+	{
+		if (fileNames[i].empty())
+			continue;
+
+		auto canonicalName = TextureRegistry::Canonicalize(fileNames[i]);
+		if (textureRegistry.Acquire(canonicalName, &texIds[i]))
+			continue;
+
+		auto pending = loadByName.find(canonicalName);
+		if (pending != loadByName.end())
+		{
+			loads[pending->second].users.push_back({ canonicalName, i });
+			continue;
+		}
+
+		loadByName[canonicalName] = loads.size();
+		loads.push_back({ fileNames[i], 0, { { canonicalName, i } } });
+	}
+
+	if (DEDUP_TEXTURE_CONTENT && !streamed)
+	{
+		threadPool.ParallelFor(loads.size(), [&](size_t i)
+		{
+			loads[i].contentHash = HashTextureFile(loads[i].fileName);
+		});
+	}
+
+	//the user that triggered a load holds the reference Add gives it, the rest take theirs by name or content
+	auto acquireUsers = [&](const TextureLoad& load, size_t firstUser)
+	{
+		for (size_t u = firstUser; u < load.users.size(); ++u)
+		{
+			const auto& user = load.users[u];
+			if (!textureRegistry.Acquire(user.first, &texIds[user.second]))
+				textureRegistry.AcquireByHash(user.first, load.contentHash, &texIds[user.second]);
+		}
+	};
+
+	//copies of a loaded file, and of each other, under different names
+	std::vector<TextureLoad> toLoad;
+	std::map<uint64_t, size_t> loadByHash;
+	for (auto& load : loads)
+	{
+		if (textureRegistry.AcquireByHash(load.users[0].first, load.contentHash, &texIds[load.users[0].second]))
+		{
+			acquireUsers(load, 1);
+			continue;
+		}
+
+		auto sameContent = load.contentHash != 0 ? loadByHash.find(load.contentHash) : loadByHash.end();
+		if (sameContent != loadByHash.end())
+		{
+			auto& users = toLoad[sameContent->second].users;
+			users.insert(users.end(), load.users.begin(), load.users.end());
+			continue;
+		}
+
+		if (load.contentHash != 0)
+			loadByHash[load.contentHash] = toLoad.size();
+		toLoad.push_back(std::move(load));
+	}
+
+	if (streamed)
+	{
+		for (auto& load : toLoad)
+		{
+			//sized once decoded, hashed once uploaded
+			auto texId = CreateTextureSlot(texImgViews[0]);
+			textureRegistry.Add(load.users[0].first, load.contentHash, texId, 0);
+			texIds[load.users[0].second] = texId;
+			acquireUsers(load, 1);
+
+			StartTextureStream(texId, load.fileName);
+		}
+
+		std::cout << "streaming " << toLoad.size() << " textures, the fallback is sampled until they arrive" << std::endl;
+		return texIds;
+	}
+
+	//decoded on the workers, recorded here as each one finishes so the upload batch and vulkan stay on this thread
+	std::vector<DecodedTexture> decoded(toLoad.size());
+	std::vector<double> decodeMs(toLoad.size());
+	double lastDecodeMs = 0.0;
+
+	threadPool.ParallelFor(toLoad.size(), [&](size_t i)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		decoded[i] = DecodeTexture(toLoad[i].fileName, false);
+		decodeMs[i] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	},
+	[&](size_t i)
+	{
+		lastDecodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+
+		auto texId = CreateTexture(decoded[i], uploadBatch);
+		textureRegistry.Add(toLoad[i].users[0].first, toLoad[i].contentHash, texId, decoded[i].GetGpuBytes());
+		texIds[toLoad[i].users[0].second] = texId;
+		acquireUsers(toLoad[i], 1);
+
+		decoded[i] = DecodedTexture();
+	});
+
+	double serialMs = 0.0;
+	for (auto ms : decodeMs)
+		serialMs += ms;
+
+	auto totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+	std::cout << "decoded " << toLoad.size() << " textures in " << lastDecodeMs << " ms on " << threadPool.GetThreadCount()
+		<< " threads (" << serialMs << " ms one after another), all recorded after " << totalMs << " ms" << std::endl;
+
+	return texIds;
+}
+
+void VulkanRenderer::ReleaseTexture(size_t texId)
+{
+	size_t aliasOf;
+	bool aliased = textureRegistry.GetAlias(texId, &aliasOf);
+
+	if (!textureRegistry.Release(texId))
+		return;
+
+	//a texture still streaming in stops here, its worker finishes into a stream nobody looks at anymore
+	auto stream = std::find_if(textureStreams.begin(), textureStreams.end(),
+		[texId](const std::shared_ptr<TextureStream>& s) { return s->texId == texId; });
+	if (stream != textureStreams.end())
+	{
+		auto uploadValue = std::max((*stream)->tailValue, (*stream)->fullValue);
+		if (uploadValue > 0)
+		{
+			VkSemaphoreWaitInfo waitInfo = {};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &uploadTimeline;
+			waitInfo.pValues = &uploadValue;
+			vkWaitSemaphores(mainDevice.logicalDevice, &waitInfo, DRAW_TIMEOUT);
+		}
+
+		textureStreams.erase(stream);
+	}
+
+	//nothing in flight, views the texture moved off of can go before the image
+	RecycleTextureSets(true);
+
+	if (texImages[texId] != VK_NULL_HANDLE)
+	{
+		vkDestroyImageView(mainDevice.logicalDevice, texImgViews[texId], nullptr);
+		vkDestroyImage(mainDevice.logicalDevice, texImages[texId], nullptr);
+		memoryAllocator.Free(texImgMemories[texId]);
+	}
+
+	texImgViews[texId] = VK_NULL_HANDLE;
+	texImages[texId] = VK_NULL_HANDLE;
+	texImgMemories[texId] = MemoryAllocation();
+	freeTexIds.push_back(texId);
+
+	//an alias has no image of its own, only the reference it held on the texture it sampled
+	if (aliased)
+		ReleaseTexture(aliasOf);
+}
+
+void VulkanRenderer::StartTextureStream(size_t texId, const std::string& fileName)
+{
+	auto stream = std::make_shared<TextureStream>();
+	stream->texId = texId;
+	stream->fileName = fileName;
+
+	if (textureStreams.empty())
+	{
+		streamStart = std::chrono::high_resolution_clock::now();
+		streamedCount = 0;
+		mergedStreamCount = 0;
+	}
+	textureStreams.push_back(stream);
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		++decodingStreams;
+	}
+
+	threadPool.Run([this, stream]()
+	{
+		//every level on the cpu, the low ones are uploaded before level 0 so there is nothing to blit them from
+		try
+		{
+			stream->decoded = DecodeTexture(stream->fileName, true);
+		}
+		catch (const std::exception& e)
+		{
+			stream->error = e.what();
+		}
+
+		//here rather than on the loading thread, a copy is only found out once its upload is done
+		if (DEDUP_TEXTURE_CONTENT && stream->error.empty())
+			stream->contentHash = HashTextureFile(stream->fileName);
+
+		std::lock_guard<std::mutex> lock(streamMutex);
+		stream->decodeDone = true;
+		--decodingStreams;
+		streamCv.notify_all();
+	});
+}
+
+//bytes of levels [0, level) packed level 0 first
+static VkDeviceSize GetLevelOffset(VkFormat format, uint32_t wid, uint32_t hei, uint32_t level)
+{
+	VkDeviceSize offset = 0;
+	for (uint32_t l = 0; l < level; ++l)
+	{
+		offset += GetImageLevelSize(format, wid, hei);
+		wid = std::max(wid / 2, 1u);
+		hei = std::max(hei / 2, 1u);
+	}
+
+	return offset;
+}
+
+void VulkanRenderer::UpdateTextureStreams()
+{
+	RecycleTextureSets(false);
+
+	if (textureStreams.empty())
+		return;
+
+	//one small submit with the low levels of every texture decoded since last frame, one with the large levels that fit the budget
+	std::unique_ptr<UploadBatch> tailBatch;
+	std::unique_ptr<UploadBatch> fullBatch;
+	std::vector<TextureStream*> tailStreams;
+	std::vector<TextureStream*> fullStreams;
+	VkDeviceSize fullBytes = 0;
+
+	for (auto& streamPtr : textureStreams)
+	{
+		auto stream = streamPtr.get();
+		auto& decoded = stream->decoded;
+
+		//whatever earlier submits brought in, the whole texture or, when it came first, the low levels
+		if (stream->fullValue != 0 && stream->fullValue <= completedUploadValue)
+		{
+			//a copy of a texture that is in already (streamed ones only once uploaded) samples that one instead of its own image
+			size_t sameId;
+			if (stream->contentHash != 0 && textureRegistry.FindByHash(stream->contentHash, &sameId))
+			{
+				SwapTextureView(stream->texId, texImgViews[sameId], true);
+				textureRegistry.Alias(stream->texId, sameId);
+
+				textureBytes -= stream->gpuBytes;
+				rgbaTextureBytes -= MipChain::GetSize(decoded.wid, decoded.hei, decoded.mipLevels);
+				++mergedStreamCount;
+			}
+			else
+			{
+				SwapTextureView(stream->texId, CreateImageView(texImages[stream->texId], decoded.format, VK_IMAGE_ASPECT_COLOR_BIT,
+					0, decoded.mipLevels), false);
+				textureRegistry.SetContentHash(stream->texId, stream->contentHash);
+			}
+
+			stream->done = true;
+			++streamedCount;
+			continue;
+		}
+		if (stream->tailValue != 0 && !stream->tailShown && stream->tailValue <= completedUploadValue)
+		{
+			SwapTextureView(stream->texId, CreateImageView(texImages[stream->texId], decoded.format, VK_IMAGE_ASPECT_COLOR_BIT,
+				stream->tailLevel, decoded.mipLevels - stream->tailLevel), false);
+			stream->tailShown = true;
+		}
+
+		if (!stream->tailRecorded && stream->decodeDone)
+		{
+			if (!stream->error.empty())
+			{
+				std::cout << "failed to stream " << stream->fileName << " (" << stream->error << "), it keeps the fallback texture" << std::endl;
+				stream->done = true;
+				continue;
+			}
+
+			MemoryAllocation texImageMemory;
+			texImages[stream->texId] = CreateImage(decoded.wid, decoded.hei, decoded.format, &texImageMemory,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, decoded.mipLevels);
+			texImgMemories[stream->texId] = texImageMemory;
+
+			stream->gpuBytes = decoded.GetGpuBytes();
+			textureBytes += stream->gpuBytes;
+			rgbaTextureBytes += MipChain::GetSize(decoded.wid, decoded.hei, decoded.mipLevels);
+			textureRegistry.SetBytes(stream->texId, stream->gpuBytes);
+
+			while (stream->tailLevel + 1 < decoded.mipLevels &&
+				std::max(decoded.wid >> stream->tailLevel, decoded.hei >> stream->tailLevel) > STREAM_TAIL_SIZE)
+			{
+				++stream->tailLevel;
+			}
+
+			if (!tailBatch)
+				tailBatch = std::make_unique<UploadBatch>(mainDevice.logicalDevice, &memoryAllocator, GetUploadQueues());
+
+			RecordTextureLevels(stream, tailBatch.get(), stream->tailLevel, decoded.mipLevels - stream->tailLevel);
+			tailStreams.push_back(stream);
+			stream->tailRecorded = true;
+			stream->fullRecorded = stream->tailLevel == 0;
+		}
+
+		//at least one texture a frame however large, later ones wait for the next frame's budget
+		auto levelBytes = stream->tailRecorded ? GetLevelOffset(decoded.format, decoded.wid, decoded.hei, stream->tailLevel) : 0;
+		if (stream->tailRecorded && !stream->fullRecorded && (fullBytes == 0 || fullBytes + levelBytes <= STREAM_BYTES_PER_FRAME))
+		{
+			if (!fullBatch)
+				fullBatch = std::make_unique<UploadBatch>(mainDevice.logicalDevice, &memoryAllocator, GetUploadQueues());
+
+			RecordTextureLevels(stream, fullBatch.get(), 0, stream->tailLevel);
+			fullStreams.push_back(stream);
+			stream->fullRecorded = true;
+			fullBytes += levelBytes;
+		}
+
+		if (stream->fullRecorded)
+			std::vector<uint8_t>().swap(decoded.data);
+	}
+
+	//submitted in this order so the low levels never wait behind large ones
+	if (tailBatch)
+	{
+		auto uploadValue = tailBatch->Submit();
+		for (auto stream : tailStreams)
+		{
+			stream->tailValue = uploadValue;
+			if (stream->tailLevel == 0)
+				stream->fullValue = uploadValue;
+		}
+		pendingUploads.push_back(std::move(tailBatch));
+	}
+	if (fullBatch)
+	{
+		auto uploadValue = fullBatch->Submit();
+		for (auto stream : fullStreams)
+			stream->fullValue = uploadValue;
+		pendingUploads.push_back(std::move(fullBatch));
+	}
+
+	textureStreams.erase(std::remove_if(textureStreams.begin(), textureStreams.end(),
+		[](const std::shared_ptr<TextureStream>& s) { return s->done; }), textureStreams.end());
+
+	if (textureStreams.empty())
+	{
+		auto streamMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - streamStart).count();
+		std::cout << "streamed " << streamedCount << " textures (" << mergedStreamCount << " copies merged after upload), the last one in "
+			<< streamMs << " ms after the first was requested" << std::endl;
+		std::cout << "textures so far: " << textureBytes / (1024 * 1024) << " MB on the gpu, "
+			<< rgbaTextureBytes / (1024 * 1024) << " MB as rgba8" << std::endl;
+		textureRegistry.PrintStats();
+	}
+}
+
+void VulkanRenderer::RecordTextureLevels(TextureStream* stream, UploadBatch* uploadBatch, uint32_t baseMipLevel, uint32_t mipLevels)
+{
+	const auto& decoded = stream->decoded;
+	auto texImage = texImages[stream->texId];
+
+	auto offset = GetLevelOffset(decoded.format, decoded.wid, decoded.hei, baseMipLevel);
+	auto size = GetLevelOffset(decoded.format, decoded.wid, decoded.hei, baseMipLevel + mipLevels) - offset;
+
+	VkBuffer imgStagingBuffer;
+	auto data = uploadBatch->CreateStagingBuffer(size, &imgStagingBuffer);
+	memcpy(data, decoded.data.data() + offset, size);
+
+	uploadBatch->TransitionImageLayout(texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, baseMipLevel, mipLevels);
+	uploadBatch->CopyImgBuffer(imgStagingBuffer, texImage, decoded.format, decoded.wid, decoded.hei, baseMipLevel, mipLevels);
+	uploadBatch->TransitionImageLayout(texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		baseMipLevel, mipLevels);
+}
+
+void VulkanRenderer::SwapTextureView(size_t texId, VkImageView texImgView, bool dropImage)
+{
+	VkDescriptorSet descrSet;
+	if (!spareTextureSets.empty())
+	{
+		descrSet = spareTextureSets.back();
+		spareTextureSets.pop_back();
+	}
+	else
+	{
+		descrSet = AllocateTextureDescriptor();
+	}
+
+	WriteTextureDescriptor(descrSet, texImgView);
+
+	//recorded from now on, the old set is only safe to touch once this frame's predecessors are done
+	retiredTextureSets.push_back({ samplerDescriptorSets[texId], texImgViews[texId], VK_NULL_HANDLE, MemoryAllocation(), frameCount });
+	samplerDescriptorSets[texId] = descrSet;
+	texImgViews[texId] = texImgView;
+
+	//the slot keeps no image, so ReleaseTexture and Cleanup leave the view alone
+	if (dropImage)
+	{
+		retiredTextureSets.back().image = texImages[texId];
+		retiredTextureSets.back().memory = texImgMemories[texId];
+		texImages[texId] = VK_NULL_HANDLE;
+		texImgMemories[texId] = MemoryAllocation();
+	}
+}
+
+void VulkanRenderer::RecycleTextureSets(bool allFramesDone)
+{
+	size_t kept = 0;
+	for (auto& retired : retiredTextureSets)
+	{
+		if (!allFramesDone && retired.frame + MAX_QUEUED_DRAWS > frameCount)
+		{
+			retiredTextureSets[kept++] = retired;
+			continue;
+		}
+
+		if (retired.view != VK_NULL_HANDLE)
+			vkDestroyImageView(mainDevice.logicalDevice, retired.view, nullptr);
+		if (retired.image != VK_NULL_HANDLE)
+		{
+			vkDestroyImage(mainDevice.logicalDevice, retired.image, nullptr);
+			memoryAllocator.Free(retired.memory);
+		}
+		spareTextureSets.push_back(retired.descrSet);
+	}
+
+	retiredTextureSets.resize(kept);
+}
+
+VkDescriptorSet VulkanRenderer::AllocateTextureDescriptor()
+{
+	VkDescriptorSet descrSet;
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = samplerDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &samplerSetLayout;
+
+	if (VK_SUCCESS != vkAllocateDescriptorSets(mainDevice.logicalDevice, &allocInfo, &descrSet))
+		throw std::runtime_error("failed to alloc tex descriptor set");
+
+	return descrSet;
+}
+
+size_t VulkanRenderer::CreateTextureDescriptor(VkImageView texImgView)
+{
+	auto descrSet = AllocateTextureDescriptor();
+	WriteTextureDescriptor(descrSet, texImgView);
+
+	samplerDescriptorSets.push_back(descrSet);
+	return samplerDescriptorSets.size() - 1;
+}
+
+void VulkanRenderer::WriteTextureDescriptor(VkDescriptorSet descrSet, VkImageView texImgView)
+{
 	VkDescriptorImageInfo imgInfo = {};
 	imgInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	imgInfo.imageView = texImgView;
@@ -1610,37 +2776,439 @@ size_t VulkanRenderer::CreateTextureDescriptor(VkImageView texImgView)
 	dsWrite.pImageInfo = &imgInfo;
 
 	vkUpdateDescriptorSets(mainDevice.logicalDevice, 1, &dsWrite, 0, nullptr);
-
-	samplerDescriptorSets.push_back(descrSet);
-	return samplerDescriptorSets.size() - 1;
 }
 
 size_t VulkanRenderer::CreateMeshModel(std::string fileName)
 {
-	Assimp::Importer importer;
-	auto scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
-	if (!scene) throw std::runtime_error("failed to load model: " + fileName);
+	//the same file placed again shares the first copy's pool ranges and textures, nothing is loaded
+	auto shared = sharedGeometry.find(fileName);
+	if (shared != sharedGeometry.end())
+	{
+		++shared->second.refCount;
+
+		auto newModel = MeshModel(shared->second.meshes);
+		newModel.SetUploadValue(shared->second.uploadValue);
+		newModel.SetSourceName(fileName);
+		newModel.SetOccluders(shared->second.occluders);
+		models.push_back(newModel);
+		drawList.MarkDirty();
+		return models.size() - 1;
+	}
+
+	auto loadStart = std::chrono::high_resolution_clock::now();
+
+	//every buffer copy and image transition of this model goes into one submit
+	auto uploadBatch = std::make_unique<UploadBatch>(mainDevice.logicalDevice, &memoryAllocator, GetUploadQueues());
+
+	//assimp only runs when the cooked file is missing or the source changed since it was cooked
+	auto cookedName = fileName + ".cooked";
+	auto sourceHash = MeshCache::HashFile(fileName);
+
+	MeshCache cache;
+	MeshImporter importer;
+	bool warm = cache.Open(cookedName, sourceHash);
+
+	std::vector<std::string> texNames;
+	std::vector<MeshRange> meshRanges;
+	uint64_t totalVertices, totalIndices, totalLodIndices, totalMeshlets, totalMeshletVertices;
+	const Vertex* srcVerts;
+	const uint32_t* srcIndices;
+	const uint32_t* srcLodIndices;
+	const Meshlet* srcMeshlets;
+	const uint32_t* srcMeshletVertices;
+	const uint32_t* srcMeshletTriangles;
+
+	if (warm)
+	{
+		texNames = cache.GetTexNames();
+		for (size_t i = 0; i < cache.GetMeshCount(); ++i)
+			meshRanges.push_back(cache.GetMeshRange(i));
+
+		totalVertices = cache.GetTotalVertices();
+		totalIndices = cache.GetTotalIndices();
+		totalLodIndices = cache.GetTotalLodIndices();
+		srcVerts = cache.GetVertices();
+		srcIndices = cache.GetIndices();
+		srcLodIndices = cache.GetLodIndices();
+		totalMeshlets = cache.GetTotalMeshlets();
+		srcMeshlets = cache.GetMeshlets();
+		totalMeshletVertices = cache.GetTotalMeshletVertices();
+		srcMeshletVertices = cache.GetMeshletVertices();
+		srcMeshletTriangles = cache.GetMeshletTriangles();
+	}
+	else
+	{
+		//sized from the scene up front, nothing is converted yet
+		importer.Open(fileName);
+
+		texNames = importer.GetTexNames();
+		totalVertices = importer.GetTotalVertices();
+		totalIndices = importer.GetTotalIndices();
+	}
+
+	auto matToTex = CreateTextures(texNames, uploadBatch.get(), STREAM_TEXTURES);
+
+	//one staging buffer for all vertices, then all indices, then all lod indices, filled before any copy is recorded
+	//the mesh shaders' meshlet vertices and triangles follow when they are in use
+	//a cold load converts straight into it, everything after the indices is only sized by the importer and gets a second buffer
+	GeometryStaging staging = {};
+	staging.indexOffset = sizeof(Vertex) * totalVertices;
+	staging.meshletGeometry = meshShading;
+	VkDeviceSize geometryEnd = staging.indexOffset + sizeof(uint32_t) * totalIndices;
+
+	//places the lod indices and meshlet streams from extraOffset on, returns where they end
+	auto layoutExtraStaging = [&](VkDeviceSize extraOffset)
+	{
+		staging.lodIndexOffset = extraOffset;
+		staging.meshletVertexOffset = staging.lodIndexOffset + sizeof(uint32_t) * totalLodIndices;
+		staging.meshletTriangleOffset = staging.meshletVertexOffset + sizeof(uint32_t) * totalMeshletVertices;
+		return meshShading ? staging.meshletTriangleOffset + sizeof(uint32_t) * (totalIndices / 3) : staging.meshletVertexOffset;
+	};
+	auto copyExtraStaging = [&](char* data)
+	{
+		memcpy(data + staging.lodIndexOffset, srcLodIndices, sizeof(uint32_t) * totalLodIndices);
+		if (meshShading)
+		{
+			memcpy(data + staging.meshletVertexOffset, srcMeshletVertices, sizeof(uint32_t) * totalMeshletVertices);
+			memcpy(data + staging.meshletTriangleOffset, srcMeshletTriangles, sizeof(uint32_t) * (totalIndices / 3));
+		}
+	};
+
+	auto stagingData = static_cast<char*>(uploadBatch->CreateStagingBuffer(
+		warm ? layoutExtraStaging(geometryEnd) : geometryEnd, &staging.buffer));
+	staging.extraBuffer = staging.buffer;
+
+	//the simplifier, the occluder builder and the cook read the converted geometry over and over,
+	//without host cached staging they go through a cpu copy that only lives until this load returns
+	std::vector<Vertex> convertedVerts;
+	std::vector<uint32_t> convertedIndices;
+
+	if (warm)
+	{
+		memcpy(stagingData, srcVerts, sizeof(Vertex) * totalVertices);
+		memcpy(stagingData + staging.indexOffset, srcIndices, sizeof(uint32_t) * totalIndices);
+		copyExtraStaging(stagingData);
+	}
+	else
+	{
+		auto verts = reinterpret_cast<Vertex*>(stagingData);
+		auto indices = reinterpret_cast<uint32_t*>(stagingData + staging.indexOffset);
+		if (!uploadBatch->IsStagingCached())
+		{
+			convertedVerts.resize(totalVertices);
+			convertedIndices.resize(totalIndices);
+			verts = convertedVerts.data();
+			indices = convertedIndices.data();
+		}
+
+		importer.Convert(&threadPool, verts, indices);
+		importer.BuildLods(&threadPool, verts, indices);
+
+		if (!convertedVerts.empty())
+		{
+			memcpy(stagingData, verts, sizeof(Vertex) * totalVertices);
+			memcpy(stagingData + staging.indexOffset, indices, sizeof(uint32_t) * totalIndices);
+		}
+
+		meshRanges = importer.GetMeshRanges();
+		totalLodIndices = importer.GetLodIndices().size();
+		srcVerts = verts;
+		srcIndices = indices;
+		srcLodIndices = importer.GetLodIndices().data();
+		totalMeshlets = importer.GetMeshlets().size();
+		srcMeshlets = importer.GetMeshlets().data();
+		totalMeshletVertices = importer.GetMeshletVertices().size();
+		srcMeshletVertices = importer.GetMeshletVertices().data();
+		srcMeshletTriangles = importer.GetMeshletTriangles().data();
+
+		//nothing is recorded from the first buffer yet, so this one must not flush it
+		auto extraSize = layoutExtraStaging(0);
+		if (extraSize > 0)
+			copyExtraStaging(static_cast<char*>(uploadBatch->AppendStagingBuffer(extraSize, &staging.extraBuffer)));
+
+		MeshCache::Write(cookedName, sourceHash, texNames, meshRanges, srcVerts, totalVertices, srcIndices, totalIndices,
+			srcLodIndices, totalLodIndices, srcMeshlets, totalMeshlets, srcMeshletVertices, totalMeshletVertices, srcMeshletTriangles);
+	}
+
+	auto occluders = std::make_shared<std::vector<Occluder>>(meshRanges.size());
+	if (CPU_OCCLUSION_CULLING && !gpuDriven)
+	{
+		float largestRadius = 0.0f;
+		for (const auto& range : meshRanges)
+			largestRadius = std::max(largestRadius, range.sphere.w);
 
-	auto texNames = MeshModel::LoadMaterials(scene);
+		threadPool.ParallelFor(meshRanges.size(), [&](size_t i)
+		{
+			if (meshRanges[i].sphere.w >= largestRadius * OCCLUDER_MIN_RADIUS_RATIO)
+				MeshModel::BuildOccluder(srcVerts, srcIndices, meshRanges[i], OCCLUDER_GRID_CELLS, &(*occluders)[i]);
+		});
+	}
+
+	auto parseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+
+	std::vector<Mesh> allMeshes;
+	for (const auto& range : meshRanges)
+	{
+		allMeshes.push_back(Mesh(&geometryPool, uploadBatch.get(), staging, range, srcMeshlets, matToTex[range.materialIdx]));
+	}
+
+	//not waited on, Draw picks the model up once the timeline reaches this value
+	auto uploadValue = uploadBatch->Submit();
+
+	auto loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	std::cout << "loaded " << fileName << " in " << loadMs << " ms (" << (warm ? "warm, cooked cache, " : "cold, assimp + cook, ")
+		<< parseMs << " ms to staged geometry), " << uploadBatch->GetSubmitCount() << " upload submits ("
+		<< (BATCH_UPLOADS ? "batched" : "per resource") << ")" << std::endl;
+	std::cout << "textures so far: " << textureBytes / (1024 * 1024) << " MB on the gpu, "
+		<< rgbaTextureBytes / (1024 * 1024) << " MB as rgba8" << std::endl;
+	textureRegistry.PrintStats();
+	memoryAllocator.PrintStats();
+	geometryPool.PrintStats();
 
-	std::vector<size_t> matToTex(texNames.size());
+	pendingUploads.push_back(std::move(uploadBatch));
 
+	std::vector<size_t> texRefs;
 	for (size_t i = 0; i < texNames.size(); ++i)
 	{
 		if (!texNames[i].empty())
-			matToTex[i] = CreateTexture(texNames[i]);
-		else
-			matToTex[i] = 0;
+			texRefs.push_back(matToTex[i]);
 	}
 
-	auto allMeshes = MeshModel::LoadNode(mainDevice.physicalDevice, mainDevice.logicalDevice,
-		graphicsQueue, graphicsCommandPool, scene->mRootNode, scene, matToTex);
+	sharedGeometry[fileName] = { allMeshes, uploadValue, 1, occluders, texRefs };
 
 	auto newModel = MeshModel(allMeshes);
+	newModel.SetUploadValue(uploadValue);
+	newModel.SetSourceName(fileName);
+	newModel.SetOccluders(occluders);
 	models.push_back(newModel);
+	drawList.MarkDirty();
 	return models.size() - 1;
 }
 
+void VulkanRenderer::CookTextures(std::string dir)
+{
+	//offline, no device needed, only the worker pool
+	TextureEncoder::CookDirectory(&threadPool, dir);
+}
+
+void VulkanRenderer::BenchmarkMeshCache(std::string fileName, int runs)
+{
+	//cpu side only, what a cold and a warm start spend before anything is uploaded
+	auto cookedName = fileName + ".cooked";
+	double coldMs = 0.0, warmMs = 0.0;
+	size_t meshCount = 0;
+
+	for (int r = 0; r < runs; ++r)
+	{
+		auto coldStart = std::chrono::high_resolution_clock::now();
+		{
+			auto sourceHash = MeshCache::HashFile(fileName);
+
+			MeshImporter importer;
+			importer.Open(fileName);
+
+			std::vector<Vertex> verts(importer.GetTotalVertices());
+			std::vector<uint32_t> indices(importer.GetTotalIndices());
+			importer.Convert(&threadPool, verts.data(), indices.data());
+			importer.BuildLods(&threadPool, verts.data(), indices.data());
+
+			const auto& lodIndices = importer.GetLodIndices();
+			const auto& meshlets = importer.GetMeshlets();
+			const auto& meshletVertices = importer.GetMeshletVertices();
+			MeshCache::Write(cookedName, sourceHash, importer.GetTexNames(), importer.GetMeshRanges(),
+				verts.data(), verts.size(), indices.data(), indices.size(), lodIndices.data(), lodIndices.size(),
+				meshlets.data(), meshlets.size(), meshletVertices.data(), meshletVertices.size(), importer.GetMeshletTriangles().data());
+			meshCount = importer.GetMeshRanges().size();
+		}
+		coldMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - coldStart).count();
+
+		auto warmStart = std::chrono::high_resolution_clock::now();
+		{
+			MeshCache cache;
+			if (!cache.Open(cookedName, MeshCache::HashFile(fileName)))
+				throw std::runtime_error("failed to read back cooked mesh: " + cookedName);
+
+			//touch every page the upload would read so the mapping cost is counted
+			volatile uint32_t sink = 0;
+			auto verts = reinterpret_cast<const char*>(cache.GetVertices());
+			for (size_t b = 0; b < sizeof(Vertex) * cache.GetTotalVertices(); b += 4096)
+				sink = sink + verts[b];
+
+			auto indices = reinterpret_cast<const char*>(cache.GetIndices());
+			for (size_t b = 0; b < sizeof(uint32_t) * cache.GetTotalIndices(); b += 4096)
+				sink = sink + indices[b];
+
+			auto lodIndices = reinterpret_cast<const char*>(cache.GetLodIndices());
+			for (size_t b = 0; b < sizeof(uint32_t) * cache.GetTotalLodIndices(); b += 4096)
+				sink = sink + lodIndices[b];
+		}
+		warmMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - warmStart).count();
+	}
+
+	coldMs /= runs;
+	warmMs /= runs;
+	std::cout << "mesh cache benchmark " << fileName << " (" << meshCount << " meshes, " << runs << " runs): cold "
+		<< coldMs << " ms, warm " << warmMs << " ms, " << coldMs / warmMs << "x" << std::endl;
+}
+
+void VulkanRenderer::BenchmarkRecording(std::string fileName, size_t maxModels, int runs)
+{
+	//cpu cost of RecordCommands alone at every thread count, the loaded model is repeated to reach each count
+	auto id = CreateMeshModel(fileName);
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	CollectFinishedUploads();
+
+	auto originalCount = models.size();
+	auto base = models[id];
+
+	for (size_t count = 1; count <= maxModels; count *= 4)
+	{
+		models.resize(originalCount - 1);
+		for (size_t i = 0; i < count; ++i)
+			models.push_back(base);
+
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		drawList.Build(models);
+		auto buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+		UpdateUniformBuffers();
+
+		std::cout << "record benchmark: " << count << " models, " << drawList.GetDrawCount() << " draws, draw list build "
+			<< buildMs << " ms" << std::endl;
+
+		//1, 2, 4.. threads up to every worker plus the caller
+		double singleMs = 0.0;
+		for (size_t threads = 1; ; threads = std::min(threads * 2, recordSlots))
+		{
+			recordThreads = threads;
+
+			auto recordStart = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < runs; ++r)
+				RecordCommands(0);
+			auto recordMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count() / runs;
+
+			if (threads == 1)
+				singleMs = recordMs;
+
+			std::cout << "  " << threads << " threads: record " << recordMs << " ms ("
+				<< recordMs * 1000000.0 / std::max<size_t>(drawList.GetDrawCount(), 1) << " ns/draw), "
+				<< singleMs / recordMs << "x, " << recordStats.draws << " draws for " << recordStats.instances << " instances, "
+				<< recordStats.setBinds << " set + " << recordStats.bufferBinds
+				<< " buffer binds, " << recordStats.bindsSaved << " saved, " << recordStats.culled << " culled" << std::endl;
+
+			if (threads == recordSlots)
+				break;
+		}
+	}
+
+	//the copies share the original's pool ranges, drop them without freeing anything
+	models.resize(originalCount);
+	drawList.MarkDirty();
+	recordThreads = RECORD_THREADS == 0 ? recordSlots : std::min(RECORD_THREADS, recordSlots);
+}
+
+void VulkanRenderer::BenchmarkLods(std::string fileName, size_t gridSize, int frames)
+{
+	//cpu side level selection on a camera flying low over a grid of copies, triangles of the visible
+	//draws at the selected levels against the same draws fixed at the full mesh
+	auto id = CreateMeshModel(fileName);
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	CollectFinishedUploads();
+
+	auto originalCount = models.size();
+	auto base = models[id];
+
+	float radius = 0.0f;
+	for (size_t k = 0; k < base.GetMeshCount(); ++k)
+	{
+		auto sphere = base.GetMesh(k)->GetBoundingSphere();
+		radius = std::max(radius, glm::length(glm::vec3(sphere)) + sphere.w);
+	}
+
+	auto spacing = radius * 2.5f;
+	auto half = spacing * (gridSize - 1) * 0.5f;
+
+	models.resize(originalCount - 1);
+	std::vector<glm::mat4> benchModels;
+	for (size_t i = 0; i < models.size(); ++i)
+		benchModels.push_back(models[i].GetModel());
+
+	for (size_t z = 0; z < gridSize; ++z)
+	{
+		for (size_t x = 0; x < gridSize; ++x)
+		{
+			models.push_back(base);
+			benchModels.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(x * spacing - half, 0.0f, z * spacing - half)));
+		}
+	}
+
+	drawList.Build(models);
+
+	auto pixelsPerUnit = std::abs(uboViewProjection.projection[1][1]) * 0.5f * static_cast<float>(swapchainImgExtent.height);
+	uint64_t lodTriangles = 0, fullTriangles = 0;
+	double selectMs = 0.0;
+
+	for (int f = 0; f < frames; ++f)
+	{
+		//corner to corner along the diagonal, looking ahead and slightly down
+		auto t = frames > 1 ? static_cast<float>(f) / (frames - 1) : 0.0f;
+		auto eye = glm::mix(glm::vec3(-half, radius, -half), glm::vec3(half, radius, half), t);
+		auto view = glm::lookAt(eye, eye + glm::vec3(1.0f, -0.3f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		drawList.Cull(uboViewProjection.projection * view, benchModels);
+
+		auto selectStart = std::chrono::high_resolution_clock::now();
+		drawList.SelectLods(eye, pixelsPerUnit);
+		selectMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - selectStart).count();
+
+		lodTriangles += drawList.GetVisibleTriangles(true);
+		fullTriangles += drawList.GetVisibleTriangles(false);
+	}
+
+	frames = std::max(frames, 1);
+	std::cout << "lod benchmark: " << gridSize * gridSize << " models, " << drawList.GetDrawCount() << " draws, "
+		<< frames << " frame flythrough: " << lodTriangles / frames << " triangles per frame with lods, "
+		<< fullTriangles / frames << " at level 0 (" << 100.0 * lodTriangles / std::max<uint64_t>(fullTriangles, 1)
+		<< "%), selection " << selectMs * 1000.0 / frames << " us per frame" << std::endl;
+
+	//the copies share the original's pool ranges, drop them without freeing anything
+	models.resize(originalCount);
+	drawList.MarkDirty();
+}
+
+void VulkanRenderer::DestroyMeshModel(size_t id)
+{
+	if (id >= models.size() || models[id].GetMeshCount() == 0)
+		return;
+
+	//the pool ranges may be reused by the next upload, nothing in flight can still read them
+	vkWaitForFences(mainDevice.logicalDevice, static_cast<uint32_t>(drawFences.size()), drawFences.data(), VK_TRUE, DRAW_TIMEOUT);
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &uploadTimeline;
+	auto uploadValue = models[id].GetUploadValue();
+	waitInfo.pValues = &uploadValue;
+	vkWaitSemaphores(mainDevice.logicalDevice, &waitInfo, DRAW_TIMEOUT);
+
+	//only the last model placed from a file gives the pool ranges and its texture references back
+	auto shared = sharedGeometry.find(models[id].GetSourceName());
+	if (shared != sharedGeometry.end() && --shared->second.refCount == 0)
+	{
+		models[id].DestroyMeshModel();
+		for (auto texId : shared->second.texIds)
+			ReleaseTexture(texId);
+		sharedGeometry.erase(shared);
+	}
+	else
+	{
+		models[id].DetachMeshes();
+	}
+
+	drawList.MarkDirty();
+}
+
 glm::mat4 VulkanRenderer::GetModel(size_t id)
 {
 	if (!models.empty() && id < models.size())
@@ -10,16 +10,31 @@
 #include <assimp/postprocess.h>
 
 #include <stdexcept>
+#include <atomic>
 #include <vector>
 #include <set>
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <memory>
+#include <map>
 
 #include "stb_image.h"
 
 #include "Utils.h"
 #include "Mesh.h"
 #include "MeshModel.h"
+#include "UploadBatch.h"
+#include "GeometryPool.h"
+#include "MeshCache.h"
+#include "MeshImporter.h"
+#include "UniformRing.h"
+#include "DrawList.h"
+#include "GpuDrawList.h"
+#include "MipChain.h"
+#include "TextureFile.h"
+#include "TextureEncoder.h"
+#include "TextureRegistry.h"
 
 class VulkanRenderer
 {
@@ -31,6 +46,27 @@ public:
 	void InitScene();
 
 	size_t CreateMeshModel(std::string fileName);
+	void DestroyMeshModel(size_t id);
+	void BenchmarkMeshCache(std::string fileName, int runs);
+	void BenchmarkRecording(std::string fileName, size_t maxModels, int runs);
+	void BenchmarkLods(std::string fileName, size_t gridSize, int frames);
+	void CookTextures(std::string dir);
+
+	struct RecordStats
+	{
+		size_t draws = 0; //instanced draw calls
+		size_t instances = 0;
+		size_t setBinds = 0; //descriptor sets, counted one per set
+		size_t bufferBinds = 0; //vertex + index
+		size_t bindsSaved = 0; //against binding both sets and both buffers for every mesh instance
+		size_t visible = 0; //mesh draws left after frustum and occlusion culling
+		size_t culled = 0;
+		size_t occluded = 0; //part of culled, rejected by the cpu occlusion buffer
+		size_t disoccluded = 0; //drawn by the late phase after failing last frame's hi-z
+		size_t triangles = 0; //at the selected levels, cpu path only
+		size_t clustersCulled = 0; //meshlets of single instance draws facing away or outside the frustum, cpu path only
+	};
+	RecordStats GetRecordStats();
 	glm::mat4 GetModel(size_t id);
 	void UpdateModel(size_t id, glm::mat4 newModel);
 
@@ -55,8 +91,35 @@ private:
 		VkDevice logicalDevice;
 	} mainDevice;
 
+	ThreadPool threadPool;
+	MemoryAllocator memoryAllocator;
+	GeometryPool geometryPool;
+	DrawList drawList;
+	GpuDrawList gpuDrawList;
+	bool gpuDriven = false; //GPU_DRIVEN and the device has indirect count draws
+	bool meshShading = false; //MESH_SHADING, gpu driven and the device has task and mesh shaders
+	bool blitMips = false; //GENERATE_MIPS, GPU_MIPS and the texture format can be linearly blitted
+	bool bcTextures = false; //BC_TEXTURES and the device samples block compressed formats
+	uint64_t gpuUploadValue = 0; //highest upload value written by the last gpuDrawList update
+	HiZPyramid hiZPyramid;
+	OcclusionBuffer occlusionBuffer; //cpu path only
+	glm::mat4 hiZViewProj; //what the pyramid's depth was drawn with
+	bool hiZValid = false;
+
+	//pool ranges loaded from one file, every model placed from it shares them
+	struct SharedGeometry
+	{
+		std::vector<Mesh> meshes;
+		uint64_t uploadValue;
+		size_t refCount;
+		std::shared_ptr<const std::vector<Occluder>> occluders;
+		std::vector<size_t> texIds; //one texture reference per textured material, given back with the geometry
+	};
+	std::map<std::string, SharedGeometry> sharedGeometry;
+
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
+	VkQueue transferQueue; //graphicsQueue when there's no dedicated transfer family
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapchain;
 
@@ -64,10 +127,16 @@ private:
 	std::vector<VkFramebuffer> swapchainFramebuffers;
 	std::vector<VkCommandBuffer> commandBuffers;
 
+	//[frameIdx * recordSlots + slice], reset once the frame's fence is waited on
+	size_t recordSlots = 0;
+	size_t recordThreads = 0;
+	std::vector<VkCommandPool> recordCommandPools;
+	std::vector<VkCommandBuffer> recordCommandBuffers;
+
 	struct BufferImage
 	{
 		VkImage img;
-		VkDeviceMemory memory;
+		MemoryAllocation memory;
 		VkImageView imgView;
 	};
 	std::vector<BufferImage> depthBuffers;
@@ -81,32 +150,57 @@ private:
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSetLayout samplerSetLayout;
 	VkDescriptorSetLayout inputSetLayout;
-	VkPushConstantRange pushConstantRange;
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorPool samplerDescriptorPool;
 	VkDescriptorPool inputDescriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets; //1 per swapchain img
+	VkDescriptorSet frameDescriptorSet; //points at the uniform ring, moved with dynamic offsets
 	std::vector<VkDescriptorSet> samplerDescriptorSets; //1 per texture
 	std::vector<VkDescriptorSet> inputDescriptorSets;
 
-	std::vector<VkBuffer> vpUniformBuffers;
-	std::vector<VkDeviceMemory> vpUniformBufferMemories;
+	UniformRing uniformRing;
+	std::array<uint32_t, 3> frameDynamicOffsets = {}; //view projection, object buffer, instance stream
+	uint32_t* instanceStream = nullptr; //mapped, this frame's slice
+	std::vector<float> objectDepths; //view space, sorts the draw list front to back
+	std::vector<glm::mat4> objectModels; //cpu copy of the object buffer for culling, the mapped one may be uncached
+	std::array<glm::vec4, 6> framePlanes = {}; //world space frustum and camera of the frame being recorded, for cluster culling
+	glm::vec3 frameCameraPos = glm::vec3(0.0f);
+	uint64_t frameCount = 0;
+	RecordStats recordStats;
 
 	//std::vector<MeshModel> models;
 
 	std::vector<VkImage> texImages;
-	std::vector<VkDeviceMemory> texImgMemories;
+	std::vector<MemoryAllocation> texImgMemories;
 	std::vector<VkImageView> texImgViews;
+	std::vector<size_t> freeTexIds; //released, their descriptor sets are rewritten for the next texture
+	//sets a streamed texture moved off, with the view they sampled and the frame they were last recordable in
+	struct RetiredTextureSet
+	{
+		VkDescriptorSet descrSet;
+		VkImageView view; //VK_NULL_HANDLE for the fallback's, which stays
+		VkImage image; //VK_NULL_HANDLE unless the texture turned out to be a copy and samples another one's image now
+		MemoryAllocation memory;
+		uint64_t frame;
+	};
+	std::vector<RetiredTextureSet> retiredTextureSets;
+	std::vector<VkDescriptorSet> spareTextureSets; //no frame in flight can have them bound
+	TextureRegistry textureRegistry;
+	VkDeviceSize textureBytes = 0; //every level of every texture as uploaded
+	VkDeviceSize rgbaTextureBytes = 0; //the same textures as rgba8
 
 
 	VkPipeline graphicsPipeline;
 	VkPipelineLayout pipelineLayout;
+	VkPipeline meshPipeline = VK_NULL_HANDLE; //mesh shading only, full level meshlet draws
+	VkPipelineLayout meshPipelineLayout = VK_NULL_HANDLE;
 	VkPipeline blitPipeline;
 	VkPipelineLayout blitLayout;
 	VkRenderPass renderPass;
+	VkRenderPass earlyRenderPass; //gpu driven only, draws the early cull phase and keeps color and depth for renderPass
 
 	VkCommandPool graphicsCommandPool;
+	VkCommandPool transferCommandPool;
 
 	VkFormat swapchainImgFormat;
 	VkExtent2D swapchainImgExtent;
@@ -115,6 +209,15 @@ private:
 	std::vector<VkSemaphore> semsRenderFinished;
 	std::vector<VkFence> drawFences;
 
+	//signalled by upload batches, a frame only waits on the values of models it draws
+	VkSemaphore uploadTimeline;
+	uint64_t uploadTimelineValue = 0;
+	VkSemaphore uploadTransferTimeline; //transfer queue side of the ownership handoff
+	uint64_t uploadTransferTimelineValue = 0;
+	uint64_t completedUploadValue = 0;
+	uint64_t frameUploadValue = 0;
+	std::vector<std::unique_ptr<UploadBatch>> pendingUploads;
+
 	bool CheckValidationLayersAvailable(std::vector<const char*> wantedLayers);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
 
@@ -124,7 +227,6 @@ private:
 	void CreateSwapchain();
 	void CreateRenderPass();
 	void CreateDescriptorSetLayouts();
-	void CreatePushConstantRange();
 
 	void CreateGraphicsPipeline();
 	void CreateBlitPipeline();
@@ -135,17 +237,26 @@ private:
 	void CreateFramebuffers();
 	void CreateCommandPool();
 	void CreateCommandBuffers();
+	void CreateRecordCommandBuffers();
 	void CreateSyncObjects();
 	void CreateTexSampler();
 
-	void CreateUniformBuffers();
 	void CreateDescriptorPools();
 	void CreateDescriptorSets();
 	void CreateInputDescriptorSets();
 
-	void UpdateUniformBuffers(uint32_t imgIdx);
+	void UpdateUniformBuffers();
+
+	UploadQueues GetUploadQueues();
+	VkPipelineStageFlags GetUploadReadStages();
+	void CollectFinishedUploads();
 
 	void RecordCommands(uint32_t imgIdx);
+	//binds and draws batches [firstBatch, lastBatch) of the draw list
+	void RecordDraws(VkCommandBuffer cmdBuffer, size_t firstBatch, size_t lastBatch, RecordStats* stats);
+	void RecordGpuDraws(VkCommandBuffer cmdBuffer, CullPhase phase);
+	//fills occlusionBuffer with the occluders of every uploaded model
+	void RasterizeOccluders(const glm::mat4& viewProj);
 
 	void GetPhysicalDevice();
 	QueueFamilyIndices GetQueueFamilyIndices(VkPhysicalDevice device);
@@ -159,14 +270,80 @@ private:
 	VkExtent2D ChooseExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilities);
 	VkFormat ChooseSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags);
 
-	VkImage CreateImage(uint32_t wid, uint32_t hei, VkFormat format, VkDeviceMemory* imgMemory,
-		VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags);
-	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	VkImage CreateImage(uint32_t wid, uint32_t hei, VkFormat format, MemoryAllocation* imgMemory,
+		VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, uint32_t mipLevels);
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t mipLevels);
 	VkShaderModule CreateShaderModule(const std::vector<char> &shader);
 
-	size_t CreateTextureImage(std::string fileName);
-	size_t CreateTexture(std::string fileName);
+	//a texture ready for staging, decoding touches no vulkan state so it runs on any thread
+	struct DecodedTexture
+	{
+		VkFormat format;
+		uint32_t wid;
+		uint32_t hei;
+		uint32_t mipLevels;
+		uint32_t stagedLevels; //packed in data level 0 first, the ones after are blitted
+		std::vector<uint8_t> data;
+
+		//every level once uploaded, blitted ones included
+		VkDeviceSize GetGpuBytes() const
+		{
+			return stagedLevels < mipLevels ? MipChain::GetSize(wid, hei, mipLevels) : data.size();
+		}
+	};
+
+	//a texture decoding on a worker or on its way up, its id samples the fallback until the low levels are in, then those
+	struct TextureStream
+	{
+		size_t texId;
+		std::string fileName;
+		//written by the worker before decodeDone
+		DecodedTexture decoded;
+		uint64_t contentHash = 0; //0 when not deduplicating or the file couldn't be hashed
+		std::string error;
+		std::atomic<bool> decodeDone{ false };
+
+		uint32_t tailLevel = 0; //first level of the small upload, 0 when it is the whole texture
+		bool tailRecorded = false;
+		bool fullRecorded = false;
+		uint64_t tailValue = 0; //upload timeline values, 0 until submitted
+		uint64_t fullValue = 0;
+		bool tailShown = false;
+		bool done = false;
+		VkDeviceSize gpuBytes = 0; //known once decoded, decoded.data is dropped after recording
+	};
+	std::vector<std::shared_ptr<TextureStream>> textureStreams;
+	std::mutex streamMutex;
+	std::condition_variable streamCv;
+	size_t decodingStreams = 0; //still on a worker, released ones included, Cleanup waits for them
+	std::chrono::high_resolution_clock::time_point streamStart;
+	size_t streamedCount = 0;
+	size_t mergedStreamCount = 0; //of those, copies that sample a texture loaded under another name
+
+	//cpuMips: every level filtered here even when the gpu could blit them
+	DecodedTexture DecodeTexture(std::string fileName, bool cpuMips);
+	VkImage CreateTextureImage(const DecodedTexture& decoded, UploadBatch* uploadBatch, MemoryAllocation* texImageMemory);
+	size_t CreateTexture(const DecodedTexture& decoded, UploadBatch* uploadBatch);
+	//one texture id per name, 0 (the fallback) for empty ones, files already loaded are reused
+	//each non-empty name holds a reference, handed back with ReleaseTexture
+	//streamed: returns before anything is decoded or hashed, new ids sample the fallback until UpdateTextureStreams brings them in
+	std::vector<size_t> CreateTextures(const std::vector<std::string>& fileNames, UploadBatch* uploadBatch, bool streamed);
+	//only once nothing is in flight, sets the streamed textures moved off are recycled along with it
+	void ReleaseTexture(size_t texId);
+	//an id sampling texImgView, a released one first, with no image of its own yet
+	size_t CreateTextureSlot(VkImageView texImgView);
+	void StartTextureStream(size_t texId, const std::string& fileName);
+	//once a frame before recording: uploads finished decodes, low levels first, and swaps in whatever has arrived
+	void UpdateTextureStreams();
+	void RecordTextureLevels(TextureStream* stream, UploadBatch* uploadBatch, uint32_t baseMipLevel, uint32_t mipLevels);
+	//moves texId to another descriptor set sampling texImgView, frames in flight may still have the current one bound
+	//dropImage: texImgView is another texture's, texId's own image is retired along with the old set
+	void SwapTextureView(size_t texId, VkImageView texImgView, bool dropImage);
+	//allFramesDone only when nothing is in flight, otherwise sets wait out MAX_QUEUED_DRAWS frames
+	void RecycleTextureSets(bool allFramesDone);
+	VkDescriptorSet AllocateTextureDescriptor();
 	size_t CreateTextureDescriptor(VkImageView texImgView);
+	void WriteTextureDescriptor(VkDescriptorSet descrSet, VkImageView texImgView);
 
 	stbi_uc* LoadImage(std::string fileName, int* wid, int* hei, VkDeviceSize* imgSize);
 };
\ No newline at end of file
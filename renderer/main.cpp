@@ -21,13 +21,47 @@ void InitWindow(std::string name = "test", const int wid = 1600, const int hei =
 	window = glfwCreateWindow(wid, hei, name.c_str(), nullptr, nullptr);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	//--bench-cache: cold assimp import vs warm cooked cache load, no window needed
+	if (argc > 1 && std::string(argv[1]) == "--bench-cache")
+	{
+		renderer.BenchmarkMeshCache("Models\\abandoned_cottage.fbx", 5);
+		return 0;
+	}
+
+	//--cook-textures: block compress every image in Textures into a ktx2 next to it, no window needed
+	if (argc > 1 && std::string(argv[1]) == "--cook-textures")
+	{
+		renderer.CookTextures("Textures");
+		return 0;
+	}
+
 	InitWindow();
 
 	if (renderer.Init(window) == EXIT_FAILURE)
 		return EXIT_FAILURE;
 
+	//--bench-record: cpu time of command recording against model count
+	if (argc > 1 && std::string(argv[1]) == "--bench-record")
+	{
+		renderer.BenchmarkRecording("Models\\abandoned_cottage.fbx", 4096, 20);
+		renderer.Cleanup();
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return 0;
+	}
+
+	//--bench-lod: triangles submitted with per draw level selection vs the full meshes on a flythrough
+	if (argc > 1 && std::string(argv[1]) == "--bench-lod")
+	{
+		renderer.BenchmarkLods("Models\\abandoned_cottage.fbx", 32, 600);
+		renderer.Cleanup();
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return 0;
+	}
+
 	auto angle = 0.0f;
 	auto deltaTime = 0.0f;
 	auto lastTime = 0.0f;